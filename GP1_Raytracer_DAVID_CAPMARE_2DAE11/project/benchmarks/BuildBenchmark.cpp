@@ -0,0 +1,102 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BVH.h"
+#include "Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	struct BuilderConfig
+	{
+		const char* name;
+		BVHBuildSettings settings;
+	};
+
+	const BuilderConfig BUILDERS[]
+	{
+		{ "binned SAH", { BVHBuilder::BinnedSAH } },
+		{ "spatial split", { BVHBuilder::SpatialSplit } },
+		{ "morton 30 bit", { BVHBuilder::Morton, .3f, 30, 0 } },
+		{ "morton 63 bit", { BVHBuilder::Morton, .3f, 63, 0 } },
+		{ "morton + 2 treelet passes", { BVHBuilder::Morton, .3f, 30, 2 } },
+	};
+
+	constexpr int REPEAT_COUNT{ 3 };
+
+	// Small triangles scattered through a box, roughly what a scanned mesh looks like to the builder
+	void CreateRandomTriangles(size_t count, std::vector<Vector3>& positions, std::vector<int>& indices)
+	{
+		std::mt19937 rng{ 42 };
+		std::uniform_real_distribution<float> position{ -100.f, 100.f };
+		std::uniform_real_distribution<float> offset{ -.5f, .5f };
+
+		positions.clear();
+		indices.clear();
+		for (size_t triIdx{}; triIdx < count; ++triIdx)
+		{
+			const Vector3 center{ position(rng), position(rng), position(rng) };
+			for (int corner{}; corner < 3; ++corner)
+			{
+				indices.push_back(static_cast<int>(positions.size()));
+				positions.push_back(center + Vector3{ offset(rng), offset(rng), offset(rng) });
+			}
+		}
+	}
+
+	void RunBuilders(const std::string& name, const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		std::cout << name << " (" << triangleCount << " triangles)\n";
+
+		for (const BuilderConfig& builder : BUILDERS)
+		{
+			BVH bvh{};
+			bvh.SetBuildSettings(builder.settings);
+
+			// best of a few runs, the first one also pays for page faults
+			double bestMs{ 1e30 };
+			for (int run{}; run < REPEAT_COUNT; ++run)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				bvh.Build(positions, indices);
+				const auto end = std::chrono::steady_clock::now();
+				bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+			}
+
+			std::cout << "  " << std::left << std::setw(28) << builder.name << std::right << std::fixed << std::setprecision(2)
+				<< std::setw(10) << bestMs << " ms"
+				<< std::setw(10) << bestMs * 1e6 / triangleCount << " ms/Mtri"
+				<< "   SAH " << bvh.GetSAHCost() << '\n';
+		}
+	}
+}
+
+// Times every BVH builder, pass .obj files to also time real meshes: BuildBenchmark resources/PrikkitTea.obj
+int main(int argc, char* argv[])
+{
+	std::vector<Vector3> positions{};
+	std::vector<int> indices{};
+
+	for (const size_t count : { 100'000, 1'000'000 })
+	{
+		CreateRandomTriangles(count, positions, indices);
+		RunBuilders("random", positions, indices);
+	}
+
+	for (int argIdx{ 1 }; argIdx < argc; ++argIdx)
+	{
+		std::vector<Vector3> normals{};
+		if (!Utils::ParseOBJ(argv[argIdx], positions, normals, indices))
+		{
+			std::cout << "could not load " << argv[argIdx] << '\n';
+			continue;
+		}
+		RunBuilders(argv[argIdx], positions, indices);
+	}
+}
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	constexpr int SPHERE_COUNT{ 10'000 };
+	constexpr int PLANE_COUNT{ 64 };
+	constexpr int RAY_COUNT{ 2'000 };
+
+	template<typename Function>
+	double TimeNanoseconds(const Function& function)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		function();
+		const auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count();
+	}
+}
+
+// Closest hit over a flat list of spheres and planes without any hierarchy, one primitive per test against 8 per packet
+int main()
+{
+	std::mt19937 rng{ 42 };
+	std::uniform_real_distribution<float> position{ -10.f, 10.f };
+	std::uniform_real_distribution<float> radius{ .05f, .5f };
+
+	std::vector<Sphere> spheres{};
+	for (int sphereIdx{}; sphereIdx < SPHERE_COUNT; ++sphereIdx)
+	{
+		spheres.push_back({ { position(rng), position(rng), position(rng) }, radius(rng) });
+	}
+
+	std::vector<Plane> planes{};
+	for (int planeIdx{}; planeIdx < PLANE_COUNT; ++planeIdx)
+	{
+		planes.push_back({ { position(rng), position(rng), position(rng) }, Vector3{ position(rng), position(rng), position(rng) }.Normalized() });
+	}
+
+	std::vector<SpherePacket8> spherePackets{};
+	std::vector<PlanePacket8> planePackets{};
+	BuildPrimitivePackets(spheres, spherePackets);
+	BuildPrimitivePackets(planes, planePackets);
+
+	std::vector<Ray> rays{};
+	for (int rayIdx{}; rayIdx < RAY_COUNT; ++rayIdx)
+	{
+		const Vector3 origin{ position(rng), position(rng), -30.f };
+		rays.push_back({ origin, (Vector3{ position(rng), position(rng), position(rng) } - origin).Normalized() });
+	}
+
+	// the closest t is summed so neither loop can be thrown away
+	double sphereSum{}, spherePacketSum{}, planeSum{}, planePacketSum{};
+	const double sphereNs = TimeNanoseconds([&]
+		{
+			for (const Ray& ray : rays)
+			{
+				HitRecord closestHit{}, tempHit{};
+				for (const Sphere& sphere : spheres)
+				{
+					if (GeometryUtils::HitTest_Sphere(sphere, ray, tempHit) && tempHit.t < closestHit.t) closestHit = tempHit;
+				}
+				if (closestHit.didHit) sphereSum += closestHit.t;
+			}
+		});
+
+	const double spherePacketNs = TimeNanoseconds([&]
+		{
+			for (const Ray& ray : rays)
+			{
+				float t{};
+				uint32_t sphereIdx{};
+				if (GeometryUtils::HitTest_SpherePackets(spherePackets, ray, t, sphereIdx)) spherePacketSum += t;
+			}
+		});
+
+	const double planeNs = TimeNanoseconds([&]
+		{
+			for (const Ray& ray : rays)
+			{
+				HitRecord closestHit{}, tempHit{};
+				for (const Plane& plane : planes)
+				{
+					GeometryUtils::HitTest_Plane(plane, ray, tempHit);
+					closestHit = tempHit.t < closestHit.t ? tempHit : closestHit;
+				}
+				if (closestHit.didHit) planeSum += closestHit.t;
+			}
+		});
+
+	const double planePacketNs = TimeNanoseconds([&]
+		{
+			for (const Ray& ray : rays)
+			{
+				float t{};
+				uint32_t planeIdx{};
+				if (GeometryUtils::HitTest_PlanePackets(planePackets, ray, t, planeIdx)) planePacketSum += t;
+			}
+		});
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< SPHERE_COUNT << " spheres, one at a time   " << sphereNs / RAY_COUNT << " ns/ray (t sum " << sphereSum << ")\n"
+		<< SPHERE_COUNT << " spheres, SpherePacket8   " << spherePacketNs / RAY_COUNT << " ns/ray (t sum " << spherePacketSum << ")\n"
+		<< PLANE_COUNT << " planes, one at a time      " << planeNs / RAY_COUNT << " ns/ray (t sum " << planeSum << ")\n"
+		<< PLANE_COUNT << " planes, PlanePacket8       " << planePacketNs / RAY_COUNT << " ns/ray (t sum " << planePacketSum << ")\n";
+}
@@ -0,0 +1,116 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	constexpr int TRIANGLE_COUNT{ 100'000 };
+	constexpr int RAY_COUNT{ 200 };
+
+	template<typename Function>
+	double TimeNanoseconds(const Function& function)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		function();
+		const auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count();
+	}
+}
+
+// Times the ray/triangle kernels on every triangle of a random mesh, then whole closest-hit queries through the mesh hierarchy
+int main()
+{
+	std::mt19937 rng{ 42 };
+	std::uniform_real_distribution<float> position{ -10.f, 10.f };
+	std::uniform_real_distribution<float> offset{ -.5f, .5f };
+
+	TriangleMesh mesh{};
+	mesh.cullMode = TriangleCullMode::BackFaceCulling;
+	for (int triIdx{}; triIdx < TRIANGLE_COUNT; ++triIdx)
+	{
+		const Vector3 center{ position(rng), position(rng), position(rng) };
+		mesh.AppendTriangle({ center + Vector3{ offset(rng), offset(rng), offset(rng) },
+			center + Vector3{ offset(rng), offset(rng), offset(rng) },
+			center + Vector3{ offset(rng), offset(rng), offset(rng) } }, true);
+	}
+	mesh.UpdateGeometry();
+	mesh.UpdateTransforms();
+
+	std::vector<Ray> rays{};
+	for (int rayIdx{}; rayIdx < RAY_COUNT; ++rayIdx)
+	{
+		const Vector3 origin{ position(rng), position(rng), -30.f };
+		rays.push_back({ origin, (Vector3{ position(rng), position(rng), position(rng) } - origin).Normalized() });
+	}
+
+	// hits are counted so neither loop can be thrown away
+	int triangleHits{};
+	const double triangleNs = TimeNanoseconds([&]
+		{
+			Triangle triangle{};
+			triangle.cullMode = mesh.cullMode;
+			HitRecord hitRecord{};
+			for (const Ray& ray : rays)
+			{
+				for (size_t idx{}; idx < mesh.indices.size(); idx += 3)
+				{
+					triangle.v0 = mesh.positions[mesh.indices[idx]];
+					triangle.v1 = mesh.positions[mesh.indices[idx + 1]];
+					triangle.v2 = mesh.positions[mesh.indices[idx + 2]];
+					triangleHits += GeometryUtils::HitTest_Triangle(triangle, ray, hitRecord);
+				}
+			}
+		});
+
+	int recordHits{};
+	const double recordNs = TimeNanoseconds([&]
+		{
+			for (const Ray& ray : rays)
+			{
+				for (const TriangleRecord& record : mesh.triangleRecords)
+				{
+					float t;
+					recordHits += GeometryUtils::HitTest_TriangleRecord(record, mesh.cullMode, ray, false, t);
+				}
+			}
+		});
+
+	int packetHits{};
+	const double packetNs = TimeNanoseconds([&]
+		{
+			alignas(32) float distances[TrianglePacket8::WIDTH];
+			for (const Ray& ray : rays)
+			{
+				for (const TrianglePacket8& packet : mesh.trianglePackets)
+				{
+					packetHits += std::popcount(GeometryUtils::HitTest_TrianglePacket(packet, 0xFF, mesh.cullMode, ray, false, distances));
+				}
+			}
+		});
+
+	int meshHits{};
+	const double meshNs = TimeNanoseconds([&]
+		{
+			for (int repeat{}; repeat < 1000; ++repeat)
+			{
+				for (const Ray& ray : rays)
+				{
+					HitRecord hitRecord{};
+					meshHits += GeometryUtils::HitTest_TriangleMesh(mesh, ray, hitRecord);
+				}
+			}
+		});
+
+	const double testCount = double(RAY_COUNT) * TRIANGLE_COUNT;
+	std::cout << std::fixed << std::setprecision(2)
+		<< "Triangle rebuilt per test   " << triangleNs / testCount << " ns/test (" << triangleHits << " hits)\n"
+		<< "Precomputed TriangleRecord  " << recordNs / testCount << " ns/test (" << recordHits << " hits)\n"
+		<< "8-wide TrianglePacket8      " << packetNs / testCount << " ns/test (" << packetHits << " hits)\n"
+		<< "Mesh closest hit            " << meshNs / (RAY_COUNT * 1000.0) << " ns/ray (" << meshHits / 1000 << " hits)\n";
+}
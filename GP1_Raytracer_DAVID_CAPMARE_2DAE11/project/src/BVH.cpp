@@ -0,0 +1,1876 @@
+#include "BVH.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
+namespace dae
+{
+	namespace
+	{
+		AABB GetNodeBounds(const BVHNode& node)
+		{
+			return { node.minAABB, node.maxAABB };
+		}
+
+		float GetNodeCost(const BVHNode& node)
+		{
+			return GetNodeBounds(node).Area() * (node.IsLeaf() ? node.primitiveCount : 1.f);
+		}
+
+		AABB GetTriangleBounds(const std::vector<Vector3>& positions, const std::vector<int>& indices, uint32_t triIdx)
+		{
+			AABB bounds{};
+			bounds.Grow(positions[indices[size_t(triIdx) * 3]]);
+			bounds.Grow(positions[indices[size_t(triIdx) * 3 + 1]]);
+			bounds.Grow(positions[indices[size_t(triIdx) * 3 + 2]]);
+			return bounds;
+		}
+
+		struct Bin
+		{
+			AABB bounds{};
+			uint32_t primitiveCount{};
+		};
+
+		struct SplitPlane
+		{
+			int axis{ -1 };
+			int bin{};
+			float centroidMin{};
+			float binScale{};
+
+			int GetBin(float centroid) const
+			{
+				return std::min(BVH::BIN_COUNT - 1, static_cast<int>((centroid - centroidMin) * binScale));
+			}
+		};
+
+		struct BuildContext
+		{
+			std::vector<BVHNode>& nodes;
+			std::vector<uint32_t>& primitiveIndices;
+			const std::vector<AABB>& primitiveBounds;
+			std::vector<Vector3> centroids{};
+			uint32_t nodesUsed{};
+		};
+
+		void UpdateNodeBounds(BuildContext& context, uint32_t nodeIdx)
+		{
+			BVHNode& node = context.nodes[nodeIdx];
+			AABB bounds{};
+			for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+			{
+				bounds.Grow(context.primitiveBounds[context.primitiveIndices[node.leftFirst + i]]);
+			}
+			node.minAABB = bounds.min;
+			node.maxAABB = bounds.max;
+		}
+
+		//Binned SAH over the centroids of count items, shared by the object split builders
+		template<typename GetCentroid, typename GetBounds>
+		float FindBestSplitPlane(uint32_t count, const GetCentroid& getCentroid, const GetBounds& getBounds, SplitPlane& bestSplit)
+		{
+			float bestCost{ FLT_MAX };
+
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				//bin on centroid bounds, not on node bounds, so no bin stays empty by construction
+				float centroidMin{ FLT_MAX }, centroidMax{ -FLT_MAX };
+				for (uint32_t i{ 0 }; i < count; ++i)
+				{
+					const float c = getCentroid(i)[axis];
+					centroidMin = std::min(centroidMin, c);
+					centroidMax = std::max(centroidMax, c);
+				}
+				if (centroidMin == centroidMax) continue;
+
+				SplitPlane split{ axis, 0, centroidMin, BVH::BIN_COUNT / (centroidMax - centroidMin) };
+
+				Bin bins[BVH::BIN_COUNT]{};
+				for (uint32_t i{ 0 }; i < count; ++i)
+				{
+					Bin& bin = bins[split.GetBin(getCentroid(i)[axis])];
+					bin.bounds.Grow(getBounds(i));
+					++bin.primitiveCount;
+				}
+
+				//sweep from both sides to get the area and count of every candidate plane
+				float leftArea[BVH::BIN_COUNT - 1]{}, rightArea[BVH::BIN_COUNT - 1]{};
+				uint32_t leftCount[BVH::BIN_COUNT - 1]{}, rightCount[BVH::BIN_COUNT - 1]{};
+				AABB leftBox{}, rightBox{};
+				uint32_t leftSum{}, rightSum{};
+				for (int i{ 0 }; i < BVH::BIN_COUNT - 1; ++i)
+				{
+					leftSum += bins[i].primitiveCount;
+					leftCount[i] = leftSum;
+					leftBox.Grow(bins[i].bounds);
+					leftArea[i] = leftBox.Area();
+
+					rightSum += bins[BVH::BIN_COUNT - 1 - i].primitiveCount;
+					rightCount[BVH::BIN_COUNT - 2 - i] = rightSum;
+					rightBox.Grow(bins[BVH::BIN_COUNT - 1 - i].bounds);
+					rightArea[BVH::BIN_COUNT - 2 - i] = rightBox.Area();
+				}
+
+				for (int i{ 0 }; i < BVH::BIN_COUNT - 1; ++i)
+				{
+					if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+
+					const float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestSplit = split;
+						bestSplit.bin = i;
+					}
+				}
+			}
+
+			return bestCost;
+		}
+
+		void Subdivide(BuildContext& context, uint32_t nodeIdx, int depth)
+		{
+			BVHNode& node = context.nodes[nodeIdx];
+			if (node.primitiveCount <= 1 || depth >= BVH::MAX_DEPTH) return;
+
+			const uint32_t* primitives = &context.primitiveIndices[node.leftFirst];
+			SplitPlane split{};
+			const float splitCost = FindBestSplitPlane(node.primitiveCount,
+				[&](uint32_t i) -> const Vector3& { return context.centroids[primitives[i]]; },
+				[&](uint32_t i) -> const AABB& { return context.primitiveBounds[primitives[i]]; }, split);
+
+			const float leafCost = GetNodeCost(node);
+			if (split.axis < 0 || splitCost >= leafCost) return;
+
+			const auto first = context.primitiveIndices.begin() + node.leftFirst;
+			const auto middle = std::partition(first, first + node.primitiveCount, [&](uint32_t primitiveIdx)
+				{
+					return split.GetBin(context.centroids[primitiveIdx][split.axis]) <= split.bin;
+				});
+
+			const uint32_t leftCount = static_cast<uint32_t>(middle - first);
+			if (leftCount == 0 || leftCount == node.primitiveCount) return;
+
+			const uint32_t leftIdx = context.nodesUsed++;
+			const uint32_t rightIdx = context.nodesUsed++;
+
+			context.nodes[leftIdx].leftFirst = node.leftFirst;
+			context.nodes[leftIdx].primitiveCount = leftCount;
+			context.nodes[rightIdx].leftFirst = node.leftFirst + leftCount;
+			context.nodes[rightIdx].primitiveCount = node.primitiveCount - leftCount;
+
+			node.leftFirst = leftIdx;
+			node.primitiveCount = 0;
+
+			UpdateNodeBounds(context, leftIdx);
+			UpdateNodeBounds(context, rightIdx);
+
+			Subdivide(context, leftIdx, depth + 1);
+			Subdivide(context, rightIdx, depth + 1);
+		}
+
+		//A triangle reference of the spatial split builder, its bounds shrink every time the triangle gets split
+		struct Reference
+		{
+			AABB bounds{};
+			uint32_t primitiveIdx{};
+		};
+
+		struct SpatialSplitContext
+		{
+			std::vector<BVHNode>& nodes;
+			std::vector<uint32_t>& primitiveIndices;
+			const std::vector<Vector3>& positions;
+			const std::vector<int>& indices;
+			float minOverlapArea{};
+			size_t duplicateBudget{};
+		};
+
+		struct SpatialBin
+		{
+			AABB bounds{};
+			uint32_t entryCount{};
+			uint32_t exitCount{};
+		};
+
+		struct SpatialSplit
+		{
+			int axis{ -1 };
+			float position{};
+			AABB leftBounds{};
+			AABB rightBounds{};
+			uint32_t leftCount{};
+			uint32_t rightCount{};
+		};
+
+		//Bounds of the part of the triangle inside [slabMin, slabMax] on axis, limited to what the reference already covered
+		AABB ClipReference(const SpatialSplitContext& context, const Reference& reference, int axis, float slabMin, float slabMax)
+		{
+			const size_t idx = size_t(reference.primitiveIdx) * 3;
+			const Vector3 vertices[3]{ context.positions[context.indices[idx]], context.positions[context.indices[idx + 1]], context.positions[context.indices[idx + 2]] };
+
+			AABB clipped{};
+			for (int vertex{ 0 }; vertex < 3; ++vertex)
+			{
+				const Vector3& a = vertices[vertex];
+				const Vector3& b = vertices[(vertex + 1) % 3];
+
+				if (a[axis] >= slabMin && a[axis] <= slabMax) clipped.Grow(a);
+
+				//points where the edge crosses one of the slab planes
+				for (const float plane : { slabMin, slabMax })
+				{
+					if ((a[axis] < plane && b[axis] > plane) || (a[axis] > plane && b[axis] < plane))
+					{
+						Vector3 p = a + (b - a) * ((plane - a[axis]) / (b[axis] - a[axis]));
+						p[axis] = plane;
+						clipped.Grow(p);
+					}
+				}
+			}
+
+			clipped.min = Vector3::Max(clipped.min, reference.bounds.min);
+			clipped.max = Vector3::Min(clipped.max, reference.bounds.max);
+			return clipped;
+		}
+
+		bool IsValid(const AABB& bounds)
+		{
+			return bounds.min.x <= bounds.max.x && bounds.min.y <= bounds.max.y && bounds.min.z <= bounds.max.z;
+		}
+
+		//Binned spatial splits: references are clipped into every bin they overlap, a reference is counted where it enters and where it leaves
+		float FindBestSpatialSplit(const SpatialSplitContext& context, const AABB& nodeBounds, const std::vector<Reference>& references, SpatialSplit& bestSplit)
+		{
+			float bestCost{ FLT_MAX };
+
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				const float nodeMin = nodeBounds.min[axis];
+				const float binWidth = (nodeBounds.max[axis] - nodeMin) / BVH::BIN_COUNT;
+				if (binWidth <= 0.f) continue;
+
+				const auto getBin = [&](float position)
+					{
+						return std::clamp(static_cast<int>((position - nodeMin) / binWidth), 0, BVH::BIN_COUNT - 1);
+					};
+
+				SpatialBin bins[BVH::BIN_COUNT]{};
+				for (const Reference& reference : references)
+				{
+					const int firstBin = getBin(reference.bounds.min[axis]);
+					const int lastBin = std::max(firstBin, getBin(reference.bounds.max[axis]));
+
+					for (int bin{ firstBin }; bin <= lastBin; ++bin)
+					{
+						if (firstBin == lastBin)
+						{
+							bins[bin].bounds.Grow(reference.bounds);
+							break;
+						}
+
+						const float binMin = (bin == firstBin) ? reference.bounds.min[axis] : nodeMin + bin * binWidth;
+						const float binMax = (bin == lastBin) ? reference.bounds.max[axis] : nodeMin + (bin + 1) * binWidth;
+						const AABB clipped = ClipReference(context, reference, axis, binMin, binMax);
+						if (IsValid(clipped)) bins[bin].bounds.Grow(clipped);
+					}
+
+					++bins[firstBin].entryCount;
+					++bins[lastBin].exitCount;
+				}
+
+				AABB leftBoxes[BVH::BIN_COUNT - 1]{}, rightBoxes[BVH::BIN_COUNT - 1]{};
+				uint32_t leftCounts[BVH::BIN_COUNT - 1]{}, rightCounts[BVH::BIN_COUNT - 1]{};
+				AABB leftBox{}, rightBox{};
+				uint32_t leftSum{}, rightSum{};
+				for (int i{ 0 }; i < BVH::BIN_COUNT - 1; ++i)
+				{
+					leftSum += bins[i].entryCount;
+					leftCounts[i] = leftSum;
+					leftBox.Grow(bins[i].bounds);
+					leftBoxes[i] = leftBox;
+
+					rightSum += bins[BVH::BIN_COUNT - 1 - i].exitCount;
+					rightCounts[BVH::BIN_COUNT - 2 - i] = rightSum;
+					rightBox.Grow(bins[BVH::BIN_COUNT - 1 - i].bounds);
+					rightBoxes[BVH::BIN_COUNT - 2 - i] = rightBox;
+				}
+
+				for (int i{ 0 }; i < BVH::BIN_COUNT - 1; ++i)
+				{
+					if (leftCounts[i] == 0 || rightCounts[i] == 0) continue;
+
+					const float cost = leftCounts[i] * leftBoxes[i].Area() + rightCounts[i] * rightBoxes[i].Area();
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestSplit = { axis, nodeMin + (i + 1) * binWidth, leftBoxes[i], rightBoxes[i], leftCounts[i], rightCounts[i] };
+					}
+				}
+			}
+
+			return bestCost;
+		}
+
+		//Sends every reference to the side of the plane it is on. Straddling ones get split while the budget lasts,
+		//unless moving them to one side whole is cheaper (reference unsplitting)
+		void PartitionSpatial(SpatialSplitContext& context, const std::vector<Reference>& references, const SpatialSplit& split,
+			std::vector<Reference>& left, std::vector<Reference>& right)
+		{
+			const float leftArea = split.leftBounds.Area();
+			const float rightArea = split.rightBounds.Area();
+			const float splitCost = leftArea * split.leftCount + rightArea * split.rightCount;
+
+			for (const Reference& reference : references)
+			{
+				if (reference.bounds.max[split.axis] <= split.position)
+				{
+					left.push_back(reference);
+					continue;
+				}
+				if (reference.bounds.min[split.axis] >= split.position)
+				{
+					right.push_back(reference);
+					continue;
+				}
+
+				AABB grownLeft = split.leftBounds;
+				grownLeft.Grow(reference.bounds);
+				AABB grownRight = split.rightBounds;
+				grownRight.Grow(reference.bounds);
+
+				const float leftOnlyCost = grownLeft.Area() * split.leftCount + rightArea * (split.rightCount - 1);
+				const float rightOnlyCost = leftArea * (split.leftCount - 1) + grownRight.Area() * split.rightCount;
+
+				if (context.duplicateBudget > 0 && splitCost < leftOnlyCost && splitCost < rightOnlyCost)
+				{
+					const Reference leftPart{ ClipReference(context, reference, split.axis, -FLT_MAX, split.position), reference.primitiveIdx };
+					const Reference rightPart{ ClipReference(context, reference, split.axis, split.position, FLT_MAX), reference.primitiveIdx };
+
+					//float clipping can leave a sliver with nothing in it, that side just does not get the reference
+					if (IsValid(leftPart.bounds) && IsValid(rightPart.bounds))
+					{
+						left.push_back(leftPart);
+						right.push_back(rightPart);
+						--context.duplicateBudget;
+						continue;
+					}
+				}
+
+				if (leftOnlyCost <= rightOnlyCost)
+					left.push_back(reference);
+				else
+					right.push_back(reference);
+			}
+		}
+
+		void SubdivideSpatial(SpatialSplitContext& context, uint32_t nodeIdx, std::vector<Reference>& references, int depth)
+		{
+			AABB nodeBounds{};
+			for (const Reference& reference : references)
+			{
+				nodeBounds.Grow(reference.bounds);
+			}
+			context.nodes[nodeIdx].minAABB = nodeBounds.min;
+			context.nodes[nodeIdx].maxAABB = nodeBounds.max;
+
+			const auto makeLeaf = [&]()
+				{
+					context.nodes[nodeIdx].leftFirst = static_cast<uint32_t>(context.primitiveIndices.size());
+					context.nodes[nodeIdx].primitiveCount = static_cast<uint32_t>(references.size());
+					for (const Reference& reference : references)
+					{
+						context.primitiveIndices.push_back(reference.primitiveIdx);
+					}
+				};
+
+			const uint32_t count = static_cast<uint32_t>(references.size());
+			if (count <= 1 || depth >= BVH::MAX_DEPTH)
+			{
+				makeLeaf();
+				return;
+			}
+
+			SplitPlane objectSplit{};
+			const float objectCost = FindBestSplitPlane(count,
+				[&](uint32_t i) { return references[i].bounds.GetCenter(); },
+				[&](uint32_t i) -> const AABB& { return references[i].bounds; }, objectSplit);
+
+			//spatial splits only pay off where the object split children overlap a lot
+			SpatialSplit spatialSplit{};
+			float spatialCost{ FLT_MAX };
+			if (context.duplicateBudget > 0)
+			{
+				float overlapArea{ FLT_MAX };
+				if (objectSplit.axis >= 0)
+				{
+					AABB leftBounds{}, rightBounds{};
+					for (const Reference& reference : references)
+					{
+						const bool isLeft = objectSplit.GetBin(reference.bounds.GetCenter()[objectSplit.axis]) <= objectSplit.bin;
+						(isLeft ? leftBounds : rightBounds).Grow(reference.bounds);
+					}
+
+					AABB overlap{ Vector3::Max(leftBounds.min, rightBounds.min), Vector3::Min(leftBounds.max, rightBounds.max) };
+					overlapArea = IsValid(overlap) ? overlap.Area() : 0.f;
+				}
+
+				if (overlapArea > context.minOverlapArea)
+				{
+					spatialCost = FindBestSpatialSplit(context, nodeBounds, references, spatialSplit);
+				}
+			}
+
+			const float leafCost = nodeBounds.Area() * count;
+			if (std::min(objectCost, spatialCost) >= leafCost)
+			{
+				makeLeaf();
+				return;
+			}
+
+			std::vector<Reference> left{}, right{};
+			if (spatialCost < objectCost)
+			{
+				PartitionSpatial(context, references, spatialSplit, left, right);
+			}
+			else
+			{
+				for (const Reference& reference : references)
+				{
+					const bool isLeft = objectSplit.GetBin(reference.bounds.GetCenter()[objectSplit.axis]) <= objectSplit.bin;
+					(isLeft ? left : right).push_back(reference);
+				}
+			}
+
+			if (left.empty() || right.empty())
+			{
+				makeLeaf();
+				return;
+			}
+
+			//the children get their own reference lists, this one is no longer needed while they subdivide
+			references.clear();
+			references.shrink_to_fit();
+
+			const uint32_t leftIdx = static_cast<uint32_t>(context.nodes.size());
+			context.nodes.resize(context.nodes.size() + 2);
+			context.nodes[nodeIdx].leftFirst = leftIdx;
+			context.nodes[nodeIdx].primitiveCount = 0;
+
+			SubdivideSpatial(context, leftIdx, left, depth + 1);
+			SubdivideSpatial(context, leftIdx + 1, right, depth + 1);
+		}
+		//Splits [0, count) into chunks of chunkSize and runs function(chunk, begin, end) for all of them on every core
+		template<typename Function>
+		void ParallelForChunks(uint32_t count, uint32_t chunkSize, const Function& function)
+		{
+			const uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+			if (chunkCount <= 1)
+			{
+				function(0u, 0u, count);
+				return;
+			}
+
+			std::vector<uint32_t> chunks(chunkCount);
+			std::iota(chunks.begin(), chunks.end(), 0u);
+			std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](uint32_t chunk)
+				{
+					function(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+				});
+		}
+
+		template<typename Function>
+		void ParallelFor(uint32_t count, const Function& function)
+		{
+			ParallelForChunks(count, 4096, [&](uint32_t, uint32_t begin, uint32_t end)
+				{
+					for (uint32_t i{ begin }; i < end; ++i)
+					{
+						function(i);
+					}
+				});
+		}
+
+		//Spreads the lowest 21 bits so two zero bits sit between every bit
+		uint64_t ExpandMortonBits(uint64_t v)
+		{
+			v &= 0x1fffff;
+			v = (v | v << 32) & 0x1f00000000ffff;
+			v = (v | v << 16) & 0x1f0000ff0000ff;
+			v = (v | v << 8) & 0x100f00f00f00f00f;
+			v = (v | v << 4) & 0x10c30c30c30c30c3;
+			v = (v | v << 2) & 0x1249249249249249;
+			return v;
+		}
+
+		//LSD radix sort of the codes with the primitive ids moving along, 8 bits per pass.
+		//Every chunk counts its own digits, so counting and scattering both run in parallel and equal codes keep their order
+		void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int bitCount)
+		{
+			constexpr uint32_t chunkSize{ 1 << 16 };
+			const uint32_t count = static_cast<uint32_t>(keys.size());
+			const uint32_t chunkCount = std::max(1u, (count + chunkSize - 1) / chunkSize);
+
+			std::vector<uint64_t> sortedKeys(count);
+			std::vector<uint32_t> sortedValues(count);
+			std::vector<std::array<uint32_t, 256>> offsets(chunkCount);
+
+			for (int shift{ 0 }; shift < bitCount; shift += 8)
+			{
+				ParallelForChunks(count, chunkSize, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+					{
+						std::array<uint32_t, 256>& histogram = offsets[chunk];
+						histogram.fill(0);
+						for (uint32_t i{ begin }; i < end; ++i)
+						{
+							++histogram[(keys[i] >> shift) & 0xFF];
+						}
+					});
+
+				uint32_t offset{ 0 };
+				for (uint32_t digit{ 0 }; digit < 256; ++digit)
+				{
+					for (std::array<uint32_t, 256>& histogram : offsets)
+					{
+						const uint32_t digitCount = histogram[digit];
+						histogram[digit] = offset;
+						offset += digitCount;
+					}
+				}
+
+				ParallelForChunks(count, chunkSize, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+					{
+						std::array<uint32_t, 256>& histogram = offsets[chunk];
+						for (uint32_t i{ begin }; i < end; ++i)
+						{
+							const uint32_t target = histogram[(keys[i] >> shift) & 0xFF]++;
+							sortedKeys[target] = keys[i];
+							sortedValues[target] = values[i];
+						}
+					});
+
+				keys.swap(sortedKeys);
+				values.swap(sortedValues);
+			}
+		}
+
+		//Bump whenever a builder or node layout changes, old cache files are then never looked at again
+		constexpr uint32_t CACHE_VERSION{ 2 };
+		constexpr uint32_t CACHE_MAGIC{ 0x43485642 }; // "BVHC"
+
+		//Arrays start on cache line boundaries, the mapping itself is page aligned
+		constexpr size_t CACHE_ALIGNMENT{ 64 };
+
+		struct CacheArray
+		{
+			uint64_t offset;
+			uint64_t count;
+		};
+
+		//No implicit padding, so a value initialized header is written the same every time
+		struct CacheHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t key;
+			uint64_t fileSize;
+			uint32_t primitiveCount;
+			float buildCost;
+			double costSum;
+			BVHNodeFormat nodeFormat;
+			BVHNodeFormat tracedNodeFormat;
+			uint8_t reserved[6];
+			CacheArray nodes;
+			CacheArray primitiveIndices;
+			CacheArray wideNodes;
+			CacheArray quantizedNodes16;
+			CacheArray quantizedNodes8;
+		};
+		static_assert(sizeof(CacheHeader) == 48 + 5 * sizeof(CacheArray));
+
+		size_t AlignCacheOffset(size_t offset)
+		{
+			return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+		}
+
+		//FNV-1a on 64 bit words with an extra shift so the high bits reach the low ones, only has to tell meshes apart
+		uint64_t HashBytes(uint64_t hash, const void* pData, size_t size)
+		{
+			const std::byte* pBytes = static_cast<const std::byte*>(pData);
+			size_t i{ 0 };
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+			{
+				uint64_t word;
+				std::memcpy(&word, pBytes + i, sizeof(uint64_t));
+				hash = (hash ^ word) * 0x100000001b3;
+				hash ^= hash >> 29;
+			}
+			for (; i < size; ++i)
+			{
+				hash = (hash ^ static_cast<uint64_t>(pBytes[i])) * 0x100000001b3;
+			}
+			return hash;
+		}
+
+		template<typename T>
+		uint64_t HashValue(uint64_t hash, const T& value)
+		{
+			return HashBytes(hash, &value, sizeof(T));
+		}
+
+		//Empty span when the array does not fit the file, so a truncated file is never read past its end
+		template<typename T>
+		std::span<const T> GetCacheArray(const MappedFile& file, const CacheArray& array)
+		{
+			if (array.offset % CACHE_ALIGNMENT != 0 || array.offset > file.GetSize()
+				|| array.count > (file.GetSize() - array.offset) / sizeof(T)) return {};
+
+			return { reinterpret_cast<const T*>(file.GetData() + array.offset), static_cast<size_t>(array.count) };
+		}
+
+		//Walks a cached tree from the root. Every child has to be in range, reached only once and no deeper than MAX_DEPTH,
+		//so a corrupt file can neither loop nor overflow a traversal stack. forEachChild returns false on a bad leaf range
+		template<typename ForEachChild>
+		bool IsCacheTree(size_t nodeCount, const ForEachChild& forEachChild)
+		{
+			if (nodeCount == 0) return true;
+
+			//depth + 1, 0 for nodes not reached yet
+			std::vector<uint8_t> depths(nodeCount, 0);
+			std::vector<uint32_t> stack{ 0 };
+			depths[0] = 1;
+			while (!stack.empty())
+			{
+				const uint32_t nodeIdx = stack.back();
+				stack.pop_back();
+
+				const auto visitChild = [&](uint64_t childIdx)
+					{
+						if (childIdx >= nodeCount || depths[childIdx] != 0 || depths[nodeIdx] > BVH::MAX_DEPTH) return false;
+						depths[childIdx] = static_cast<uint8_t>(depths[nodeIdx] + 1);
+						stack.push_back(static_cast<uint32_t>(childIdx));
+						return true;
+					};
+				if (!forEachChild(nodeIdx, visitChild)) return false;
+			}
+			return true;
+		}
+
+		//Unused quantized slots are stored inverted and are never hit, every other slot without primitives is traced as an interior child
+		template<typename Quantized>
+		bool IsValidCacheTree(std::span<const BVH8QuantizedNode<Quantized>> nodes, size_t primitiveIndexCount)
+		{
+			return IsCacheTree(nodes.size(), [&](uint32_t nodeIdx, const auto& visitChild)
+				{
+					const BVH8QuantizedNode<Quantized>& node = nodes[nodeIdx];
+					uint64_t primitiveIdx{ node.primitiveBase };
+					for (int slot{ 0 }; slot < BVH::WIDTH; ++slot)
+					{
+						if (node.interiorMask & (1 << slot))
+						{
+							if (node.qMinX[slot] <= node.qMaxX[slot] && !visitChild(uint64_t(node.childBase) + node.meta[slot])) return false;
+							continue;
+						}
+
+						//same decoding as GetBVH8Slot, a leaf slot without primitives is traced as an interior child
+						if (node.meta[slot] == 0)
+						{
+							if (node.qMinX[slot] <= node.qMaxX[slot] && !visitChild(primitiveIdx)) return false;
+							continue;
+						}
+
+						primitiveIdx += node.meta[slot];
+						if (primitiveIdx > primitiveIndexCount) return false;
+					}
+					return true;
+				});
+		}
+
+		template<typename T>
+		void WriteCacheArray(std::ofstream& file, const std::vector<T>& values)
+		{
+			file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+
+			const size_t position = static_cast<size_t>(file.tellp());
+			const char padding[CACHE_ALIGNMENT]{};
+			file.write(padding, AlignCacheOffset(position) - position);
+		}
+	}
+
+	void BVH::Build(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		if (m_BuildSettings.builder == BVHBuilder::SpatialSplit)
+		{
+			BuildSpatialSplit(positions, indices);
+			return;
+		}
+
+		std::vector<AABB> triangleBounds(indices.size() / 3);
+		ParallelFor(static_cast<uint32_t>(triangleBounds.size()), [&](uint32_t triIdx)
+			{
+				triangleBounds[triIdx] = GetTriangleBounds(positions, indices, triIdx);
+			});
+
+		Build(triangleBounds);
+	}
+
+	bool BVH::Build(const std::vector<Vector3>& positions, const std::vector<int>& indices, const std::string& cacheDirectory)
+	{
+		if (cacheDirectory.empty())
+		{
+			Build(positions, indices);
+			return false;
+		}
+
+		//every input of the build is part of the key, the node sizes catch layout changes that forgot the version bump
+		uint64_t key{ 0xcbf29ce484222325 };
+		key = HashValue(key, CACHE_VERSION);
+		key = HashValue(key, sizeof(BVHNode) | sizeof(BVH8Node) << 16 | sizeof(BVH8QuantizedNode<uint8_t>) << 32);
+		key = HashValue(key, m_BuildSettings.builder);
+		key = HashValue(key, m_BuildSettings.duplicateBudget);
+		key = HashValue(key, m_BuildSettings.mortonBits);
+		key = HashValue(key, m_BuildSettings.treeletPasses);
+		key = HashValue(key, m_NodeFormat);
+		key = HashValue(key, positions.size());
+		key = HashBytes(key, positions.data(), positions.size() * sizeof(Vector3));
+		key = HashValue(key, indices.size());
+		key = HashBytes(key, indices.data(), indices.size() * sizeof(int));
+
+		char fileName[32]{};
+		std::snprintf(fileName, sizeof(fileName), "%016llx.bvh", static_cast<unsigned long long>(key));
+		const std::filesystem::path path = std::filesystem::path{ cacheDirectory } / fileName;
+
+		if (MapCache(path.string(), key)) return true;
+
+		Build(positions, indices);
+
+		std::error_code error{};
+		std::filesystem::create_directories(cacheDirectory, error);
+		WriteCache(path.string(), key);
+		return false;
+	}
+
+	bool BVH::MapCache(const std::string& path, uint64_t key)
+	{
+		const std::shared_ptr<const MappedFile> pFile = MappedFile::Open(path);
+		if (!pFile || pFile->GetSize() < sizeof(CacheHeader)) return false;
+
+		const CacheHeader& header = *reinterpret_cast<const CacheHeader*>(pFile->GetData());
+		if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != key || header.fileSize != pFile->GetSize()) return false;
+
+		MappedArrays mapped{ pFile,
+			GetCacheArray<BVHNode>(*pFile, header.nodes),
+			GetCacheArray<uint32_t>(*pFile, header.primitiveIndices),
+			GetCacheArray<BVH8Node>(*pFile, header.wideNodes),
+			GetCacheArray<BVH8QuantizedNode<uint16_t>>(*pFile, header.quantizedNodes16),
+			GetCacheArray<BVH8QuantizedNode<uint8_t>>(*pFile, header.quantizedNodes8) };
+
+		if (mapped.nodes.size() != header.nodes.count || mapped.primitiveIndices.size() != header.primitiveIndices.count
+			|| mapped.wideNodes.size() != header.wideNodes.count || mapped.quantizedNodes16.size() != header.quantizedNodes16.count
+			|| mapped.quantizedNodes8.size() != header.quantizedNodes8.count) return false;
+
+		//the key only says the file was written for this geometry, not that it survived on disk, so every index is checked once
+		const size_t primitiveIndexCount = mapped.primitiveIndices.size();
+		if (std::any_of(mapped.primitiveIndices.begin(), mapped.primitiveIndices.end(), [&](uint32_t primitiveIdx) { return primitiveIdx >= header.primitiveCount; })) return false;
+
+		const bool validNodes = IsCacheTree(mapped.nodes.size(), [&](uint32_t nodeIdx, const auto& visitChild)
+			{
+				const BVHNode& node = mapped.nodes[nodeIdx];
+				if (node.IsLeaf()) return uint64_t(node.leftFirst) + node.primitiveCount <= primitiveIndexCount;
+				return visitChild(node.leftFirst) && visitChild(uint64_t(node.leftFirst) + 1);
+			});
+
+		//unused full slots keep the inverted bounds and point at the root
+		const bool validWideNodes = IsCacheTree(mapped.wideNodes.size(), [&](uint32_t nodeIdx, const auto& visitChild)
+			{
+				const BVH8Node& node = mapped.wideNodes[nodeIdx];
+				for (int slot{ 0 }; slot < WIDTH; ++slot)
+				{
+					if (node.primitiveCount[slot] > 0)
+					{
+						if (uint64_t(node.childIndex[slot]) + node.primitiveCount[slot] > primitiveIndexCount) return false;
+					}
+					else if (!(node.bounds.minX[slot] == FLT_MAX && node.bounds.maxX[slot] == -FLT_MAX) && !visitChild(node.childIndex[slot])) return false;
+				}
+				return true;
+			});
+
+		if (!validNodes || !validWideNodes || !IsValidCacheTree(mapped.quantizedNodes16, primitiveIndexCount)
+			|| !IsValidCacheTree(mapped.quantizedNodes8, primitiveIndexCount)) return false;
+
+		//only the scalars are copied, the arrays are traced where they are
+		Clear();
+		m_Mapped = std::move(mapped);
+		m_PrimitiveCount = header.primitiveCount;
+		m_NodeFormat = header.nodeFormat;
+		m_TracedNodeFormat = header.tracedNodeFormat;
+		m_CostSum = header.costSum;
+		m_BuildCost = header.buildCost;
+		return true;
+	}
+
+	void BVH::WriteCache(const std::string& path, uint64_t key) const
+	{
+		CacheHeader header{};
+		header.magic = CACHE_MAGIC;
+		header.version = CACHE_VERSION;
+		header.key = key;
+		header.primitiveCount = m_PrimitiveCount;
+		header.buildCost = m_BuildCost;
+		header.costSum = m_CostSum;
+		header.nodeFormat = m_NodeFormat;
+		header.tracedNodeFormat = m_TracedNodeFormat;
+
+		size_t offset = AlignCacheOffset(sizeof(CacheHeader));
+		const auto placeArray = [&offset](CacheArray& array, size_t count, size_t elementSize)
+			{
+				array = { offset, count };
+				offset = AlignCacheOffset(offset + count * elementSize);
+			};
+		placeArray(header.nodes, m_Nodes.size(), sizeof(BVHNode));
+		placeArray(header.primitiveIndices, m_PrimitiveIndices.size(), sizeof(uint32_t));
+		placeArray(header.wideNodes, m_WideNodes.size(), sizeof(BVH8Node));
+		placeArray(header.quantizedNodes16, m_QuantizedNodes16.size(), sizeof(BVH8QuantizedNode<uint16_t>));
+		placeArray(header.quantizedNodes8, m_QuantizedNodes8.size(), sizeof(BVH8QuantizedNode<uint8_t>));
+		header.fileSize = offset;
+
+		//written next to the target and renamed, so a crash never leaves a half written cache file behind
+		const std::string tempPath = path + ".tmp";
+		{
+			std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+			if (!file) return;
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+			const char padding[CACHE_ALIGNMENT]{};
+			file.write(padding, AlignCacheOffset(sizeof(CacheHeader)) - sizeof(CacheHeader));
+
+			WriteCacheArray(file, m_Nodes);
+			WriteCacheArray(file, m_PrimitiveIndices);
+			WriteCacheArray(file, m_WideNodes);
+			WriteCacheArray(file, m_QuantizedNodes16);
+			WriteCacheArray(file, m_QuantizedNodes8);
+			if (file) file.close();
+			if (!file)
+			{
+				std::error_code error{};
+				std::filesystem::remove(tempPath, error);
+				return;
+			}
+		}
+
+		std::error_code error{};
+		std::filesystem::remove(path, error);
+		std::filesystem::rename(tempPath, path, error);
+	}
+
+	void BVH::Unmap()
+	{
+		if (!IsMapped()) return;
+
+		m_Nodes.assign(m_Mapped.nodes.begin(), m_Mapped.nodes.end());
+		m_PrimitiveIndices.assign(m_Mapped.primitiveIndices.begin(), m_Mapped.primitiveIndices.end());
+		m_Mapped = {};
+
+		//the cost ratio keeps comparing against the original build
+		const float buildCost = m_BuildCost;
+		UpdateTopology();
+		Collapse();
+		m_BuildCost = buildCost;
+	}
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds)
+	{
+		if (m_BuildSettings.builder == BVHBuilder::Morton)
+			BuildMorton(primitiveBounds);
+		else
+			BuildBinnedSAH(primitiveBounds);
+	}
+
+	void BVH::BuildBinnedSAH(const std::vector<AABB>& primitiveBounds)
+	{
+		Clear();
+
+		const uint32_t primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+		if (primitiveCount == 0) return;
+
+		//a binary tree never needs more than 2N - 1 nodes
+		m_Nodes.resize(size_t(primitiveCount) * 2 - 1);
+		m_PrimitiveIndices.resize(primitiveCount);
+		m_PrimitiveCount = primitiveCount;
+
+		BuildContext context{ m_Nodes, m_PrimitiveIndices, primitiveBounds };
+		context.centroids.resize(primitiveCount);
+
+		for (uint32_t primitiveIdx{ 0 }; primitiveIdx < primitiveCount; ++primitiveIdx)
+		{
+			context.centroids[primitiveIdx] = primitiveBounds[primitiveIdx].GetCenter();
+			m_PrimitiveIndices[primitiveIdx] = primitiveIdx;
+		}
+
+		BVHNode& root = m_Nodes[0];
+		root.leftFirst = 0;
+		root.primitiveCount = primitiveCount;
+		context.nodesUsed = 1;
+
+		UpdateNodeBounds(context, 0);
+		Subdivide(context, 0, 0);
+
+		m_Nodes.resize(context.nodesUsed);
+		m_Nodes.shrink_to_fit();
+
+		UpdateTopology();
+		FinishBuild();
+	}
+
+	void BVH::BuildMorton(const std::vector<AABB>& primitiveBounds)
+	{
+		Clear();
+
+		const uint32_t primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+		if (primitiveCount == 0) return;
+
+		m_PrimitiveCount = primitiveCount;
+
+		const AABB centroidBounds = std::transform_reduce(std::execution::par, primitiveBounds.begin(), primitiveBounds.end(), AABB{},
+			[](AABB a, const AABB& b) { a.Grow(b); return a; },
+			[](const AABB& bounds) { const Vector3 center = bounds.GetCenter(); return AABB{ center, center }; });
+
+		//the centroids are quantized on a grid over their bounds, every axis gets a third of the code
+		const int bitsPerAxis = (m_BuildSettings.mortonBits > 30) ? 21 : 10;
+		const float gridSize = static_cast<float>((1 << bitsPerAxis) - 1);
+		const Vector3 extent = centroidBounds.max - centroidBounds.min;
+		const Vector3 gridScale{
+			extent.x > 0.f ? gridSize / extent.x : 0.f,
+			extent.y > 0.f ? gridSize / extent.y : 0.f,
+			extent.z > 0.f ? gridSize / extent.z : 0.f };
+
+		std::vector<uint64_t> codes(primitiveCount);
+		m_PrimitiveIndices.resize(primitiveCount);
+		ParallelFor(primitiveCount, [&](uint32_t primitiveIdx)
+			{
+				const Vector3 cell = (primitiveBounds[primitiveIdx].GetCenter() - centroidBounds.min);
+				codes[primitiveIdx] = ExpandMortonBits(static_cast<uint64_t>(cell.x * gridScale.x)) << 2
+					| ExpandMortonBits(static_cast<uint64_t>(cell.y * gridScale.y)) << 1
+					| ExpandMortonBits(static_cast<uint64_t>(cell.z * gridScale.z));
+				m_PrimitiveIndices[primitiveIdx] = primitiveIdx;
+			});
+
+		RadixSort(codes, m_PrimitiveIndices, bitsPerAxis * 3);
+
+		//Karras 2012: every interior node finds its key range and split on its own, so the whole hierarchy is emitted in parallel.
+		//The children of interior node i go to 2i + 1 and 2i + 2, which keeps siblings next to each other
+		m_Nodes.assign(size_t(primitiveCount) * 2 - 1, BVHNode{});
+		if (primitiveCount == 1)
+		{
+			m_Nodes[0].primitiveCount = 1;
+		}
+		else
+		{
+			const int64_t count = primitiveCount;
+			const auto getCommonPrefix = [&](int64_t i, int64_t j)
+				{
+					if (j < 0 || j >= count) return -1;
+					if (codes[i] == codes[j]) return 64 + std::countl_zero(static_cast<uint32_t>(i ^ j));
+					return std::countl_zero(codes[i] ^ codes[j]);
+				};
+
+			std::vector<uint32_t> interiorSlots(primitiveCount - 1);
+			ParallelFor(primitiveCount - 1, [&](uint32_t interiorIdx)
+				{
+					const int64_t i = interiorIdx;
+					const int64_t direction = (getCommonPrefix(i, i + 1) > getCommonPrefix(i, i - 1)) ? 1 : -1;
+
+					//the range grows towards the neighbour that shares more of the code
+					const int minPrefix = getCommonPrefix(i, i - direction);
+					int64_t maxLength{ 2 };
+					while (getCommonPrefix(i, i + maxLength * direction) > minPrefix) maxLength *= 2;
+
+					int64_t length{ 0 };
+					for (int64_t step{ maxLength / 2 }; step >= 1; step /= 2)
+					{
+						if (getCommonPrefix(i, i + (length + step) * direction) > minPrefix) length += step;
+					}
+					const int64_t j = i + length * direction;
+
+					//split where the highest differing bit of the range flips
+					const int nodePrefix = getCommonPrefix(i, j);
+					int64_t split{ 0 };
+					for (int64_t divisor{ 2 }; ; divisor *= 2)
+					{
+						const int64_t step = (length + divisor - 1) / divisor;
+						if (getCommonPrefix(i, i + (split + step) * direction) > nodePrefix) split += step;
+						if (step <= 1) break;
+					}
+					const int64_t gamma = i + split * direction + std::min<int64_t>(direction, 0);
+
+					const uint32_t leftSlot = interiorIdx * 2 + 1;
+					const uint32_t rightSlot = leftSlot + 1;
+
+					if (std::min(i, j) == gamma)
+						m_Nodes[leftSlot] = { {}, static_cast<uint32_t>(gamma), {}, 1 };
+					else
+						interiorSlots[gamma] = leftSlot;
+
+					if (std::max(i, j) == gamma + 1)
+						m_Nodes[rightSlot] = { {}, static_cast<uint32_t>(gamma + 1), {}, 1 };
+					else
+						interiorSlots[gamma + 1] = rightSlot;
+				});
+
+			interiorSlots[0] = 0;
+			ParallelFor(primitiveCount - 1, [&](uint32_t interiorIdx)
+				{
+					m_Nodes[interiorSlots[interiorIdx]].leftFirst = interiorIdx * 2 + 1;
+				});
+		}
+
+		//all bounds start out empty, so the refit also leaves the right SAH cost behind
+		UpdateTopology();
+		RefitLevels(m_Levels, [&](uint32_t primitiveIdx) { return primitiveBounds[primitiveIdx]; });
+
+		for (int pass{ 0 }; pass < m_BuildSettings.treeletPasses; ++pass)
+		{
+			OptimizeTreelets();
+		}
+
+		//codes with long shared prefixes on skewed input can make the tree deeper than the traversal stack allows
+		if (m_Levels.size() > size_t(MAX_DEPTH) + 1)
+		{
+			BuildBinnedSAH(primitiveBounds);
+			return;
+		}
+
+		FinishBuild();
+	}
+
+	void BVH::OptimizeTreelets()
+	{
+		//SAH cost of every subtree, bottom-up
+		std::vector<float> subtreeCosts(m_Nodes.size());
+		std::vector<uint32_t> primitiveCounts(m_Nodes.size());
+		for (size_t depth{ m_Levels.size() }; depth-- > 0;)
+		{
+			for (const uint32_t nodeIdx : m_Levels[depth])
+			{
+				const BVHNode& node = m_Nodes[nodeIdx];
+				if (node.IsLeaf())
+				{
+					subtreeCosts[nodeIdx] = GetNodeCost(node);
+					primitiveCounts[nodeIdx] = node.primitiveCount;
+				}
+				else
+				{
+					subtreeCosts[nodeIdx] = GetNodeCost(node) + subtreeCosts[node.leftFirst] + subtreeCosts[node.leftFirst + 1];
+					primitiveCounts[nodeIdx] = primitiveCounts[node.leftFirst] + primitiveCounts[node.leftFirst + 1];
+				}
+			}
+		}
+
+		//treelets rooted on the same level cover separate subtrees, so a level is restructured in parallel before moving up
+		for (size_t depth{ m_Levels.size() }; depth-- > 0;)
+		{
+			const std::vector<uint32_t>& level = m_Levels[depth];
+			ParallelFor(static_cast<uint32_t>(level.size()), [&](uint32_t levelIdx)
+				{
+					if (primitiveCounts[level[levelIdx]] >= TREELET_LEAF_COUNT) RestructureTreelet(level[levelIdx], subtreeCosts);
+				});
+		}
+
+		UpdateTopology();
+	}
+
+	void BVH::RestructureTreelet(uint32_t rootIdx, std::vector<float>& subtreeCosts)
+	{
+		//grow the treelet by opening its largest leaf until it has TREELET_LEAF_COUNT of them
+		uint32_t leaves[TREELET_LEAF_COUNT]{ m_Nodes[rootIdx].leftFirst, m_Nodes[rootIdx].leftFirst + 1 };
+		uint32_t pairs[TREELET_LEAF_COUNT - 1]{ m_Nodes[rootIdx].leftFirst };
+		int leafCount{ 2 };
+
+		while (leafCount < TREELET_LEAF_COUNT)
+		{
+			int bestLeaf{ -1 };
+			float bestArea{ -1.f };
+			for (int leaf{ 0 }; leaf < leafCount; ++leaf)
+			{
+				const BVHNode& node = m_Nodes[leaves[leaf]];
+				if (node.IsLeaf()) continue;
+
+				const float area = GetNodeBounds(node).Area();
+				if (area > bestArea)
+				{
+					bestArea = area;
+					bestLeaf = leaf;
+				}
+			}
+			if (bestLeaf < 0) break;
+
+			const uint32_t leftIdx = m_Nodes[leaves[bestLeaf]].leftFirst;
+			pairs[leafCount - 1] = leftIdx;
+			leaves[bestLeaf] = leftIdx;
+			leaves[leafCount++] = leftIdx + 1;
+		}
+		if (leafCount < 3) return;
+
+		//best SAH cost for every subset of the treelet leaves, a subset is always visited after all of its own subsets
+		constexpr int subsetCount{ 1 << TREELET_LEAF_COUNT };
+		AABB subsetBounds[subsetCount]{};
+		float subsetCosts[subsetCount]{};
+		uint8_t bestPartitions[subsetCount]{};
+
+		const uint32_t fullSet = (1u << leafCount) - 1;
+		for (uint32_t subset{ 1 }; subset <= fullSet; ++subset)
+		{
+			const int lowestLeaf = std::countr_zero(subset);
+			const uint32_t rest = subset & (subset - 1);
+
+			if (rest == 0)
+			{
+				subsetBounds[subset] = GetNodeBounds(m_Nodes[leaves[lowestLeaf]]);
+				subsetCosts[subset] = subtreeCosts[leaves[lowestLeaf]];
+				continue;
+			}
+
+			subsetBounds[subset] = subsetBounds[rest];
+			subsetBounds[subset].Grow(subsetBounds[1u << lowestLeaf]);
+
+			//only partitions holding the lowest leaf, the mirrored ones cost the same
+			float bestCost{ FLT_MAX };
+			for (uint32_t partition{ (subset - 1) & subset }; partition != 0; partition = (partition - 1) & subset)
+			{
+				if (!(partition & (1u << lowestLeaf))) continue;
+
+				const float cost = subsetCosts[partition] + subsetCosts[subset ^ partition];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestPartitions[subset] = static_cast<uint8_t>(partition);
+				}
+			}
+			subsetCosts[subset] = subsetBounds[subset].Area() + bestCost;
+		}
+
+		//write the best tree back into the same slots, the leaves move as a whole with their subtree cost
+		BVHNode leafNodes[TREELET_LEAF_COUNT]{};
+		float leafCosts[TREELET_LEAF_COUNT]{};
+		for (int leaf{ 0 }; leaf < leafCount; ++leaf)
+		{
+			leafNodes[leaf] = m_Nodes[leaves[leaf]];
+			leafCosts[leaf] = subtreeCosts[leaves[leaf]];
+		}
+
+		int pairsUsed{ 0 };
+		const auto emit = [&](const auto& self, uint32_t subset, uint32_t nodeIdx) -> void
+			{
+				if ((subset & (subset - 1)) == 0)
+				{
+					const int leaf = std::countr_zero(subset);
+					m_Nodes[nodeIdx] = leafNodes[leaf];
+					subtreeCosts[nodeIdx] = leafCosts[leaf];
+					return;
+				}
+
+				const uint32_t pairIdx = pairs[pairsUsed++];
+				m_Nodes[nodeIdx] = { subsetBounds[subset].min, pairIdx, subsetBounds[subset].max, 0 };
+				subtreeCosts[nodeIdx] = subsetCosts[subset];
+
+				self(self, bestPartitions[subset], pairIdx);
+				self(self, subset ^ bestPartitions[subset], pairIdx + 1);
+			};
+		emit(emit, fullSet, rootIdx);
+	}
+
+	void BVH::BuildSpatialSplit(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		Clear();
+
+		const uint32_t primitiveCount = static_cast<uint32_t>(indices.size() / 3);
+		if (primitiveCount == 0) return;
+
+		std::vector<Reference> references(primitiveCount);
+		AABB rootBounds{};
+		for (uint32_t triIdx{ 0 }; triIdx < primitiveCount; ++triIdx)
+		{
+			references[triIdx] = { GetTriangleBounds(positions, indices, triIdx), triIdx };
+			rootBounds.Grow(references[triIdx].bounds);
+		}
+
+		SpatialSplitContext context{ m_Nodes, m_PrimitiveIndices, positions, indices };
+		context.minOverlapArea = rootBounds.Area() * SPATIAL_SPLIT_MIN_OVERLAP;
+		context.duplicateBudget = static_cast<size_t>(primitiveCount * std::max(0.f, m_BuildSettings.duplicateBudget));
+
+		const size_t maxReferenceCount = primitiveCount + context.duplicateBudget;
+		m_Nodes.reserve(maxReferenceCount * 2 - 1);
+		m_PrimitiveIndices.reserve(maxReferenceCount);
+		m_Nodes.resize(1);
+
+		SubdivideSpatial(context, 0, references, 0);
+
+		m_Nodes.shrink_to_fit();
+		m_PrimitiveIndices.shrink_to_fit();
+		m_PrimitiveCount = primitiveCount;
+
+		UpdateTopology();
+		FinishBuild();
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds)
+	{
+		Unmap();
+		RefitLevels(m_Levels, [&](uint32_t primitiveIdx) { return primitiveBounds[primitiveIdx]; });
+		QuantizeWideNodes(m_Levels, true);
+	}
+
+	void BVH::Refit(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		Unmap();
+		RefitLevels(m_Levels, [&](uint32_t triIdx) { return GetTriangleBounds(positions, indices, triIdx); });
+		QuantizeWideNodes(m_Levels, true);
+	}
+
+	void BVH::Refit(const std::vector<Vector3>& positions, const std::vector<int>& indices, const std::vector<uint32_t>& changedPrimitives)
+	{
+		Unmap();
+		if (m_Nodes.empty()) return;
+
+		//a split triangle sits in several leaves but only one of them is known per triangle
+		if (HasDuplicateReferences())
+		{
+			Refit(positions, indices);
+			return;
+		}
+
+		m_DirtyFlags.resize(m_Nodes.size());
+		m_DirtyLevels.resize(m_Levels.size());
+
+		//mark every node from the changed leaves up to the root, stop where another path already did
+		for (const uint32_t primitiveIdx : changedPrimitives)
+		{
+			uint32_t nodeIdx = m_PrimitiveLeaves[primitiveIdx];
+			while (!m_DirtyFlags[nodeIdx])
+			{
+				m_DirtyFlags[nodeIdx] = 1;
+				m_DirtyLevels[m_NodeDepths[nodeIdx]].push_back(nodeIdx);
+
+				if (nodeIdx == 0) break;
+				nodeIdx = m_Parents[nodeIdx];
+			}
+		}
+
+		RefitLevels(m_DirtyLevels, [&](uint32_t triIdx) { return GetTriangleBounds(positions, indices, triIdx); });
+		QuantizeWideNodes(m_DirtyLevels, false);
+
+		for (std::vector<uint32_t>& level : m_DirtyLevels)
+		{
+			for (const uint32_t nodeIdx : level)
+			{
+				m_DirtyFlags[nodeIdx] = 0;
+			}
+			level.clear();
+		}
+	}
+
+	bool BVH::Insert(uint32_t primitiveIdx, const AABB& bounds)
+	{
+		Unmap();
+		if (m_Nodes.empty())
+		{
+			m_Nodes.push_back({ bounds.min, 0, bounds.max, 1 });
+			m_PrimitiveIndices.push_back(primitiveIdx);
+			m_PrimitiveCount = primitiveIdx + 1;
+			UpdateTopology();
+			FinishBuild();
+			return true;
+		}
+
+		if (HasDuplicateReferences()) return false;
+
+		//descend towards the child whose surface grows the least
+		uint32_t leafIdx{ 0 };
+		while (!m_Nodes[leafIdx].IsLeaf())
+		{
+			const uint32_t leftIdx = m_Nodes[leafIdx].leftFirst;
+			AABB left = GetNodeBounds(m_Nodes[leftIdx]);
+			AABB right = GetNodeBounds(m_Nodes[leftIdx + 1]);
+			const float leftArea = left.Area();
+			const float rightArea = right.Area();
+			left.Grow(bounds);
+			right.Grow(bounds);
+
+			leafIdx = (left.Area() - leftArea <= right.Area() - rightArea) ? leftIdx : leftIdx + 1;
+		}
+
+		const uint8_t depth = m_NodeDepths[leafIdx];
+		if (depth + 1 >= MAX_DEPTH) return false;
+
+		//the leaf turns into an interior node over a copy of itself and a leaf with the new primitive
+		const uint32_t oldLeafIdx = static_cast<uint32_t>(m_Nodes.size());
+		const uint32_t newLeafIdx = oldLeafIdx + 1;
+		const BVHNode oldLeaf = m_Nodes[leafIdx];
+
+		m_Nodes.push_back(oldLeaf);
+		m_Nodes.push_back({ bounds.min, static_cast<uint32_t>(m_PrimitiveIndices.size()), bounds.max, 1 });
+		m_PrimitiveIndices.push_back(primitiveIdx);
+
+		m_Nodes[leafIdx].leftFirst = oldLeafIdx;
+		m_Nodes[leafIdx].primitiveCount = 0;
+
+		m_Parents.push_back(leafIdx);
+		m_Parents.push_back(leafIdx);
+		m_NodeDepths.push_back(depth + 1);
+		m_NodeDepths.push_back(depth + 1);
+		if (m_Levels.size() <= size_t(depth) + 1) m_Levels.resize(size_t(depth) + 2);
+		m_Levels[depth + 1].push_back(oldLeafIdx);
+		m_Levels[depth + 1].push_back(newLeafIdx);
+
+		for (uint32_t i{ 0 }; i < oldLeaf.primitiveCount; ++i)
+		{
+			m_PrimitiveLeaves[m_PrimitiveIndices[oldLeaf.leftFirst + i]] = oldLeafIdx;
+		}
+		m_PrimitiveCount = std::max(m_PrimitiveCount, primitiveIdx + 1);
+		m_PrimitiveLeaves.resize(m_PrimitiveCount);
+		m_PrimitiveLeaves[primitiveIdx] = newLeafIdx;
+
+		m_CostSum += GetNodeCost(m_Nodes[newLeafIdx]);
+
+		//grow the split leaf and every ancestor, the old leaf cost now belongs to its copy
+		uint32_t nodeIdx = leafIdx;
+		while (true)
+		{
+			BVHNode& node = m_Nodes[nodeIdx];
+			const float oldCost = (nodeIdx == leafIdx) ? 0.f : GetNodeCost(node);
+
+			AABB nodeBounds = GetNodeBounds(node);
+			nodeBounds.Grow(bounds);
+			node.minAABB = nodeBounds.min;
+			node.maxAABB = nodeBounds.max;
+			m_CostSum += GetNodeCost(node) - oldCost;
+
+			if (nodeIdx == 0) break;
+			nodeIdx = m_Parents[nodeIdx];
+		}
+
+		if (m_TracedNodeFormat == BVHNodeFormat::Full)
+			SplitWideSlot(leafIdx);
+		else
+			Collapse();
+		return true;
+	}
+
+	void BVH::SetBuildSettings(const BVHBuildSettings& settings)
+	{
+		m_BuildSettings = settings;
+	}
+
+	void BVH::SetNodeFormat(BVHNodeFormat format)
+	{
+		Unmap();
+		m_NodeFormat = format;
+		if (!m_Nodes.empty()) Collapse();
+	}
+
+	void BVH::Clear()
+	{
+		m_Nodes.clear();
+		m_PrimitiveIndices.clear();
+		m_PrimitiveCount = 0;
+		m_WideNodes.clear();
+		m_QuantizedNodes16.clear();
+		m_QuantizedNodes8.clear();
+		m_WideSlots.clear();
+		m_WideSources.clear();
+		m_Parents.clear();
+		m_NodeDepths.clear();
+		m_PrimitiveLeaves.clear();
+		m_Levels.clear();
+		m_DirtyFlags.clear();
+		m_DirtyLevels.clear();
+		m_DirtyWideNodes.clear();
+		m_Mapped = {};
+		m_CostSum = 0.0;
+		m_BuildCost = 0.f;
+	}
+
+	float BVH::GetSAHCost() const
+	{
+		const std::span<const BVHNode> nodes = GetNodes();
+		if (nodes.empty()) return 0.f;
+
+		const float rootArea = GetNodeBounds(nodes[0]).Area();
+		if (rootArea <= 0.f) return 0.f;
+
+		return static_cast<float>(m_CostSum / rootArea);
+	}
+
+	float BVH::GetCostRatio() const
+	{
+		if (m_BuildCost <= 0.f) return 1.f;
+		return GetSAHCost() / m_BuildCost;
+	}
+
+	void BVH::UpdateTopology()
+	{
+		const size_t nodeCount = m_Nodes.size();
+		m_Parents.assign(nodeCount, 0);
+		m_NodeDepths.assign(nodeCount, 0);
+		m_PrimitiveLeaves.assign(m_PrimitiveCount, 0);
+		m_Levels.clear();
+		m_CostSum = 0.0;
+
+		//depth first from the root, the Morton builder does not store parents before their children
+		std::vector<uint32_t> stack{ 0 };
+		while (!stack.empty())
+		{
+			const uint32_t nodeIdx = stack.back();
+			stack.pop_back();
+
+			const BVHNode& node = m_Nodes[nodeIdx];
+			const uint8_t depth = m_NodeDepths[nodeIdx];
+
+			if (m_Levels.size() <= depth) m_Levels.resize(size_t(depth) + 1);
+			m_Levels[depth].push_back(nodeIdx);
+			m_CostSum += GetNodeCost(node);
+
+			if (node.IsLeaf())
+			{
+				for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+				{
+					m_PrimitiveLeaves[m_PrimitiveIndices[node.leftFirst + i]] = nodeIdx;
+				}
+			}
+			else
+			{
+				for (uint32_t childIdx{ node.leftFirst }; childIdx < node.leftFirst + 2; ++childIdx)
+				{
+					m_Parents[childIdx] = nodeIdx;
+					m_NodeDepths[childIdx] = depth + 1;
+					stack.push_back(childIdx);
+				}
+			}
+		}
+	}
+
+	void BVH::FinishBuild()
+	{
+		m_BuildCost = GetSAHCost();
+		Collapse();
+	}
+
+	void BVH::Collapse()
+	{
+		m_WideNodes.clear();
+		m_QuantizedNodes16.clear();
+		m_QuantizedNodes8.clear();
+		m_WideSources.clear();
+		m_WideSlots.assign(m_Nodes.size(), UINT32_MAX);
+		m_TracedNodeFormat = BVHNodeFormat::Full;
+		if (m_Nodes.empty()) return;
+
+		//every wide node opens at least one binary interior node, there are (N - 1) / 2 of those
+		m_WideNodes.reserve(m_Nodes.size() / 2 + 1);
+		m_WideNodes.resize(1);
+		m_WideSources.assign(WIDTH, UINT32_MAX);
+
+		//the primitives get reordered so the leaf slots of a wide node are next to each other
+		std::vector<uint32_t> primitiveIndices{};
+		primitiveIndices.reserve(m_PrimitiveIndices.size());
+		CollapseNode(0, 0, primitiveIndices);
+		m_PrimitiveIndices.swap(primitiveIndices);
+
+		bool isQuantized{ false };
+		switch (m_NodeFormat)
+		{
+		case BVHNodeFormat::Quantized16:
+			isQuantized = Quantize(m_QuantizedNodes16);
+			break;
+		case BVHNodeFormat::Quantized8:
+			isQuantized = Quantize(m_QuantizedNodes8);
+			break;
+		case BVHNodeFormat::Full:
+			break;
+		}
+
+		//the full nodes only stay around when they are the ones being traced
+		if (isQuantized)
+		{
+			m_TracedNodeFormat = m_NodeFormat;
+			m_WideNodes.clear();
+			m_WideNodes.shrink_to_fit();
+		}
+		else
+		{
+			m_QuantizedNodes16.clear();
+			m_QuantizedNodes8.clear();
+			m_WideSources.clear();
+			m_WideNodes.shrink_to_fit();
+		}
+	}
+
+	void BVH::CollapseNode(uint32_t nodeIdx, uint32_t wideIdx, std::vector<uint32_t>& primitiveIndices)
+	{
+		uint32_t slots[WIDTH]{ nodeIdx };
+		int slotCount{ 1 };
+
+		//keep opening the interior slot with the largest surface, those are the boxes most rays would test anyway
+		while (slotCount < WIDTH)
+		{
+			int bestSlot{ -1 };
+			float bestArea{ -1.f };
+			for (int slot{ 0 }; slot < slotCount; ++slot)
+			{
+				const BVHNode& node = m_Nodes[slots[slot]];
+				if (node.IsLeaf()) continue;
+
+				//the node being collapsed always opens first, it never becomes a slot of itself
+				const float area = (slots[slot] == nodeIdx) ? FLT_MAX : GetNodeBounds(node).Area();
+				if (area > bestArea)
+				{
+					bestArea = area;
+					bestSlot = slot;
+				}
+			}
+			if (bestSlot < 0) break;
+
+			const uint32_t leftIdx = m_Nodes[slots[bestSlot]].leftFirst;
+			slots[bestSlot] = leftIdx;
+			slots[slotCount++] = leftIdx + 1;
+		}
+
+		//the interior children get one block of wide nodes
+		uint32_t childWideIdx = static_cast<uint32_t>(m_WideNodes.size());
+		const uint32_t interiorCount = static_cast<uint32_t>(std::count_if(slots, slots + slotCount, [&](uint32_t childIdx) { return !m_Nodes[childIdx].IsLeaf(); }));
+		m_WideNodes.resize(m_WideNodes.size() + interiorCount);
+		m_WideSources.resize(m_WideNodes.size() * WIDTH, UINT32_MAX);
+
+		BVH8Node& wideNode = m_WideNodes[wideIdx];
+		for (int slot{ 0 }; slot < WIDTH; ++slot)
+		{
+			if (slot >= slotCount)
+			{
+				wideNode.bounds.minX[slot] = wideNode.bounds.minY[slot] = wideNode.bounds.minZ[slot] = FLT_MAX;
+				wideNode.bounds.maxX[slot] = wideNode.bounds.maxY[slot] = wideNode.bounds.maxZ[slot] = -FLT_MAX;
+				continue;
+			}
+
+			const uint32_t childIdx = slots[slot];
+			m_WideSlots[childIdx] = wideIdx * WIDTH + slot;
+			m_WideSources[size_t(wideIdx) * WIDTH + slot] = childIdx;
+			CopyToWideSlot(childIdx);
+
+			BVHNode& child = m_Nodes[childIdx];
+			if (child.IsLeaf())
+			{
+				const uint32_t first = static_cast<uint32_t>(primitiveIndices.size());
+				primitiveIndices.insert(primitiveIndices.end(), m_PrimitiveIndices.begin() + child.leftFirst, m_PrimitiveIndices.begin() + child.leftFirst + child.primitiveCount);
+				child.leftFirst = first;
+
+				wideNode.childIndex[slot] = first;
+				wideNode.primitiveCount[slot] = child.primitiveCount;
+			}
+			else
+			{
+				wideNode.childIndex[slot] = childWideIdx++;
+			}
+		}
+
+		//the recursion grows m_WideNodes, so no reference is kept across it
+		for (int slot{ 0 }; slot < slotCount; ++slot)
+		{
+			if (m_Nodes[slots[slot]].IsLeaf()) continue;
+			CollapseNode(slots[slot], m_WideNodes[wideIdx].childIndex[slot], primitiveIndices);
+		}
+	}
+
+	void BVH::CopyToWideSlot(uint32_t nodeIdx)
+	{
+		if (m_WideNodes.empty()) return;
+
+		const uint32_t wideSlot = m_WideSlots[nodeIdx];
+		if (wideSlot == UINT32_MAX) return;
+
+		const BVHNode& node = m_Nodes[nodeIdx];
+		BVH8Bounds& bounds = m_WideNodes[wideSlot / WIDTH].bounds;
+		const uint32_t slot = wideSlot % WIDTH;
+
+		bounds.minX[slot] = node.minAABB.x;
+		bounds.minY[slot] = node.minAABB.y;
+		bounds.minZ[slot] = node.minAABB.z;
+		bounds.maxX[slot] = node.maxAABB.x;
+		bounds.maxY[slot] = node.maxAABB.y;
+		bounds.maxZ[slot] = node.maxAABB.z;
+	}
+
+	void BVH::SplitWideSlot(uint32_t splitIdx)
+	{
+		m_WideSlots.resize(m_Nodes.size(), UINT32_MAX);
+
+		const uint32_t wideSlot = m_WideSlots[splitIdx];
+		const uint32_t wideIdx = wideSlot / WIDTH;
+		const uint32_t leftIdx = m_Nodes[splitIdx].leftFirst;
+
+		//unused slots are the ones with inverted bounds
+		int freeSlot{ -1 };
+		for (int slot{ 0 }; slot < WIDTH && freeSlot < 0; ++slot)
+		{
+			if (m_WideNodes[wideIdx].bounds.minX[slot] > m_WideNodes[wideIdx].bounds.maxX[slot]) freeSlot = slot;
+		}
+
+		if (freeSlot >= 0)
+		{
+			//the split leaf opens in place, like the collapse would have opened it
+			m_WideSlots[splitIdx] = UINT32_MAX;
+			m_WideSlots[leftIdx] = wideSlot;
+			m_WideSlots[leftIdx + 1] = wideIdx * WIDTH + freeSlot;
+		}
+		else
+		{
+			//a full node keeps the split leaf as an interior slot over a new wide node with the two leaves
+			const uint32_t childWideIdx = static_cast<uint32_t>(m_WideNodes.size());
+			BVH8Node childNode{};
+			for (int slot{ 0 }; slot < WIDTH; ++slot)
+			{
+				childNode.bounds.minX[slot] = childNode.bounds.minY[slot] = childNode.bounds.minZ[slot] = FLT_MAX;
+				childNode.bounds.maxX[slot] = childNode.bounds.maxY[slot] = childNode.bounds.maxZ[slot] = -FLT_MAX;
+			}
+			m_WideNodes.push_back(childNode);
+
+			BVH8Node& wideNode = m_WideNodes[wideIdx];
+			wideNode.childIndex[wideSlot % WIDTH] = childWideIdx;
+			wideNode.primitiveCount[wideSlot % WIDTH] = 0;
+			m_WideSlots[leftIdx] = childWideIdx * WIDTH;
+			m_WideSlots[leftIdx + 1] = childWideIdx * WIDTH + 1;
+		}
+
+		//both leaves keep the primitive ranges they got in the traced order
+		for (const uint32_t childIdx : { leftIdx, leftIdx + 1 })
+		{
+			BVH8Node& wideNode = m_WideNodes[m_WideSlots[childIdx] / WIDTH];
+			wideNode.childIndex[m_WideSlots[childIdx] % WIDTH] = m_Nodes[childIdx].leftFirst;
+			wideNode.primitiveCount[m_WideSlots[childIdx] % WIDTH] = m_Nodes[childIdx].primitiveCount;
+			CopyToWideSlot(childIdx);
+		}
+
+		//the split leaf and its ancestors grew, the ones that are slots copy their new bounds over
+		uint32_t nodeIdx = splitIdx;
+		while (true)
+		{
+			CopyToWideSlot(nodeIdx);
+			if (nodeIdx == 0) break;
+			nodeIdx = m_Parents[nodeIdx];
+		}
+	}
+
+	void BVH::QuantizeWideNodes(const std::vector<std::vector<uint32_t>>& levels, bool allNodes)
+	{
+		if (m_TracedNodeFormat == BVHNodeFormat::Full) return;
+
+		const auto quantize = [&](uint32_t wideIdx)
+			{
+				if (m_TracedNodeFormat == BVHNodeFormat::Quantized16)
+					QuantizeBounds(m_QuantizedNodes16[wideIdx], wideIdx);
+				else
+					QuantizeBounds(m_QuantizedNodes8[wideIdx], wideIdx);
+			};
+
+		if (allNodes)
+		{
+			const uint32_t wideCount = static_cast<uint32_t>(m_WideSources.size() / WIDTH);
+			for (uint32_t wideIdx{ 0 }; wideIdx < wideCount; ++wideIdx)
+			{
+				quantize(wideIdx);
+			}
+			return;
+		}
+
+		//a changed slot moves the grid of the whole wide node it sits in
+		m_DirtyWideNodes.clear();
+		for (const std::vector<uint32_t>& level : levels)
+		{
+			for (const uint32_t nodeIdx : level)
+			{
+				if (m_WideSlots[nodeIdx] != UINT32_MAX) m_DirtyWideNodes.push_back(m_WideSlots[nodeIdx] / WIDTH);
+			}
+		}
+		std::sort(m_DirtyWideNodes.begin(), m_DirtyWideNodes.end());
+		m_DirtyWideNodes.erase(std::unique(m_DirtyWideNodes.begin(), m_DirtyWideNodes.end()), m_DirtyWideNodes.end());
+
+		for (const uint32_t wideIdx : m_DirtyWideNodes)
+		{
+			quantize(wideIdx);
+		}
+	}
+
+	template<typename Quantized>
+	bool BVH::Quantize(std::vector<BVH8QuantizedNode<Quantized>>& quantizedNodes)
+	{
+		quantizedNodes.resize(m_WideNodes.size());
+
+		for (uint32_t wideIdx{ 0 }; wideIdx < m_WideNodes.size(); ++wideIdx)
+		{
+			const BVH8Node& wideNode = m_WideNodes[wideIdx];
+			BVH8QuantizedNode<Quantized>& quantizedNode = quantizedNodes[wideIdx];
+
+			//the collapse stored interior children and leaf primitives in slot order, so the first of each is the base
+			bool hasChild{ false }, hasLeaf{ false };
+			for (int slot{ 0 }; slot < WIDTH; ++slot)
+			{
+				if (m_WideSources[size_t(wideIdx) * WIDTH + slot] == UINT32_MAX) continue;
+
+				if (wideNode.primitiveCount[slot] == 0)
+				{
+					if (!hasChild) quantizedNode.childBase = wideNode.childIndex[slot];
+					hasChild = true;
+					quantizedNode.interiorMask |= 1 << slot;
+					quantizedNode.meta[slot] = static_cast<uint8_t>(wideNode.childIndex[slot] - quantizedNode.childBase);
+				}
+				else
+				{
+					if (wideNode.primitiveCount[slot] > MAX_QUANTIZED_LEAF_SIZE) return false;
+
+					if (!hasLeaf) quantizedNode.primitiveBase = wideNode.childIndex[slot];
+					hasLeaf = true;
+					quantizedNode.meta[slot] = static_cast<uint8_t>(wideNode.primitiveCount[slot]);
+				}
+			}
+
+			QuantizeBounds(quantizedNode, wideIdx);
+		}
+
+		return true;
+	}
+
+	template<typename Quantized>
+	void BVH::QuantizeBounds(BVH8QuantizedNode<Quantized>& quantizedNode, uint32_t wideIdx) const
+	{
+		constexpr uint32_t quantizedMax{ std::numeric_limits<Quantized>::max() };
+		const uint32_t* sources = &m_WideSources[size_t(wideIdx) * WIDTH];
+
+		AABB nodeBounds{};
+		for (int slot{ 0 }; slot < WIDTH; ++slot)
+		{
+			if (sources[slot] != UINT32_MAX) nodeBounds.Grow(GetNodeBounds(m_Nodes[sources[slot]]));
+		}
+		quantizedNode.origin = nodeBounds.min;
+
+		Quantized* quantizedMins[3]{ quantizedNode.qMinX, quantizedNode.qMinY, quantizedNode.qMinZ };
+		Quantized* quantizedMaxs[3]{ quantizedNode.qMaxX, quantizedNode.qMaxY, quantizedNode.qMaxZ };
+
+		for (int axis{ 0 }; axis < 3; ++axis)
+		{
+			//smallest power of two grid step that still reaches the far side of the node box
+			const float origin = nodeBounds.min[axis];
+			const float extent = nodeBounds.max[axis] - origin;
+			int exponent = (extent > 0.f) ? static_cast<int>(std::ceil(std::log2(extent / quantizedMax))) : MIN_QUANTIZED_EXPONENT;
+			exponent = std::max(exponent, MIN_QUANTIZED_EXPONENT);
+			while (origin + quantizedMax * GetQuantizedScale(int8_t(exponent)) < nodeBounds.max[axis]) ++exponent;
+
+			//one grid step has to survive being added to the origin, or unused slots would decode to a flat box instead of an inverted one
+			while (origin + GetQuantizedScale(int8_t(exponent)) == origin) ++exponent;
+
+			quantizedNode.exponent[axis] = static_cast<int8_t>(exponent);
+			const float scale = GetQuantizedScale(quantizedNode.exponent[axis]);
+
+			for (int slot{ 0 }; slot < WIDTH; ++slot)
+			{
+				//unused slots get inverted bounds so they never get hit
+				if (sources[slot] == UINT32_MAX)
+				{
+					quantizedMins[axis][slot] = static_cast<Quantized>(quantizedMax);
+					quantizedMaxs[axis][slot] = 0;
+					continue;
+				}
+
+				const BVHNode& child = m_Nodes[sources[slot]];
+
+				//round outwards, then step further out while float rounding still puts the decoded bound inside the box
+				uint32_t low = static_cast<uint32_t>(std::clamp(std::floor((child.minAABB[axis] - origin) / scale), 0.f, float(quantizedMax)));
+				while (low > 0 && origin + low * scale > child.minAABB[axis]) --low;
+
+				uint32_t high = static_cast<uint32_t>(std::clamp(std::ceil((child.maxAABB[axis] - origin) / scale), 0.f, float(quantizedMax)));
+				while (high < quantizedMax && origin + high * scale < child.maxAABB[axis]) ++high;
+
+				quantizedMins[axis][slot] = static_cast<Quantized>(low);
+				quantizedMaxs[axis][slot] = static_cast<Quantized>(high);
+			}
+		}
+	}
+
+	size_t BVH::GetTraversalByteSize() const
+	{
+		return GetWideNodes().size_bytes() + GetQuantizedNodes16().size_bytes() + GetQuantizedNodes8().size_bytes() + GetPrimitiveIndices().size_bytes();
+	}
+
+	size_t BVH::GetByteSize() const
+	{
+		size_t byteSize = GetTraversalByteSize()
+			+ GetNodes().size_bytes()
+			+ (m_Parents.size() + m_PrimitiveLeaves.size() + m_WideSlots.size() + m_WideSources.size()) * sizeof(uint32_t)
+			+ m_NodeDepths.size() * sizeof(uint8_t);
+
+		for (const std::vector<uint32_t>& level : m_Levels)
+		{
+			byteSize += level.size() * sizeof(uint32_t);
+		}
+		return byteSize;
+	}
+
+	template<typename GetBounds>
+	float BVH::RefitNode(uint32_t nodeIdx, const GetBounds& getBounds)
+	{
+		BVHNode& node = m_Nodes[nodeIdx];
+		const float oldCost = GetNodeCost(node);
+
+		AABB bounds{};
+		if (node.IsLeaf())
+		{
+			for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+			{
+				bounds.Grow(getBounds(m_PrimitiveIndices[node.leftFirst + i]));
+			}
+		}
+		else
+		{
+			bounds.Grow(GetNodeBounds(m_Nodes[node.leftFirst]));
+			bounds.Grow(GetNodeBounds(m_Nodes[node.leftFirst + 1]));
+		}
+		node.minAABB = bounds.min;
+		node.maxAABB = bounds.max;
+
+		//slots of one wide node are separate floats, so parallel levels can write them side by side
+		CopyToWideSlot(nodeIdx);
+
+		return GetNodeCost(node) - oldCost;
+	}
+
+	template<typename GetBounds>
+	void BVH::RefitLevels(const std::vector<std::vector<uint32_t>>& levels, const GetBounds& getBounds)
+	{
+		//deepest level first, a level only reads the bounds of the one below it
+		for (size_t depth{ levels.size() }; depth-- > 0;)
+		{
+			const std::vector<uint32_t>& level = levels[depth];
+
+			if (level.size() >= PARALLEL_REFIT_THRESHOLD)
+			{
+				m_CostSum += std::transform_reduce(std::execution::par, level.begin(), level.end(), 0.0, std::plus<>{},
+					[&](uint32_t nodeIdx) { return double(RefitNode(nodeIdx, getBounds)); });
+			}
+			else
+			{
+				for (const uint32_t nodeIdx : level)
+				{
+					m_CostSum += RefitNode(nodeIdx, getBounds);
+				}
+			}
+		}
+	}
+}
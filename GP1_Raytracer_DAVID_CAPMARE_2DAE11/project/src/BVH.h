@@ -0,0 +1,303 @@
+#pragma once
+#include <bit>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	class MappedFile;
+
+	struct AABB
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& p)
+		{
+			min = Vector3::Min(min, p);
+			max = Vector3::Max(max, p);
+		}
+
+		void Grow(const AABB& b)
+		{
+			min = Vector3::Min(min, b.min);
+			max = Vector3::Max(max, b.max);
+		}
+
+		Vector3 GetCenter() const { return (min + max) * .5f; }
+
+		float Area() const
+		{
+			const Vector3 e = max - min;
+			return e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+	};
+
+	// 32 bytes so two siblings share a cache line
+	struct BVHNode
+	{
+		Vector3 minAABB{};
+		uint32_t leftFirst{}; // index of the left child (right child is leftFirst + 1), or first primitive when leaf
+		Vector3 maxAABB{};
+		uint32_t primitiveCount{}; // 0 for interior nodes
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	// Child bounds of an 8-wide node, stored per axis so one ray is tested against all 8 boxes at once.
+	// Unused slots keep inverted bounds and never get hit
+	struct alignas(32) BVH8Bounds
+	{
+		float minX[8]{}, minY[8]{}, minZ[8]{};
+		float maxX[8]{}, maxY[8]{}, maxZ[8]{};
+	};
+
+	// Collapsed 8-wide node, 256 bytes
+	struct alignas(32) BVH8Node
+	{
+		BVH8Bounds bounds{};
+		uint32_t childIndex[8]{}; // wide node index, or first primitive when the child is a leaf
+		uint32_t primitiveCount[8]{}; // 0 for interior children and unused slots
+	};
+
+	// Compressed 8-wide node, 80 bytes with 8 bit and 128 bytes with 16 bit bounds.
+	// Slot bounds are stored on a grid over the node box (origin + q * 2^exponent) and rounded outwards, so they stay conservative.
+	// Interior children of a node are stored next to each other, so are the primitives of its leaf slots
+	template<typename Quantized>
+	struct BVH8QuantizedNode
+	{
+		Vector3 origin{};
+		int8_t exponent[3]{};
+		uint8_t interiorMask{}; // one bit per slot holding an interior child
+		uint32_t childBase{};
+		uint32_t primitiveBase{};
+		uint8_t meta[8]{}; // interior slot: offset from childBase, leaf slot: primitive count (primitives follow the leaf slots before it)
+		Quantized qMinX[8]{}, qMinY[8]{}, qMinZ[8]{};
+		Quantized qMaxX[8]{}, qMaxY[8]{}, qMaxZ[8]{};
+	};
+
+	// 2^exponent built straight from the float bits, exponent has to stay within the normal float range
+	inline float GetQuantizedScale(int8_t exponent)
+	{
+		return std::bit_cast<float>(static_cast<uint32_t>(exponent + 127) << 23);
+	}
+
+	// Node layout used for tracing, the quantized ones trade a few extra box hits for 2-3x smaller nodes
+	enum class BVHNodeFormat : uint8_t
+	{
+		Full,
+		Quantized16,
+		Quantized8
+	};
+
+	enum class BVHBuilder : uint8_t
+	{
+		BinnedSAH,
+		SpatialSplit, // also splits triangle references that overlap a lot, slower to build but faster to trace on long and thin triangles
+		Morton // linear build over sorted Morton codes on all cores, for hierarchies rebuilt every frame
+	};
+
+	struct BVHBuildSettings
+	{
+		BVHBuilder builder{ BVHBuilder::BinnedSAH };
+
+		//Spatial splits stop duplicating references once the triangle count grew by this fraction (.3 = 30% more references)
+		float duplicateBudget{ .3f };
+
+		//Morton code length, 30 (10 bits per axis) or 63 (21 bits per axis) for big or very spread out scenes
+		int mortonBits{ 30 };
+
+		//Treelet restructuring passes after a Morton build, each one brings the SAH cost closer to the binned builder
+		int treeletPasses{ 0 };
+	};
+
+	/**
+	 * \brief Bounding volume hierarchy built with a binned surface area heuristic.
+	 * Used per mesh over its triangles and per scene over the object bounds.
+	 * Building, refitting and inserting work on the binary tree, which is then collapsed into the 8-wide tree used for tracing.
+	 */
+	class BVH final
+	{
+	public:
+		static constexpr int BIN_COUNT{ 16 };
+		static constexpr int MAX_DEPTH{ 64 };
+		static constexpr int WIDTH{ 8 };
+
+		//Largest leaf a quantized node can describe, bigger leaves only come out of degenerate input and keep the full format
+		static constexpr uint32_t MAX_QUANTIZED_LEAF_SIZE{ 255 };
+
+		//Leaves of one treelet restructured after a Morton build, the best layout is searched over all 2^7 leaf subsets
+		static constexpr int TREELET_LEAF_COUNT{ 7 };
+
+		//Spatial splits are only searched where the object split children overlap more than this fraction of the root surface
+		static constexpr float SPATIAL_SPLIT_MIN_OVERLAP{ 1e-5f };
+
+		//Grid step of flat node boxes, small enough to not widen them while 2^exponent stays a normal float
+		static constexpr int MIN_QUANTIZED_EXPONENT{ -100 };
+
+		//A refitted hierarchy pays off a rebuild once its SAH cost got this much worse than right after the build
+		static constexpr float REBUILD_COST_RATIO{ 1.5f };
+
+		//Levels with fewer nodes are refitted on the calling thread
+		static constexpr size_t PARALLEL_REFIT_THRESHOLD{ 1024 };
+
+		/**
+		 * \param positions vertex positions the hierarchy is built in
+		 * \param indices triangle list, 3 indices per triangle
+		 */
+		void Build(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+
+		/**
+		 * \brief Same as the triangle build, but first looks in cacheDirectory for a hierarchy built over the same geometry with the same settings and node format.
+		 * A cached hierarchy is traced straight from the mapped file, the first refit, insert or format change copies it into memory.
+		 * Otherwise the hierarchy is built and written to the cache, an empty directory skips the cache
+		 * \return true when the hierarchy came from the cache
+		 */
+		bool Build(const std::vector<Vector3>& positions, const std::vector<int>& indices, const std::string& cacheDirectory);
+
+		//Only has the boxes to go on, the spatial split builder falls back to binned SAH here
+		void Build(const std::vector<AABB>& primitiveBounds);
+
+		//Used from the next triangle build on
+		void SetBuildSettings(const BVHBuildSettings& settings);
+		const BVHBuildSettings& GetBuildSettings() const { return m_BuildSettings; }
+
+		/**
+		 * \brief Recomputes the node bounds bottom-up while keeping the topology, primitives must keep their index.
+		 * Every level is refitted in parallel once it is wide enough
+		 */
+		void Refit(const std::vector<AABB>& primitiveBounds);
+		void Refit(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+
+		/**
+		 * \brief Only refits the nodes above the changed triangles, the cost is linear in the number of touched nodes.
+		 * Trees with split triangles refit everything, leaves get the whole triangle bounds back
+		 */
+		void Refit(const std::vector<Vector3>& positions, const std::vector<int>& indices, const std::vector<uint32_t>& changedPrimitives);
+
+		/**
+		 * \brief Adds a primitive by splitting the leaf that grows the least, primitiveIdx has to be the next unused index.
+		 * The full node format only changes the wide node above that leaf and keeps the primitive order with primitiveIdx last,
+		 * the quantized formats need the leaves of a node next to each other and recollapse the whole tree
+		 * \return false when the tree would get too deep, rebuild instead
+		 */
+		bool Insert(uint32_t primitiveIdx, const AABB& bounds);
+		void Clear();
+
+		//Recollapses the traced nodes into the given layout, kept for every later build. The primitive order stays the same
+		void SetNodeFormat(BVHNodeFormat format);
+		//Can differ from the requested one when a leaf is too big to quantize
+		BVHNodeFormat GetNodeFormat() const { return m_TracedNodeFormat; }
+
+		//The arrays point into the cache file while the hierarchy is mapped
+		bool IsEmpty() const { return GetNodes().empty(); }
+		bool IsMapped() const { return m_Mapped.pFile != nullptr; }
+
+		std::span<const BVHNode> GetNodes() const { return IsMapped() ? m_Mapped.nodes : m_Nodes; }
+		//Only the array of the current node format is filled
+		std::span<const BVH8Node> GetWideNodes() const { return IsMapped() ? m_Mapped.wideNodes : m_WideNodes; }
+		std::span<const BVH8QuantizedNode<uint16_t>> GetQuantizedNodes16() const { return IsMapped() ? m_Mapped.quantizedNodes16 : m_QuantizedNodes16; }
+		std::span<const BVH8QuantizedNode<uint8_t>> GetQuantizedNodes8() const { return IsMapped() ? m_Mapped.quantizedNodes8 : m_QuantizedNodes8; }
+
+		// primitive ids (triangle = index / 3) in leaf order, leaves reference ranges of this array.
+		// A triangle can show up more than once after spatial splits
+		std::span<const uint32_t> GetPrimitiveIndices() const { return IsMapped() ? m_Mapped.primitiveIndices : m_PrimitiveIndices; }
+
+		//SAH cost of the current tree (traversal and intersection cost 1, relative to the root area)
+		float GetSAHCost() const;
+
+		//Current SAH cost divided by the cost right after the last build, grows as refits degrade the tree
+		float GetCostRatio() const;
+
+		//Bytes read while tracing: the wide nodes in the current format and the primitive indices
+		size_t GetTraversalByteSize() const;
+
+		//Everything the hierarchy keeps, including the binary tree and topology used to build, refit and insert
+		size_t GetByteSize() const;
+
+	private:
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<uint32_t> m_PrimitiveIndices{};
+		uint32_t m_PrimitiveCount{};
+		BVHBuildSettings m_BuildSettings{};
+
+		BVHNodeFormat m_NodeFormat{ BVHNodeFormat::Full };
+		BVHNodeFormat m_TracedNodeFormat{ BVHNodeFormat::Full };
+		std::vector<BVH8Node> m_WideNodes{};
+		std::vector<BVH8QuantizedNode<uint16_t>> m_QuantizedNodes16{};
+		std::vector<BVH8QuantizedNode<uint8_t>> m_QuantizedNodes8{};
+
+		//Every binary node that ended up as a slot of a wide node knows where (wide node * WIDTH + slot), so refits can copy its bounds over.
+		//The quantized formats also need the way back to requantize a whole node
+		std::vector<uint32_t> m_WideSlots{};
+		std::vector<uint32_t> m_WideSources{};
+
+		//Topology links so a refit can start at the changed leaves and walk up level by level
+		std::vector<uint32_t> m_Parents{};
+		std::vector<uint8_t> m_NodeDepths{};
+		std::vector<uint32_t> m_PrimitiveLeaves{};
+		std::vector<std::vector<uint32_t>> m_Levels{};
+
+		//Scratch for partial refits, kept around so a refit does not allocate
+		std::vector<uint8_t> m_DirtyFlags{};
+		std::vector<std::vector<uint32_t>> m_DirtyLevels{};
+		std::vector<uint32_t> m_DirtyWideNodes{};
+
+		//Arrays of a hierarchy loaded from the cache, the file stays mapped as long as a copy of the hierarchy uses it
+		struct MappedArrays
+		{
+			std::shared_ptr<const MappedFile> pFile{};
+			std::span<const BVHNode> nodes{};
+			std::span<const uint32_t> primitiveIndices{};
+			std::span<const BVH8Node> wideNodes{};
+			std::span<const BVH8QuantizedNode<uint16_t>> quantizedNodes16{};
+			std::span<const BVH8QuantizedNode<uint8_t>> quantizedNodes8{};
+		};
+		MappedArrays m_Mapped{};
+
+		double m_CostSum{}; //sum of area * (1 for interior nodes, primitive count for leaves)
+		float m_BuildCost{};
+
+		void BuildBinnedSAH(const std::vector<AABB>& primitiveBounds);
+		void BuildSpatialSplit(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+		void BuildMorton(const std::vector<AABB>& primitiveBounds);
+		void OptimizeTreelets();
+		void RestructureTreelet(uint32_t rootIdx, std::vector<float>& subtreeCosts);
+		bool MapCache(const std::string& path, uint64_t key);
+		void WriteCache(const std::string& path, uint64_t key) const;
+		//Copies a mapped hierarchy into memory and restores the topology, so it can be changed
+		void Unmap();
+
+		void UpdateTopology();
+		void FinishBuild();
+
+		//Spatial splits can put a triangle in several leaves
+		bool HasDuplicateReferences() const { return m_PrimitiveIndices.size() > m_PrimitiveCount; }
+
+		void Collapse();
+		void CollapseNode(uint32_t nodeIdx, uint32_t wideIdx, std::vector<uint32_t>& primitiveIndices);
+		void CopyToWideSlot(uint32_t nodeIdx);
+		//Puts the two children of a just split leaf into the full wide node that held it, or below it when that node is full
+		void SplitWideSlot(uint32_t splitIdx);
+		void QuantizeWideNodes(const std::vector<std::vector<uint32_t>>& levels, bool allNodes);
+
+		template<typename Quantized>
+		bool Quantize(std::vector<BVH8QuantizedNode<Quantized>>& quantizedNodes);
+
+		template<typename Quantized>
+		void QuantizeBounds(BVH8QuantizedNode<Quantized>& quantizedNode, uint32_t wideIdx) const;
+
+		template<typename GetBounds>
+		float RefitNode(uint32_t nodeIdx, const GetBounds& getBounds);
+
+		template<typename GetBounds>
+		void RefitLevels(const std::vector<std::vector<uint32_t>>& levels, const GetBounds& getBounds);
+	};
+}
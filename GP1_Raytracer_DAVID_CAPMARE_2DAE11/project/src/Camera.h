@@ -28,26 +28,24 @@ namespace dae
 		float totalPitch{ 0.f };
 		float totalYaw{ 0.f };
 
-		Matrix cameraToWorld{};
+		Transform cameraToWorld{};
 
 
 
 
-		Matrix CalculateCameraToWorld()
+		Transform CalculateCameraToWorld()
 		{
 			//todo: W2
 			right = Vector3::Cross(Vector3::UnitY, forward).Normalized();
 			up = Vector3::Cross(forward, right).Normalized();
-			return {
-			{right.x,right.y,right.z,0},
-			{up.x,up.y,up.z,0},
-			{forward.x,forward.y,forward.z,0},
-			{origin.x,origin.y,origin.z,1}
-			};
+			return { right, up, forward, origin };
 		}
 
-		void Update(Timer* pTimer)
+		//Returns true when the camera moved or turned
+		bool Update(Timer* pTimer)
 		{
+			const Vector3 oldOrigin{ origin }, oldForward{ forward };
+
 			const float deltaTime = pTimer->GetElapsed();
 
 			//Keyboard Input
@@ -101,6 +99,8 @@ namespace dae
 
 				
 			}
+
+			return !(origin == oldOrigin && forward == oldForward);
 		}
 	};
 }
@@ -1,8 +1,10 @@
 #pragma once
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "Maths.h"
+#include "BVH.h"
 
 
 namespace dae
@@ -24,6 +26,55 @@ namespace dae
 		unsigned char materialIndex{ 0 };
 	};
 
+	//Spheres and planes mirrored 8 at a time as structure of arrays, so a flat list of them is tested one packet per step.
+	//laneMask marks the lanes that hold a primitive, index points back into the scene array
+	struct alignas(32) SpherePacket8
+	{
+		static constexpr int WIDTH{ 8 };
+
+		float originX[WIDTH]{}, originY[WIDTH]{}, originZ[WIDTH]{};
+		float radiusSquared[WIDTH]{};
+		uint32_t index[WIDTH]{};
+		uint32_t laneMask{};
+
+		void SetLane(int lane, const Sphere& sphere, uint32_t sphereIdx)
+		{
+			originX[lane] = sphere.origin.x; originY[lane] = sphere.origin.y; originZ[lane] = sphere.origin.z;
+			radiusSquared[lane] = sphere.radius * sphere.radius;
+			index[lane] = sphereIdx;
+			laneMask |= 1u << lane;
+		}
+	};
+
+	struct alignas(32) PlanePacket8
+	{
+		static constexpr int WIDTH{ 8 };
+
+		float originX[WIDTH]{}, originY[WIDTH]{}, originZ[WIDTH]{};
+		float normalX[WIDTH]{}, normalY[WIDTH]{}, normalZ[WIDTH]{};
+		uint32_t index[WIDTH]{};
+		uint32_t laneMask{};
+
+		void SetLane(int lane, const Plane& plane, uint32_t planeIdx)
+		{
+			originX[lane] = plane.origin.x; originY[lane] = plane.origin.y; originZ[lane] = plane.origin.z;
+			normalX[lane] = plane.normal.x; normalY[lane] = plane.normal.y; normalZ[lane] = plane.normal.z;
+			index[lane] = planeIdx;
+			laneMask |= 1u << lane;
+		}
+	};
+
+	//Fills packets from a flat primitive array, the last packet keeps its unused lanes out of laneMask
+	template<typename Packet, typename Primitive>
+	inline void BuildPrimitivePackets(const std::vector<Primitive>& primitives, std::vector<Packet>& packets)
+	{
+		packets.assign((primitives.size() + Packet::WIDTH - 1) / Packet::WIDTH, Packet{});
+		for (size_t idx{}; idx < primitives.size(); ++idx)
+		{
+			packets[idx / Packet::WIDTH].SetLane(int(idx % Packet::WIDTH), primitives[idx], uint32_t(idx));
+		}
+	}
+
 	enum class TriangleCullMode
 	{
 		FrontFaceCulling,
@@ -31,6 +82,13 @@ namespace dae
 		NoCulling
 	};
 
+	//Closest fills a hit record, Any only answers whether anything is within the ray (shadow rays, they cull the opposite faces)
+	enum class HitQuery
+	{
+		Closest,
+		Any
+	};
+
 	struct Triangle
 	{
 		Triangle() = default;
@@ -55,6 +113,38 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	//Everything a ray test needs from one mesh triangle (Moller-Trumbore), built once per geometry change instead of per test.
+	//The normal is normalized and only used to cull and for the hit record
+	struct TriangleRecord
+	{
+		Vector3 v0{};
+		Vector3 edge1{};
+		Vector3 edge2{};
+		Vector3 normal{};
+	};
+
+	//8 triangle records as structure of arrays, one ray gets tested against all of them at once.
+	//Filled in the primitive order of the mesh hierarchy, position p sits in packet p / 8 at lane p % 8
+	struct alignas(32) TrianglePacket8
+	{
+		static constexpr int WIDTH{ 8 };
+
+		float v0X[WIDTH]{}, v0Y[WIDTH]{}, v0Z[WIDTH]{};
+		float edge1X[WIDTH]{}, edge1Y[WIDTH]{}, edge1Z[WIDTH]{};
+		float edge2X[WIDTH]{}, edge2Y[WIDTH]{}, edge2Z[WIDTH]{};
+		float normalX[WIDTH]{}, normalY[WIDTH]{}, normalZ[WIDTH]{};
+		uint32_t triangleIdx[WIDTH]{};
+
+		void SetLane(int lane, const TriangleRecord& record, uint32_t triIdx)
+		{
+			v0X[lane] = record.v0.x; v0Y[lane] = record.v0.y; v0Z[lane] = record.v0.z;
+			edge1X[lane] = record.edge1.x; edge1Y[lane] = record.edge1.y; edge1Z[lane] = record.edge1.z;
+			edge2X[lane] = record.edge2.x; edge2Y[lane] = record.edge2.y; edge2Z[lane] = record.edge2.z;
+			normalX[lane] = record.normal.x; normalY[lane] = record.normal.y; normalZ[lane] = record.normal.z;
+			triangleIdx[lane] = triIdx;
+		}
+	};
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -64,27 +154,41 @@ namespace dae
 			//Calculate Normals
 			CalculateNormals();
 
-			//Update Transforms
+			UpdateGeometry();
 			UpdateTransforms();
 		}
 
 		TriangleMesh(const std::vector<Vector3>& _positions, const std::vector<int>& _indices, const std::vector<Vector3>& _normals, TriangleCullMode _cullMode) :
 			positions(_positions), indices(_indices), normals(_normals), cullMode(_cullMode)
 		{
+			UpdateGeometry();
 			UpdateTransforms();
 		}
 
+		//Object space geometry, never rewritten by the transforms
 		std::vector<Vector3> positions{};
 		std::vector<Vector3> normals{};
 		std::vector<int> indices{};
 		unsigned char materialIndex{};
 
+		//One per triangle in object space, the hit tests read these instead of the positions
+		std::vector<TriangleRecord> triangleRecords{};
+
+		//The same records in hierarchy order for the 8-wide leaf test, rebuilt whenever the hierarchy reorders its primitives.
+		//trianglePositions maps a triangle back to its position so refits only rewrite the lanes that moved, it stays empty
+		//when the hierarchy references a triangle more than once (spatial splits)
+		std::vector<TrianglePacket8> trianglePackets{};
+		std::vector<uint32_t> trianglePositions{};
+
 		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
 
-		Matrix rotationTransform{};
-		Matrix translationTransform{};
-		Matrix scaleTransform{};
+		Transform rotationTransform{};
+		Transform translationTransform{};
+		Transform scaleTransform{};
 
+		//Instance transform (object to world) and its inverse, rays are moved to object space for the hit tests
+		Transform transform{};
+		Transform inverseTransform{};
 
 		Vector3 minAABB{};
 		Vector3 maxAABB{};
@@ -92,25 +196,31 @@ namespace dae
 		Vector3 transformedMinAABB{};
 		Vector3 transformedMaxAABB{};
 
-		std::vector<Vector3> transformedPositions{};
-		std::vector<Vector3> transformedNormals{};
+		//Built over the object space positions, so moving the mesh never invalidates it
+		BVH bvh{};
+
+		//Set before UpdateGeometry to map the hierarchy from a cache file written by an earlier run, big meshes skip the build that way
+		std::string bvhCacheDirectory{};
+
+		//Refits keep the hierarchy until its SAH cost got this much worse than right after the last build
+		float bvhRebuildCostRatio{ BVH::REBUILD_COST_RATIO };
 
 		void Translate(const Vector3& translation)
 		{
-			translationTransform = Matrix::CreateTranslation(translation);
+			translationTransform = Transform::CreateTranslation(translation);
 		}
 
 		void RotateY(float yaw)
 		{
-			rotationTransform = Matrix::CreateRotationY(yaw);
+			rotationTransform = Transform::CreateRotationY(yaw);
 		}
 
 		void Scale(const Vector3& scale)
 		{
-			scaleTransform = Matrix::CreateScale(scale);
+			scaleTransform = Transform::CreateScale(scale);
 		}
 
-		void AppendTriangle(const Triangle& triangle, bool ignoreTransformUpdate = false)
+		void AppendTriangle(const Triangle& triangle, bool ignoreGeometryUpdate = false)
 		{
 			int startIndex = static_cast<int>(positions.size());
 
@@ -124,9 +234,33 @@ namespace dae
 
 			normals.push_back(triangle.normal);
 
-			//Not ideal, but making sure all vertices are updated
-			if (!ignoreTransformUpdate)
-				UpdateTransforms();
+			if (ignoreGeometryUpdate)
+				return;
+
+			triangleRecords.push_back(CalculateTriangleRecord(indices.size() / 3 - 1));
+
+			//Grow the hierarchy by one leaf while it still covers every other triangle and has not degraded too much
+			const uint32_t triIdx = static_cast<uint32_t>(indices.size() / 3 - 1);
+			AABB bounds{};
+			bounds.Grow(triangle.v0);
+			bounds.Grow(triangle.v1);
+			bounds.Grow(triangle.v2);
+
+			if (bvh.GetPrimitiveIndices().size() == triIdx && bvh.Insert(triIdx, bounds) && bvh.GetCostRatio() <= bvhRebuildCostRatio)
+			{
+				//full nodes keep the order and put the new triangle last, so only its lane is written
+				if (bvh.GetNodeFormat() == BVHNodeFormat::Full && trianglePositions.size() == triIdx)
+				{
+					trianglePackets.resize(triIdx / TrianglePacket8::WIDTH + 1);
+					trianglePackets[triIdx / TrianglePacket8::WIDTH].SetLane(triIdx % TrianglePacket8::WIDTH, triangleRecords[triIdx], triIdx);
+					trianglePositions.push_back(triIdx);
+				}
+				else
+					UpdateTrianglePackets();
+				UpdateAABBFromBVH();
+			}
+			else
+				UpdateGeometry();
 		}
 
 		void CalculateNormals()
@@ -136,37 +270,129 @@ namespace dae
 
 			for (size_t idx{}; idx < indices.size(); idx += 3)
 			{
-				
-				const Vector3 a = positions[indices[idx + 1]] - positions[indices[idx]];
-				const Vector3 b = positions[indices[idx + 2]] - positions[indices[idx]];
-				const Vector3 n = Vector3::Cross(a,b).Normalized();
+				normals.emplace_back(CalculateNormal(idx / 3));
+			}
+		}
 
-				normals.emplace_back(n);
+		Vector3 CalculateNormal(size_t triIdx) const
+		{
+			const size_t idx = triIdx * 3;
+			const Vector3 a = positions[indices[idx + 1]] - positions[indices[idx]];
+			const Vector3 b = positions[indices[idx + 2]] - positions[indices[idx]];
+			return Vector3::Cross(a, b).Normalized();
+		}
+
+		TriangleRecord CalculateTriangleRecord(size_t triIdx) const
+		{
+			const size_t idx = triIdx * 3;
+			const Vector3& v0 = positions[indices[idx]];
+			const Vector3 edge1 = positions[indices[idx + 1]] - v0;
+			const Vector3 edge2 = positions[indices[idx + 2]] - v0;
+			return TriangleRecord{ v0, edge1, edge2, Vector3::Cross(edge1, edge2).Normalized() };
+		}
+
+		void UpdateTriangleRecords()
+		{
+			triangleRecords.resize(indices.size() / 3);
+			for (size_t triIdx{}; triIdx < triangleRecords.size(); ++triIdx)
+			{
+				triangleRecords[triIdx] = CalculateTriangleRecord(triIdx);
 			}
 		}
 
-		void UpdateTransforms()
+		//Call after the hierarchy changed its primitive order (build, insert), the records have to be up to date already
+		void UpdateTrianglePackets()
 		{
-			
-			transformedPositions.clear();
-			transformedPositions.reserve(positions.size());
+			const std::span<const uint32_t> primitiveIndices = bvh.GetPrimitiveIndices();
+			const size_t primitiveCount = primitiveIndices.size();
+
+			trianglePackets.assign((primitiveCount + TrianglePacket8::WIDTH - 1) / TrianglePacket8::WIDTH, TrianglePacket8{});
+			trianglePositions.assign(triangleRecords.size(), UINT32_MAX);
+
+			bool hasDuplicates{ false };
+			for (size_t position{}; position < primitiveCount; ++position)
+			{
+				const uint32_t triIdx = primitiveIndices[position];
+				trianglePackets[position / TrianglePacket8::WIDTH].SetLane(position % TrianglePacket8::WIDTH, triangleRecords[triIdx], triIdx);
 
-			transformedNormals.clear();
-			transformedNormals.reserve(normals.size());
+				if (trianglePositions[triIdx] != UINT32_MAX) hasDuplicates = true;
+				trianglePositions[triIdx] = static_cast<uint32_t>(position);
+			}
+
+			if (hasDuplicates) trianglePositions.clear();
+		}
 
-			const auto finalTransform = rotationTransform * translationTransform * scaleTransform;
+		//Call after the positions or indices changed, rebuilds the object space bounds, triangle records and hierarchy
+		void UpdateGeometry()
+		{
+			UpdateAABB();
+			UpdateTriangleRecords();
+			bvh.Build(positions, indices, bvhCacheDirectory);
+			UpdateTrianglePackets();
+			UpdateTransformedAABB(transform);
+		}
 
-			for (const auto& pos : positions)
+		/**
+		 * \brief Call after moving vertices without changing the indices (vertex animation, deformation).
+		 * Refits the hierarchy bottom-up, only above changedTriangles when given, and rebuilds it once it degraded too much
+		 */
+		void RefitGeometry(const std::vector<uint32_t>& changedTriangles = {})
+		{
+			if (changedTriangles.empty())
 			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(pos));
+				CalculateNormals();
+				UpdateTriangleRecords();
+				bvh.Refit(positions, indices);
+			}
+			else
+			{
+				for (const uint32_t triIdx : changedTriangles)
+				{
+					normals[triIdx] = CalculateNormal(triIdx);
+					triangleRecords[triIdx] = CalculateTriangleRecord(triIdx);
+				}
+				bvh.Refit(positions, indices, changedTriangles);
 			}
 
-			for (const auto& norm : normals)
+			//refits keep the primitive order, only the lanes of moved triangles change
+			if (bvh.GetCostRatio() > bvhRebuildCostRatio)
 			{
-				transformedNormals.emplace_back(finalTransform.TransformVector(norm).Normalized());
+				bvh.Build(positions, indices);
+				UpdateTrianglePackets();
 			}
+			else if (changedTriangles.empty() || trianglePositions.empty())
+			{
+				UpdateTrianglePackets();
+			}
+			else
+			{
+				for (const uint32_t triIdx : changedTriangles)
+				{
+					const uint32_t position = trianglePositions[triIdx];
+					trianglePackets[position / TrianglePacket8::WIDTH].SetLane(position % TrianglePacket8::WIDTH, triangleRecords[triIdx], triIdx);
+				}
+			}
+
+			UpdateAABBFromBVH();
+		}
+
+		//Only composes the instance transform, the cost does not depend on the vertex count
+		void UpdateTransforms()
+		{
+			transform = rotationTransform * translationTransform * scaleTransform;
+			inverseTransform = Transform::Inverse(transform);
+
+			UpdateTransformedAABB(transform);
+		}
 
-			UpdateTransformedAABB(finalTransform);
+		//Normals go through the inverse transpose so non-uniform scales keep them perpendicular
+		Vector3 TransformNormal(const Vector3& normal) const
+		{
+			return Vector3{
+				Vector3::Dot(normal, inverseTransform.GetAxisX()),
+				Vector3::Dot(normal, inverseTransform.GetAxisY()),
+				Vector3::Dot(normal, inverseTransform.GetAxisZ())
+			}.Normalized();
 		}
 
 		void UpdateAABB()
@@ -183,38 +409,39 @@ namespace dae
 			}
 		}
 
-		void UpdateTransformedAABB(const Matrix& finalTransform)
+		//The root node already bounds every triangle, no need to walk the positions again
+		void UpdateAABBFromBVH()
 		{
-			Vector3 tMinAABB = finalTransform.TransformPoint(minAABB);
-			Vector3 tMaxAABB = tMinAABB;
+			if (!bvh.IsEmpty())
+			{
+				minAABB = bvh.GetNodes()[0].minAABB;
+				maxAABB = bvh.GetNodes()[0].maxAABB;
+			}
+			UpdateTransformedAABB(transform);
+		}
 
-			Vector3 tAABB = finalTransform.TransformPoint(maxAABB.x, minAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			
-			tAABB = finalTransform.TransformPoint(maxAABB.x, minAABB.y, maxAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			
-			tAABB = finalTransform.TransformPoint(minAABB.x, minAABB.y, maxAABB.z);
-			tMinAABB = Vector3::Min(tAABB, minAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			
-			tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			
-			tAABB = finalTransform.TransformPoint(maxAABB.x, maxAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			
-			tAABB = finalTransform.TransformPoint(maxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			
-			tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, maxAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		void UpdateTransformedAABB(const Transform& finalTransform)
+		{
+			Vector3 corners[8]
+			{
+				minAABB,
+				{ maxAABB.x, minAABB.y, minAABB.z },
+				{ maxAABB.x, minAABB.y, maxAABB.z },
+				{ minAABB.x, minAABB.y, maxAABB.z },
+				{ minAABB.x, maxAABB.y, minAABB.z },
+				{ maxAABB.x, maxAABB.y, minAABB.z },
+				maxAABB,
+				{ minAABB.x, maxAABB.y, maxAABB.z }
+			};
+			finalTransform.TransformPoints(corners, corners, 8);
+
+			Vector3 tMinAABB = corners[0];
+			Vector3 tMaxAABB = tMinAABB;
+			for (int idx{ 1 }; idx < 8; ++idx)
+			{
+				tMinAABB = Vector3::Min(corners[idx], tMinAABB);
+				tMaxAABB = Vector3::Max(corners[idx], tMaxAABB);
+			}
 
 			transformedMinAABB = tMinAABB;
 			transformedMaxAABB = tMaxAABB;
@@ -242,11 +469,58 @@ namespace dae
 #pragma region MISC
 	struct Ray
 	{
+		Ray() = default;
+		Ray(const Vector3& _origin, const Vector3& _direction, float _min = 0.0001f, float _max = FLT_MAX) :
+			Ray(_origin, _direction, { 1.f / _direction.x, 1.f / _direction.y, 1.f / _direction.z }, _min, _max)
+		{
+		}
+
+		//For rays whose inverse direction is already known, like the lanes of a RayPacket8
+		Ray(const Vector3& _origin, const Vector3& _direction, const Vector3& _invDirection, float _min, float _max) :
+			origin(_origin), direction(_direction), min(_min), max(_max), invDirection(_invDirection),
+			negativeX(_invDirection.x < 0.f), negativeY(_invDirection.y < 0.f), negativeZ(_invDirection.z < 0.f)
+		{
+		}
+
 		Vector3 origin{};
 		Vector3 direction{};
 
 		float min{ 0.0001f };
 		float max{ FLT_MAX };
+
+		//Derived from direction once when the ray is made, every slab test reads these instead of dividing again.
+		//Only origin, min and max may change afterwards
+		Vector3 invDirection{};
+		bool negativeX{}, negativeY{}, negativeZ{};
+	};
+
+	//8 coherent rays as structure of arrays, one per SIMD lane. Lanes outside activeMask are skipped by every packet test
+	struct alignas(32) RayPacket8
+	{
+		static constexpr int WIDTH{ 8 };
+
+		float originX[WIDTH]{}, originY[WIDTH]{}, originZ[WIDTH]{};
+		float directionX[WIDTH]{}, directionY[WIDTH]{}, directionZ[WIDTH]{};
+		float invDirectionX[WIDTH]{}, invDirectionY[WIDTH]{}, invDirectionZ[WIDTH]{};
+		float min[WIDTH]{}, max[WIDTH]{};
+		uint32_t activeMask{};
+
+		//Forced inline like the math types, the SIMD kernels call these and must not leave a copy built with their flags
+		DAE_INLINE void SetRay(int lane, const Ray& ray)
+		{
+			originX[lane] = ray.origin.x; originY[lane] = ray.origin.y; originZ[lane] = ray.origin.z;
+			directionX[lane] = ray.direction.x; directionY[lane] = ray.direction.y; directionZ[lane] = ray.direction.z;
+			invDirectionX[lane] = ray.invDirection.x; invDirectionY[lane] = ray.invDirection.y; invDirectionZ[lane] = ray.invDirection.z;
+			min[lane] = ray.min;
+			max[lane] = ray.max;
+			activeMask |= 1u << lane;
+		}
+
+		DAE_INLINE Ray GetRay(int lane) const
+		{
+			return Ray{ { originX[lane], originY[lane], originZ[lane] }, { directionX[lane], directionY[lane], directionZ[lane] },
+				{ invDirectionX[lane], invDirectionY[lane], invDirectionZ[lane] }, min[lane], max[lane] };
+		}
 	};
 
 	struct HitRecord
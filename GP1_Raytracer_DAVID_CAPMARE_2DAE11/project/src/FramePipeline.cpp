@@ -0,0 +1,98 @@
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Project includes
+#include "FramePipeline.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace dae;
+
+FramePipeline::FramePipeline(SDL_Window* pWindow, Renderer* pRenderer, uint32_t bufferCount) :
+	m_pWindow{ pWindow },
+	m_pRenderer{ pRenderer }
+{
+	//with a single buffer every screenshot would stall the next frame
+	bufferCount = std::max(bufferCount, 2u);
+
+	const SDL_Surface* pWindowSurface{ SDL_GetWindowSurface(pWindow) };
+	m_Buffers.reserve(bufferCount);
+	for (uint32_t bufferIdx{}; bufferIdx < bufferCount; ++bufferIdx)
+	{
+		m_Buffers.emplace_back(SDL_CreateRGBSurfaceWithFormat(0, pWindowSurface->w, pWindowSurface->h, pWindowSurface->format->BitsPerPixel, pWindowSurface->format->format));
+	}
+	m_pSaving = std::make_unique<bool[]>(bufferCount);
+
+	m_SaveThread = std::thread{ [this] { SaveLoop(); } };
+}
+
+FramePipeline::~FramePipeline()
+{
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_bStop = true;
+	}
+	m_SaveQueued.notify_one();
+	m_SaveThread.join();
+
+	m_pRenderer->SetRenderTarget(nullptr);
+	for (SDL_Surface* pBuffer : m_Buffers) SDL_FreeSurface(pBuffer);
+}
+
+void FramePipeline::RenderFrame(Scene* pScene, bool bSaveToImage)
+{
+	const uint32_t bufferIdx{ uint32_t(m_RenderedFrames++ % m_Buffers.size()) };
+	{
+		//the buffer of this frame can still hold a screenshot from count frames ago
+		std::unique_lock lock{ m_Mutex };
+		m_BufferSaved.wait(lock, [this, bufferIdx] { return !m_pSaving[bufferIdx]; });
+	}
+
+	SDL_Surface* pBuffer{ m_Buffers[bufferIdx] };
+	m_pRenderer->SetRenderTarget(pBuffer);
+	m_pRenderer->Render(pScene);
+
+	//the window surface is looked up every frame, SDL recreates it when the window changes. Same format on both sides,
+	//so this is a plain copy
+	SDL_BlitSurface(pBuffer, nullptr, SDL_GetWindowSurface(m_pWindow), nullptr);
+	SDL_UpdateWindowSurface(m_pWindow);
+
+	if (!bSaveToImage) return;
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_pSaving[bufferIdx] = true;
+		m_SaveQueue.push_back(bufferIdx);
+	}
+	m_SaveQueued.notify_one();
+}
+
+void FramePipeline::SaveLoop()
+{
+	while (true)
+	{
+		uint32_t bufferIdx{};
+		{
+			//drains the queue before stopping, so no screenshot is lost
+			std::unique_lock lock{ m_Mutex };
+			m_SaveQueued.wait(lock, [this] { return m_bStop || !m_SaveQueue.empty(); });
+			if (m_SaveQueue.empty()) return;
+			bufferIdx = m_SaveQueue.front();
+			m_SaveQueue.pop_front();
+		}
+
+		//only reads the offscreen buffer, nothing of the window
+		if (!SDL_SaveBMP(m_Buffers[bufferIdx], Renderer::SCREENSHOT_PATH))
+			std::cout << "Screenshot saved!" << std::endl;
+		else
+			std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_pSaving[bufferIdx] = false;
+		}
+		m_BufferSaved.notify_one();
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+//Standard includes
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct SDL_Window;
+struct SDL_Surface;
+
+namespace dae
+{
+	class Renderer;
+	class Scene;
+
+	/**
+	 * \brief Renders frames into a ring of offscreen buffers and shows each one on the calling thread, SDL only supports the
+	 * window surface on the thread that handles the window events. Screenshots are written by a save thread while the next
+	 * frames render, RenderFrame only waits when the buffer it needs still has its screenshot being written
+	 */
+	class FramePipeline final
+	{
+	public:
+		//bufferCount screenshots can queue up while rendering goes on, at least 2
+		FramePipeline(SDL_Window* pWindow, Renderer* pRenderer, uint32_t bufferCount = DEFAULT_BUFFER_COUNT);
+		//Writes the screenshots still queued and points the renderer back at the window
+		~FramePipeline();
+
+		FramePipeline(const FramePipeline&) = delete;
+		FramePipeline(FramePipeline&&) noexcept = delete;
+		FramePipeline& operator=(const FramePipeline&) = delete;
+		FramePipeline& operator=(FramePipeline&&) noexcept = delete;
+
+		//Renders and presents the next frame on the calling thread, bSaveToImage queues it for Renderer::SCREENSHOT_PATH
+		void RenderFrame(Scene* pScene, bool bSaveToImage);
+
+		uint32_t GetBufferCount() const { return uint32_t(m_Buffers.size()); }
+
+		static constexpr uint32_t DEFAULT_BUFFER_COUNT{ 3 };
+
+	private:
+		void SaveLoop();
+
+		SDL_Window* m_pWindow{};
+		Renderer* m_pRenderer{};
+
+		//frame f always lives in buffer f % count
+		std::vector<SDL_Surface*> m_Buffers{};
+		uint64_t m_RenderedFrames{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_SaveQueued{};
+		std::condition_variable m_BufferSaved{};
+		//buffers waiting for or being written by the save thread, in frame order
+		std::deque<uint32_t> m_SaveQueue{};
+		std::unique_ptr<bool[]> m_pSaving{};
+		bool m_bStop{};
+
+		std::thread m_SaveThread{};
+	};
+}
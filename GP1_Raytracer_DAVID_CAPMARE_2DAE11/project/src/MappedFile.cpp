@@ -0,0 +1,69 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace dae;
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::string& path)
+{
+	std::shared_ptr<MappedFile> pFile{ new MappedFile() };
+
+#ifdef _WIN32
+	pFile->m_FileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (pFile->m_FileHandle == INVALID_HANDLE_VALUE)
+	{
+		pFile->m_FileHandle = nullptr;
+		return nullptr;
+	}
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(pFile->m_FileHandle, &size) || size.QuadPart == 0) return nullptr;
+
+	pFile->m_MappingHandle = CreateFileMappingA(pFile->m_FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!pFile->m_MappingHandle) return nullptr;
+
+	pFile->m_pData = static_cast<const std::byte*>(MapViewOfFile(pFile->m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+	pFile->m_Size = static_cast<size_t>(size.QuadPart);
+#else
+	const int fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) return nullptr;
+
+	struct stat fileStat{};
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close(fileDescriptor);
+		return nullptr;
+	}
+
+	//the mapping keeps its own reference to the file
+	void* pData = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	close(fileDescriptor);
+	if (pData == MAP_FAILED) return nullptr;
+
+	pFile->m_pData = static_cast<const std::byte*>(pData);
+	pFile->m_Size = static_cast<size_t>(fileStat.st_size);
+#endif
+
+	if (!pFile->m_pData) return nullptr;
+	return pFile;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (m_pData) UnmapViewOfFile(m_pData);
+	if (m_MappingHandle) CloseHandle(m_MappingHandle);
+	if (m_FileHandle) CloseHandle(m_FileHandle);
+#else
+	if (m_pData) munmap(const_cast<std::byte*>(m_pData), m_Size);
+#endif
+}
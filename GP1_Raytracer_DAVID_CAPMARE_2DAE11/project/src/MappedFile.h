@@ -0,0 +1,41 @@
+#pragma once
+
+//Standard includes
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace dae
+{
+	/**
+	 * \brief Read-only view of a whole file mapped into memory, pages are loaded by the OS when first touched.
+	 * The mapping stays valid until the object is destroyed
+	 */
+	class MappedFile final
+	{
+	public:
+		//nullptr when the file does not exist, is empty or cannot be mapped
+		static std::shared_ptr<const MappedFile> Open(const std::string& path);
+
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		const std::byte* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		MappedFile() = default;
+
+		const std::byte* m_pData{};
+		size_t m_Size{};
+
+#ifdef _WIN32
+		void* m_FileHandle{};
+		void* m_MappingHandle{};
+#endif
+	};
+}
@@ -3,6 +3,14 @@
 #include <cfloat>
 #include <algorithm>
 
+//The math types live in their headers so every vector op inlines into the hit tests and shading.
+//Forced, since an out-of-line copy emitted by one SIMD kernel copy could otherwise be picked by the linker for all of them
+#ifdef _MSC_VER
+#define DAE_INLINE __forceinline
+#else
+#define DAE_INLINE inline __attribute__((always_inline))
+#endif
+
 namespace dae
 {
 	/* --- CONSTANTS --- */
@@ -15,18 +23,18 @@ namespace dae
 	constexpr auto TO_DEGREES = (180.0f / PI);
 	constexpr auto TO_RADIANS(PI / 180.0f);
 
-	inline float Square(float a)
+	DAE_INLINE constexpr float Square(float a)
 	{
 		return a * a;
 	}
 
-	inline float Lerpf(float a, float b, float factor)
+	DAE_INLINE constexpr float Lerpf(float a, float b, float factor)
 	{
 		return ((1 - factor) * a) + (factor * b);
 	}
 
-	inline bool AreEqual(float a, float b, float epsilon = FLT_EPSILON)
+	DAE_INLINE bool AreEqual(float a, float b, float epsilon = FLT_EPSILON)
 	{
-		return abs(a - b) < epsilon;
+		return std::abs(a - b) < epsilon;
 	}
 }
@@ -2,6 +2,7 @@
 #include "Vector3.h"
 #include "Vector4.h"
 #include "Matrix.h"
+#include "Transform.h"
 #include "ColorRGB.h"
 #include "MathHelpers.h"
 
@@ -1,4 +1,6 @@
 #pragma once
+#include <cassert>
+
 #include "Vector3.h"
 #include "Vector4.h"
 
@@ -6,47 +8,228 @@ namespace dae {
 	struct Matrix
 	{
 		Matrix() = default;
-		Matrix(
+		DAE_INLINE constexpr Matrix(
 			const Vector3& xAxis,
 			const Vector3& yAxis,
 			const Vector3& zAxis,
-			const Vector3& t);
+			const Vector3& t) :
+			Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
+		{
+		}
 
-		Matrix(
+		DAE_INLINE constexpr Matrix(
 			const Vector4& xAxis,
 			const Vector4& yAxis,
 			const Vector4& zAxis,
-			const Vector4& t);
-
-		Matrix(const Matrix& m);
-
-		Vector3 TransformVector(const Vector3& v) const;
-		Vector3 TransformVector(float x, float y, float z) const;
-		Vector3 TransformPoint(const Vector3& p) const;
-		Vector3 TransformPoint(float x, float y, float z) const;
-		const Matrix& Transpose();
-
-		Vector3 GetAxisX() const;
-		Vector3 GetAxisY() const;
-		Vector3 GetAxisZ() const;
-		Vector3 GetTranslation() const;
-
-		static Matrix CreateTranslation(float x, float y, float z);
-		static Matrix CreateTranslation(const Vector3& t);
-		static Matrix CreateRotationX(float pitch);
-		static Matrix CreateRotationY(float yaw);
-		static Matrix CreateRotationZ(float roll);
-		static Matrix CreateRotation(float pitch, float yaw, float roll);
-		static Matrix CreateRotation(const Vector3& r);
-		static Matrix CreateScale(float sx, float sy, float sz);
-		static Matrix CreateScale(const Vector3& s);
-		static Matrix Transpose(const Matrix& m);
-
-		Vector4& operator[](int index);
-		Vector4 operator[](int index) const;
-		Matrix operator*(const Matrix& m) const;
-		const Matrix& operator*=(const Matrix& m);
-		bool operator==(const Matrix& m) const;
+			const Vector4& t) :
+			data{ xAxis, yAxis, zAxis, t }
+		{
+		}
+
+		DAE_INLINE constexpr Vector3 TransformVector(const Vector3& v) const
+		{
+			return TransformVector(v[0], v[1], v[2]);
+		}
+
+		DAE_INLINE constexpr Vector3 TransformVector(float x, float y, float z) const
+		{
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z,
+				data[0].y * x + data[1].y * y + data[2].y * z,
+				data[0].z * x + data[1].z * y + data[2].z * z
+			};
+		}
+
+		DAE_INLINE constexpr Vector3 TransformPoint(const Vector3& p) const
+		{
+			return TransformPoint(p[0], p[1], p[2]);
+		}
+
+		DAE_INLINE constexpr Vector3 TransformPoint(float x, float y, float z) const
+		{
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+				data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+				data[0].z * x + data[1].z * y + data[2].z * z + data[3].z
+			};
+		}
+
+		DAE_INLINE constexpr const Matrix& Transpose()
+		{
+			*this = Transpose(*this);
+			return *this;
+		}
+
+		DAE_INLINE constexpr Vector3 GetAxisX() const
+		{
+			return data[0];
+		}
+
+		DAE_INLINE constexpr Vector3 GetAxisY() const
+		{
+			return data[1];
+		}
+
+		DAE_INLINE constexpr Vector3 GetAxisZ() const
+		{
+			return data[2];
+		}
+
+		DAE_INLINE constexpr Vector3 GetTranslation() const
+		{
+			return data[3];
+		}
+
+		DAE_INLINE static constexpr Matrix CreateTranslation(float x, float y, float z)
+		{
+			return {
+			{1,0,0,0},
+			{0,1,0,0},
+			{0,0,1,0},
+			{x,y,z,1}
+			};
+		}
+
+		DAE_INLINE static constexpr Matrix CreateTranslation(const Vector3& t)
+		{
+			return CreateTranslation(t.x, t.y, t.z);
+		}
+
+		//Angles in degrees
+		DAE_INLINE static Matrix CreateRotationX(float pitch)
+		{
+			pitch *= TO_RADIANS;
+
+			return {
+			{1,0,0,0},
+			{0,std::cos(pitch),std::sin(pitch),0},
+			{0,-std::sin(pitch),std::cos(pitch),0},
+			{0,0,0,1}
+			};
+		}
+
+		DAE_INLINE static Matrix CreateRotationY(float yaw)
+		{
+			yaw *= TO_RADIANS;
+
+			return {
+			{std::cos(yaw),0,-std::sin(yaw),0},
+			{0,1,0,0},
+			{std::sin(yaw),0,std::cos(yaw),0},
+			{0,0,0,1}
+			};
+		}
+
+		DAE_INLINE static Matrix CreateRotationZ(float roll)
+		{
+			roll *= TO_RADIANS;
+
+			return {
+			{std::cos(roll),std::sin(roll),0,0},
+			{-std::sin(roll),std::cos(roll),0,0},
+			{0,0,1,0},
+			{0,0,0,1}
+			};
+		}
+
+		DAE_INLINE static Matrix CreateRotation(float pitch, float yaw, float roll)
+		{
+			return CreateRotationX(pitch) * CreateRotationY(yaw) * CreateRotationZ(roll);
+		}
+
+		DAE_INLINE static Matrix CreateRotation(const Vector3& r)
+		{
+			return CreateRotation(r.x, r.y, r.z);
+		}
+
+		DAE_INLINE static constexpr Matrix CreateScale(float sx, float sy, float sz)
+		{
+			return {
+			{ sx,0,0,0},
+			{ 0,sy,0,0},
+			{ 0,0,sz,0},
+			{ 0,0,0,1 }
+			};
+		}
+
+		DAE_INLINE static constexpr Matrix CreateScale(const Vector3& s)
+		{
+			return CreateScale(s[0], s[1], s[2]);
+		}
+
+		DAE_INLINE static constexpr Matrix Transpose(const Matrix& m)
+		{
+			return {
+			{ m.data[0].x, m.data[1].x, m.data[2].x, m.data[3].x },
+			{ m.data[0].y, m.data[1].y, m.data[2].y, m.data[3].y },
+			{ m.data[0].z, m.data[1].z, m.data[2].z, m.data[3].z },
+			{ m.data[0].w, m.data[1].w, m.data[2].w, m.data[3].w }
+			};
+		}
+
+		DAE_INLINE static constexpr Matrix Inverse(const Matrix& m)
+		{
+			//Only affine matrices are used, so invert the 3x3 part and move the translation along
+			const Vector3 xAxis = m.GetAxisX();
+			const Vector3 yAxis = m.GetAxisY();
+			const Vector3 zAxis = m.GetAxisZ();
+
+			const Vector3 c0 = Vector3::Cross(yAxis, zAxis);
+			const Vector3 c1 = Vector3::Cross(zAxis, xAxis);
+			const Vector3 c2 = Vector3::Cross(xAxis, yAxis);
+			const float invDeterminant = 1.f / Vector3::Dot(xAxis, c0);
+
+			Matrix out{
+				Vector3{ c0.x, c1.x, c2.x } * invDeterminant,
+				Vector3{ c0.y, c1.y, c2.y } * invDeterminant,
+				Vector3{ c0.z, c1.z, c2.z } * invDeterminant,
+				Vector3::Zero
+			};
+			out[3] = Vector4{ -out.TransformVector(m.GetTranslation()), 1 };
+
+			return out;
+		}
+
+#pragma region Operator Overloads
+		DAE_INLINE constexpr Vector4& operator[](int index)
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		DAE_INLINE constexpr Vector4 operator[](int index) const
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		//Row r of the result is row r of this matrix times m, written out so it stays in registers
+		DAE_INLINE constexpr Matrix operator*(const Matrix& m) const
+		{
+			Matrix result{};
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				const Vector4& row = data[r];
+				result.data[r] = m.data[0] * row.x + m.data[1] * row.y + m.data[2] * row.z + m.data[3] * row.w;
+			}
+
+			return result;
+		}
+
+		DAE_INLINE constexpr const Matrix& operator*=(const Matrix& m)
+		{
+			*this = *this * m;
+			return *this;
+		}
+
+		DAE_INLINE bool operator==(const Matrix& m) const
+		{
+			return data[0] == m.data[0]
+				&& data[1] == m.data[1]
+				&& data[2] == m.data[2]
+				&& data[3] == m.data[3];
+		}
+#pragma endregion
 
 	private:
 
@@ -64,4 +247,4 @@ namespace dae {
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
 	};
-}
\ No newline at end of file
+}
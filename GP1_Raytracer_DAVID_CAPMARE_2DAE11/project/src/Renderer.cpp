@@ -5,16 +5,19 @@
 //Project includes
 #include "Renderer.h"
 #include "Maths.h"
-#include "Matrix.h"
+#include "Transform.h"
 #include "Material.h"
 #include "Scene.h"
+#include "ThreadPool.h"
 #include "Utils.h"
 
-#include <execution>
 #include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
 
 #define PARALLEL_EXECUTION
-#define SOFT_SHADOWS
+#define PACKET_TRACING //primary rays are traced in blocks of PACKET_WIDTH x PACKET_HEIGHT
 
 using namespace dae;
 
@@ -28,11 +31,58 @@ Renderer::Renderer(SDL_Window * pWindow) :
 	m_AspectRatio = (float)m_Width / (float)m_Height;
 	m_FOV = tan((FOV_ANGLE * (M_PI / 180.f)) / 2.f);
 
+	m_pThreadPool = std::make_unique<ThreadPool>();
+	m_pPixelSamples = std::make_unique<PixelSamples[]>(size_t(m_Width) * m_Height);
+}
+
+Renderer::~Renderer() = default;
+
+void Renderer::Render(Scene* pScene)
+{
+	const auto frameStart = std::chrono::steady_clock::now();
 
+	const float scale{ m_ResolutionController.GetScale() };
+
+	//the shadow samples are the only thing that may differ between two accumulated frames
+	const bool bRestart{ !m_bAccumulate || pScene->HasChanged() || scale != m_AccumulatedScale
+		|| int(pScene->m_CurrentLightingMode) != m_AccumulatedLightingMode || pScene->m_bShadowEnabled != m_bAccumulatedShadows };
+	m_AccumulatedFrames = bRestart ? 1 : m_AccumulatedFrames + 1;
+	m_AccumulatedScale = scale;
+	m_AccumulatedLightingMode = int(pScene->m_CurrentLightingMode);
+	m_bAccumulatedShadows = pScene->m_bShadowEnabled;
+
+	if (scale < 1.f)
+	{
+		uint32_t* pTargetPixels{ m_pBufferPixels };
+		const int targetWidth{ m_Width }, targetHeight{ m_Height };
+
+		//the aspect ratio stays the one of the window, only the number of rays shrinks
+		m_Width = std::max(int(targetWidth * scale + .5f), PACKET_WIDTH);
+		m_Height = std::max(int(targetHeight * scale + .5f), PACKET_HEIGHT);
+		m_pBufferPixels = m_ScaledPixels.data();
+
+		RenderImage(pScene);
+		Upscale(pTargetPixels, targetWidth, targetHeight);
+
+		m_Width = targetWidth;
+		m_Height = targetHeight;
+		m_pBufferPixels = pTargetPixels;
+	}
+	else
+	{
+		RenderImage(pScene);
+	}
 
+	if (m_ResolutionController.GetTargetFrameTime() > 0.f)
+	{
+		m_ResolutionController.Update(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+	}
+
+	//Update SDL Surface, other targets are presented by whoever set them
+	if (m_bRenderToWindow) SDL_UpdateWindowSurface(m_pWindow);
 }
 
-void Renderer::Render(Scene* pScene) const
+void Renderer::RenderImage(Scene* pScene) const
 {
 	Camera& camera = pScene->GetCamera();
 	auto& materials = pScene->GetMaterials();
@@ -40,147 +90,187 @@ void Renderer::Render(Scene* pScene) const
 
 
 
-	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
-	const uint32_t ammountOfPixels{ uint32_t(m_Width * m_Height) };
+	const Transform cameraToWorld = camera.CalculateCameraToWorld();
+
+	//one lookup per frame, the table only changes through SetSimdLevel
+	const SimdKernelTable& kernels{ GetSimdKernels() };
 
 #ifdef PARALLEL_EXECUTION
-	//parallel
-	std::vector<uint32_t> pixelIndices{};
-	pixelIndices.reserve(ammountOfPixels);
-	for (uint32_t pixelIndex{}; pixelIndex < ammountOfPixels; ++pixelIndex) { pixelIndices.emplace_back(pixelIndex); }
-	
-	std::for_each(std::execution::par, pixelIndices.begin(), pixelIndices.end(), [&](int i) {
-		RenderPixel(pScene, i, m_FOV, m_AspectRatio, cameraToWorld, camera.origin);
+	//tiles hold whole packets, so a packet never gets rendered by two threads
+	const uint32_t tilesPerRow{ (m_Width + m_TileSize - 1) / m_TileSize };
+	const uint32_t ammountOfTiles{ tilesPerRow * ((m_Height + m_TileSize - 1) / m_TileSize) };
+	const uint32_t packetsPerRow{ uint32_t((m_Width + PACKET_WIDTH - 1) / PACKET_WIDTH) };
+
+	m_pThreadPool->ParallelFor(ammountOfTiles, [&](uint32_t tileIndex) {
+		const uint32_t firstX{ (tileIndex % tilesPerRow) * m_TileSize }, firstY{ (tileIndex / tilesPerRow) * m_TileSize };
+		const uint32_t endX{ std::min(firstX + m_TileSize, uint32_t(m_Width)) }, endY{ std::min(firstY + m_TileSize, uint32_t(m_Height)) };
+
+#ifdef PACKET_TRACING
+		for (uint32_t y{ firstY }; y < endY; y += PACKET_HEIGHT)
+		{
+			for (uint32_t x{ firstX }; x < endX; x += PACKET_WIDTH)
+			{
+				kernels.renderPacket(*this, pScene, (y / PACKET_HEIGHT) * packetsPerRow + x / PACKET_WIDTH, m_FOV, m_AspectRatio, cameraToWorld, camera.origin);
+			}
+		}
+#else
+		for (uint32_t y{ firstY }; y < endY; ++y)
+		{
+			for (uint32_t x{ firstX }; x < endX; ++x)
+			{
+				kernels.renderPixel(*this, pScene, y * m_Width + x, m_FOV, m_AspectRatio, cameraToWorld, camera.origin);
+			}
+		}
+#endif
 		});
 
+#elif defined(PACKET_TRACING)
+	const uint32_t ammountOfPackets{ GetPacketCount() };
+	for (uint32_t packetIndex{}; packetIndex < ammountOfPackets; ++packetIndex)
+	{
+		kernels.renderPacket(*this, pScene, packetIndex, m_FOV, m_AspectRatio, cameraToWorld, camera.origin);
+	}
+
 #else
 	//sync
+	const uint32_t ammountOfPixels{ uint32_t(m_Width * m_Height) };
 	for (uint32_t pixelIndex{}; pixelIndex < ammountOfPixels; ++pixelIndex)
 	{
-		RenderPixel(pScene, pixelIndex, m_FOV, m_AspectRatio, cameraToWorld, camera.origin);
+		kernels.renderPixel(*this, pScene, pixelIndex, m_FOV, m_AspectRatio, cameraToWorld, camera.origin);
 	}
 #endif
+}
 
-	//@END
-	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+void Renderer::Upscale(uint32_t* pTargetPixels, int targetWidth, int targetHeight) const
+{
+	//8 bit weights on two channels at once, a channel times 256 still fits the 16 bits it gets
+	const auto lerp = [](uint32_t a, uint32_t b, uint32_t weight)
+		{
+			const uint32_t redBlue{ (((a & 0x00FF00FF) * (256 - weight) + (b & 0x00FF00FF) * weight) >> 8) & 0x00FF00FF };
+			const uint32_t greenAlpha{ (((a >> 8) & 0x00FF00FF) * (256 - weight) + ((b >> 8) & 0x00FF00FF) * weight) & 0xFF00FF00 };
+			return redBlue | greenAlpha;
+		};
+
+	//pixel centers line up, anything past the last source pixel clamps to it. The scaled size is at least one packet, so
+	//there are always two pixels to blend on both axes
+	const float stepX{ float(m_Width) / targetWidth }, stepY{ float(m_Height) / targetHeight };
+	const auto getSample = [](float position, int size, int& first, uint32_t& weight)
+		{
+			const float clamped{ std::clamp(position, 0.f, float(size - 1)) };
+			first = std::min(int(clamped), size - 2);
+			weight = uint32_t((clamped - first) * 256.f + .5f);
+		};
+
+	m_pThreadPool->ParallelFor(uint32_t(targetHeight), [&](uint32_t y) {
+		int sourceY{};
+		uint32_t weightY{};
+		getSample((y + .5f) * stepY - .5f, m_Height, sourceY, weightY);
+		const uint32_t* pRow0{ m_pBufferPixels + sourceY * m_Width };
+		const uint32_t* pRow1{ pRow0 + m_Width };
+
+		uint32_t* pTarget{ pTargetPixels + y * targetWidth };
+		for (int x{}; x < targetWidth; ++x)
+		{
+			int sourceX{};
+			uint32_t weightX{};
+			getSample((x + .5f) * stepX - .5f, m_Width, sourceX, weightX);
+			pTarget[x] = lerp(lerp(pRow0[sourceX], pRow0[sourceX + 1], weightX), lerp(pRow1[sourceX], pRow1[sourceX + 1], weightX), weightY);
+		}
+		});
 }
 
 bool Renderer::SaveBufferToImage() const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return SDL_SaveBMP(m_pBuffer, SCREENSHOT_PATH);
 }
 
-void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const
+void Renderer::SetRenderTarget(SDL_Surface* pTarget)
 {
-	const std::vector<Material*>& materials{ pScene->GetMaterials() };
-
-	const uint32_t px{ pixelIndex % m_Width }, py{ pixelIndex / m_Width };
-
-	const float rx{ px + 0.5f }, ry{ py + 0.5f };
-	const float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov };
-	const float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
-
-	const Vector3 rayDirection = { cx,cy,1.0 };
-
-	const Ray viewRay = { cameraOrigin,cameraToWorld.TransformVector(rayDirection).Normalized() };
-
-	HitRecord closestHit{};
-	pScene->GetClosestHit(viewRay, closestHit);
-
-	ColorRGB finalColor{};
+	m_bRenderToWindow = !pTarget;
+	m_pBuffer = pTarget ? pTarget : SDL_GetWindowSurface(m_pWindow);
+	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+}
 
+void Renderer::PrintPrimaryRayThroughput(Scene* pScene) const
+{
+	Camera& camera = pScene->GetCamera();
+	const Transform cameraToWorld = camera.CalculateCameraToWorld();
+	const uint32_t ammountOfPixels{ uint32_t(m_Width * m_Height) };
 
-	if (closestHit.didHit)
+	//single threaded, so the numbers compare the tracing and not the scheduling. Hits are counted so nothing gets thrown away
+	uint32_t singleHits{};
+	const auto singleStart = std::chrono::steady_clock::now();
+	for (uint32_t pixelIndex{}; pixelIndex < ammountOfPixels; ++pixelIndex)
 	{
-		for (const Light& light : pScene->GetLights())
-		{
-
-			Vector3 LightDirection = LightUtils::GetDirectionToLight(light, closestHit.origin);
-			const float normalizedDistance = LightDirection.Normalize();
-			const Ray lightRay{ closestHit.origin + closestHit.normal * 0.0005f, LightDirection, 0.0001f, normalizedDistance };
-
-
-			ColorRGB Radiance{ 1,1,1 };
-			float observedArea{ 1 };
-			ColorRGB BRDF{ 1,1,1 };
-
-			float shadowFactor = 1.0f;
-
-#ifdef SOFT_SHADOWS
+		HitRecord closestHit{};
+		pScene->GetClosestHit(GeneratePrimaryRay(pixelIndex % m_Width, pixelIndex / m_Width, m_FOV, m_AspectRatio, cameraToWorld, camera.origin), closestHit);
+		singleHits += closestHit.didHit;
+	}
+	const auto singleEnd = std::chrono::steady_clock::now();
 
-			const float lightRadius = .1f;
-			const int numShadowSamples = 3;
+	uint32_t packetHits{};
+	const uint32_t ammountOfPackets{ GetPacketCount() };
+	for (uint32_t packetIndex{}; packetIndex < ammountOfPackets; ++packetIndex)
+	{
+		RayPacket8 packet{};
+		HitRecord closestHits[RayPacket8::WIDTH]{};
+		GetSimdKernels().generatePrimaryRays(*this, packetIndex, m_FOV, m_AspectRatio, cameraToWorld, camera.origin, packet);
+		pScene->GetClosestHits(packet, closestHits);
+		for (const HitRecord& closestHit : closestHits) packetHits += closestHit.didHit;
+	}
+	const auto packetEnd = std::chrono::steady_clock::now();
 
-			for (int i = 0; i < numShadowSamples; ++i)
-			{
-				Vector3 randomizedLightPosition = LightUtils::GetRandomPointNearLight(light, lightRadius);
+	const auto getMegaRays = [&](auto start, auto end) { return ammountOfPixels / std::chrono::duration<double, std::micro>(end - start).count(); };
+	std::cout << "Primary rays: " << getMegaRays(singleStart, singleEnd) << " Mrays/s single (" << singleHits << " hits), "
+		<< getMegaRays(singleEnd, packetEnd) << " Mrays/s packets of " << RayPacket8::WIDTH << " (" << packetHits << " hits)" << std::endl;
+}
 
-				Vector3 lightDirection = (randomizedLightPosition - closestHit.origin).Normalized();
-				float distanceToLight = (randomizedLightPosition - closestHit.origin).Magnitude();
-				Ray lightRay(closestHit.origin + closestHit.normal * 0.0005f, lightDirection, 0.0001f, distanceToLight);
+void Renderer::SetTargetFrameTime(float targetFrameTime)
+{
+	m_ResolutionController.SetTargetFrameTime(targetFrameTime);
 
-				if (!pScene->DoesHit(lightRay))
-				{
-					shadowFactor += 1.0f;
-				}
-			}
-			shadowFactor /= numShadowSamples;
+	//allocated once at full size, every scale after that fits
+	if (targetFrameTime > 0.f) m_ScaledPixels.resize(size_t(m_Width) * m_Height);
+}
 
-#endif // SOFT_SHADOWS
+void Renderer::SetThreadCount(uint32_t threadCount)
+{
+	m_pThreadPool = std::make_unique<ThreadPool>(threadCount);
+}
 
+uint32_t Renderer::GetThreadCount() const
+{
+	return m_pThreadPool->GetThreadCount();
+}
 
+void Renderer::SetTileSize(uint32_t tileSize)
+{
+	constexpr uint32_t tileAlignment{ uint32_t(std::lcm(PACKET_WIDTH, PACKET_HEIGHT)) };
+	m_TileSize = std::max((tileSize + tileAlignment - 1) / tileAlignment * tileAlignment, tileAlignment);
+}
 
-			switch (pScene->m_CurrentLightingMode)
-			{
-			case LightingMode::ObservedArea:
-				observedArea = Vector3::Dot(closestHit.normal, LightDirection);
-
-				break;
-			case LightingMode::Radiance:
-				Radiance = LightUtils::GetRadiance(light, closestHit.origin);
-				break;
-			case LightingMode::BRDF:
-				BRDF = materials[closestHit.materialIndex]->Shade(closestHit, LightDirection, -viewRay.direction);
-				break;
-			case LightingMode::Combined:
-				BRDF = materials[closestHit.materialIndex]->Shade(closestHit, LightDirection, -viewRay.direction);
-				Radiance = LightUtils::GetRadiance(light, closestHit.origin);
-				observedArea = Vector3::Dot(closestHit.normal, LightDirection);
-				break;
-			default:
-				break;
-			}
+uint32_t Renderer::GetPacketCount() const
+{
+	return uint32_t(((m_Width + PACKET_WIDTH - 1) / PACKET_WIDTH) * ((m_Height + PACKET_HEIGHT - 1) / PACKET_HEIGHT));
+}
 
-			if (observedArea < 0)
-			{
-				continue;
-			}
+Ray Renderer::GeneratePrimaryRay(uint32_t px, uint32_t py, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin) const
+{
+	const float rx{ px + 0.5f }, ry{ py + 0.5f };
+	const float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov };
+	const float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
 
-#ifdef SOFT_SHADOWS
-			finalColor += Radiance * observedArea * BRDF * shadowFactor;
-#else
-			if (pScene->DoesHit(lightRay) && pScene->m_bShadowEnabled)
-			{
-				finalColor *= 1.f;
-			}
-			else
-			{
-				finalColor += Radiance * observedArea * BRDF;
-			}
-#endif // _DEBUG
-			
+	const Vector3 rayDirection = { cx,cy,1.0 };
 
-		}
+	return Ray{ cameraOrigin,cameraToWorld.TransformVector(rayDirection).Normalized() };
+}
 
-	}
-	
-	//Update Color in Buffer
-	finalColor.MaxToOne();
-
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+void Renderer::RenderPacket(Scene* pScene, uint32_t packetIndex, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin) const
+{
+	GetSimdKernels().renderPacket(*this, pScene, packetIndex, fov, aspectRatio, cameraToWorld, cameraOrigin);
 }
 
+void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin) const
+{
+	GetSimdKernels().renderPixel(*this, pScene, pixelIndex, fov, aspectRatio, cameraToWorld, cameraOrigin);
+}
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <cfloat>
+#include <cmath>
 #include <cstdint>
+#include <memory>
+#include <vector>
 
+#include "SimdDispatch.h"
+#include "ResolutionController.h"
+#include "ColorRGB.h"
 
 
 struct SDL_Window;
@@ -10,31 +17,152 @@ struct SDL_Surface;
 namespace dae
 {
 	class Scene;
+	class ThreadPool;
+
+	//Every shaded sample of one pixel since the accumulation last restarted, with the running variance of their luminance
+	struct PixelSamples
+	{
+		ColorRGB sum{};
+		float luminanceSum{};
+		float luminanceSquaredSum{};
+		uint32_t count{};
+
+		void Add(const ColorRGB& color)
+		{
+			const float luminance{ color.r * .2126f + color.g * .7152f + color.b * .0722f };
+			sum += color;
+			luminanceSum += luminance;
+			luminanceSquaredSum += luminance * luminance;
+			++count;
+		}
+
+		ColorRGB GetMean() const { return sum * (1.f / count); }
+
+		//Standard error of the mean luminance, how far the shown color is likely off from the converged one
+		float GetError() const
+		{
+			if (count < 2) return FLT_MAX;
+
+			const float mean{ luminanceSum / count };
+			const float variance{ std::max(luminanceSquaredSum / count - mean * mean, 0.f) * count / (count - 1) };
+			return std::sqrt(variance / count);
+		}
+
+		//Four passes are only 12 shadow rays per light, a penumbra pixel with 1 in 10 rays occluded has them all agree
+		//28% of the time. After 16 passes (48 rays) that drops to under 1%, so a pixel is not frozen on a lucky history
+		bool IsConverged(float errorThreshold) const { return count >= MIN_SAMPLES && GetError() < errorThreshold; }
+
+		static constexpr uint32_t MIN_SAMPLES{ 16 };
+	};
 
 	class Renderer final
 	{
+		//pixel generation, shading and the buffer writes are compiled once per SIMD level in SimdKernels.cpp
+		template<SimdLevel Level>
+		friend struct SimdKernels;
+
 	public:
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const struct Matrix& cameraToWorld, const struct Vector3& cameraOrigin) const;
+		//Not const, with a target frame time set it renders at the resolution the controller picked for this frame
+		void Render(Scene* pScene);
+		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const struct Transform& cameraToWorld, const struct Vector3& cameraOrigin) const;
+
+		//Renders one block of PACKET_WIDTH x PACKET_HEIGHT pixels, the primary rays are traced together as one packet
+		void RenderPacket(Scene* pScene, uint32_t packetIndex, float fov, float aspectRatio, const struct Transform& cameraToWorld, const struct Vector3& cameraOrigin) const;
 		bool SaveBufferToImage() const;
 
+		//Frames after this are rendered into pTarget instead of the window surface, nullptr switches back. pTarget needs the
+		//size and pixel format of the window surface. Only the window surface gets presented at the end of Render
+		void SetRenderTarget(SDL_Surface* pTarget);
+
+		//Traces the primary rays of one frame without shading, once per ray and once per packet, and prints both rates
+		void PrintPrimaryRayThroughput(Scene* pScene) const;
+
+		//0 uses every hardware thread, restarts the workers so only call it between frames
+		void SetThreadCount(uint32_t threadCount);
+		uint32_t GetThreadCount() const;
+
+		//Square tiles of tileSize pixels are the work items of the thread pool, rounded up to whole packets
+		void SetTileSize(uint32_t tileSize);
+		uint32_t GetTileSize() const { return m_TileSize; }
+
+		/**
+		 * \brief Dynamic resolution: frames are traced at a smaller size picked from the measured render times and stretched
+		 * (bilinear) over the target, so Render keeps taking about targetFrameTime milliseconds. 0 renders at full size again
+		 */
+		void SetTargetFrameTime(float targetFrameTime);
+		float GetTargetFrameTime() const { return m_ResolutionController.GetTargetFrameTime(); }
+		//Per axis, 1 while the full window is traced
+		float GetResolutionScale() const { return m_ResolutionController.GetScale(); }
+
+		/**
+		 * \brief Progressive accumulation: while the camera, the scene (Scene::HasChanged), the lighting settings and the
+		 * resolution stay the same, every frame adds a new set of shadow samples to a float buffer and its mean is shown
+		 */
+		void SetAccumulation(bool bAccumulate) { m_bAccumulate = bAccumulate; }
+		bool IsAccumulating() const { return m_bAccumulate; }
+		//Frames averaged into the last image, 1 right after a change
+		uint32_t GetAccumulatedFrames() const { return m_AccumulatedFrames; }
+
+		/**
+		 * \brief Adaptive sampling on top of the accumulation: pixels whose error (PixelSamples::GetError) is above errorThreshold
+		 * get up to MAX_SAMPLE_SETS shading passes per frame, pixels below it after MIN_ADAPTIVE_SAMPLES keep their mean and are
+		 * not traced again until the accumulation restarts. 0 shades every pixel once per frame
+		 */
+		void SetAdaptiveThreshold(float errorThreshold) { m_AdaptiveThreshold = errorThreshold; }
+		float GetAdaptiveThreshold() const { return m_AdaptiveThreshold; }
+
+		static constexpr int PACKET_WIDTH{ 4 };
+		static constexpr int PACKET_HEIGHT{ 2 };
+		static constexpr uint32_t DEFAULT_TILE_SIZE{ 32 };
+
+		static constexpr const char* SCREENSHOT_PATH{ "RayTracing_Buffer.bmp" };
+
+		//about half a step of an 8 bit channel
+		static constexpr float DEFAULT_ADAPTIVE_THRESHOLD{ .002f };
+		static constexpr uint32_t MIN_ADAPTIVE_SAMPLES{ PixelSamples::MIN_SAMPLES };
+		static constexpr uint32_t MAX_SAMPLE_SETS{ 4 };
+
 
 	private:
+		void RenderImage(Scene* pScene) const;
+		//Bilinear stretch of the m_Width x m_Height image in m_pBufferPixels over the whole target
+		void Upscale(uint32_t* pTargetPixels, int targetWidth, int targetHeight) const;
+
+		struct Ray GeneratePrimaryRay(uint32_t px, uint32_t py, float fov, float aspectRatio, const struct Transform& cameraToWorld, const struct Vector3& cameraOrigin) const;
+		uint32_t GetPacketCount() const;
+
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pBuffer{};
-		
+		bool m_bRenderToWindow{ true };
 		
 		uint32_t* m_pBufferPixels{};
 
+		//created once, Render only hands it the tiles of a frame
+		std::unique_ptr<ThreadPool> m_pThreadPool{};
+		uint32_t m_TileSize{ DEFAULT_TILE_SIZE };
+
+		//m_Width and m_Height shrink to the scaled size during a scaled Render, which traces into m_ScaledPixels
+		ResolutionController m_ResolutionController{};
+		std::vector<uint32_t> m_ScaledPixels{};
+
+		//samples of every frame since the last restart, with the stride of the current render size
+		std::unique_ptr<PixelSamples[]> m_pPixelSamples{};
+		float m_AdaptiveThreshold{ DEFAULT_ADAPTIVE_THRESHOLD };
+		uint32_t m_AccumulatedFrames{};
+		bool m_bAccumulate{ true };
+		//what the accumulated frames were rendered with, any difference restarts it
+		int m_AccumulatedLightingMode{ -1 };
+		bool m_bAccumulatedShadows{};
+		float m_AccumulatedScale{};
 
 
 		int m_Width{};
@@ -0,0 +1,50 @@
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace dae;
+
+namespace
+{
+	//share of a new measurement in the filtered frame time
+	constexpr float SMOOTHING{ .3f };
+	//no change while the frame time is this close to the target, or the scale would flicker around it
+	constexpr float DEAD_BAND{ .05f };
+	//going down fast keeps the camera interactive when a heavy view appears, going up slowly avoids overshooting
+	constexpr float MAX_DECREASE{ .7f };
+	constexpr float MAX_INCREASE{ 1.1f };
+}
+
+ResolutionController::ResolutionController(float targetFrameTime, float minScale) :
+	m_TargetFrameTime{ targetFrameTime },
+	m_MinScale{ std::clamp(minScale, .01f, 1.f) }
+{
+}
+
+void ResolutionController::SetTargetFrameTime(float targetFrameTime)
+{
+	m_TargetFrameTime = targetFrameTime;
+	m_SmoothedFrameTime = 0.f;
+	if (m_TargetFrameTime <= 0.f) m_Scale = 1.f;
+}
+
+float ResolutionController::Update(float frameTime)
+{
+	if (m_TargetFrameTime <= 0.f || frameTime <= 0.f) return m_Scale;
+
+	m_SmoothedFrameTime = m_SmoothedFrameTime > 0.f ? m_SmoothedFrameTime + (frameTime - m_SmoothedFrameTime) * SMOOTHING : frameTime;
+
+	const float ratio{ m_TargetFrameTime / m_SmoothedFrameTime };
+	if (std::abs(ratio - 1.f) < DEAD_BAND) return m_Scale;
+
+	const float oldScale{ m_Scale };
+	m_Scale = std::clamp(m_Scale * std::sqrt(ratio), m_Scale * MAX_DECREASE, m_Scale * MAX_INCREASE);
+	m_Scale = std::clamp(m_Scale, m_MinScale, 1.f);
+
+	//what the filtered time would have been at the new scale, otherwise the filter keeps pushing after the jump
+	const float areaRatio{ (m_Scale / oldScale) * (m_Scale / oldScale) };
+	m_SmoothedFrameTime *= areaRatio;
+
+	return m_Scale;
+}
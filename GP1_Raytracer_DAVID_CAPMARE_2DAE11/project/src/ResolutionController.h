@@ -0,0 +1,32 @@
+#pragma once
+
+namespace dae
+{
+	/**
+	 * \brief Picks the render resolution scale (per axis, 1 is the full window) that keeps the measured frame time at the target.
+	 * The cost of a frame is taken to grow with its pixel count, so the scale moves with the square root of target / measured
+	 */
+	class ResolutionController final
+	{
+	public:
+		//0 milliseconds turns the scaling off, the scale then stays at 1
+		explicit ResolutionController(float targetFrameTime = 0.f, float minScale = MIN_SCALE);
+
+		void SetTargetFrameTime(float targetFrameTime);
+		float GetTargetFrameTime() const { return m_TargetFrameTime; }
+
+		//Feeds the milliseconds the last frame took at the current scale, returns the scale for the next frame
+		float Update(float frameTime);
+		float GetScale() const { return m_Scale; }
+
+		static constexpr float MIN_SCALE{ .25f };
+
+	private:
+		float m_TargetFrameTime{};
+		float m_MinScale{};
+
+		float m_Scale{ 1.f };
+		//filtered frame time, so one slow frame does not make the image jump
+		float m_SmoothedFrameTime{};
+	};
+}
@@ -28,66 +28,143 @@ namespace dae {
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
-		//todo W1
-		HitRecord tempHit{};
-
-		for (const Sphere& spheres : m_SphereGeometries)
-		{	
-			GeometryUtils::HitTest_Sphere(spheres,ray, tempHit);
-			closestHit = tempHit.t < closestHit.t ? tempHit : closestHit;
-			
+		GetSimdKernels().getClosestHit(*this, ray, closestHit);
+	}
+
+	void Scene::GetClosestHits(RayPacket8& packet, HitRecord* closestHits) const
+	{
+		GetSimdKernels().getClosestHits(*this, packet, closestHits);
+	}
+
+	bool Scene::DoesHit(const Ray& ray) const
+	{
+		ShadowOccluder occluder{};
+		return DoesHit(ray, occluder);
+	}
+
+	bool Scene::DoesHit(const Ray& ray, ShadowOccluder& lastOccluder) const
+	{
+		return GetSimdKernels().doesHit(*this, ray, lastOccluder);
+	}
+
+#pragma region Acceleration Structure
+	void Scene::BuildAccelerationStructure()
+	{
+		UpdatePrimitivePackets();
+
+		m_Objects.clear();
+		m_Objects.reserve(GetTopLevelObjectCount());
+
+		for (uint32_t idx{}; idx < m_SphereGeometries.size() && m_bSpheresInTopLevelBVH; ++idx)
+		{
+			m_Objects.push_back({ SceneObjectType::Sphere, idx });
 		}
-		
-		for (const Plane& planes : m_PlaneGeometries)
+		for (uint32_t idx{}; idx < m_Triangles.size(); ++idx)
 		{
-			GeometryUtils::HitTest_Plane(planes, ray, tempHit);
-			closestHit = tempHit.t < closestHit.t ? tempHit : closestHit;
+			m_Objects.push_back({ SceneObjectType::Triangle, idx });
 		}
-		for (const TriangleMesh& Meshes : m_TriangleMeshGeometries)
+		for (uint32_t idx{}; idx < m_TriangleMeshGeometries.size(); ++idx)
 		{
-			GeometryUtils::HitTest_TriangleMesh(Meshes, ray, tempHit);
-			closestHit = tempHit.t < closestHit.t ? tempHit : closestHit;
+			m_Objects.push_back({ SceneObjectType::TriangleMesh, idx });
 		}
-		//throw std::runtime_error("Not Implemented Yet");
+
+		UpdateObjectBounds();
+		m_TopLevelBVH.Build(m_ObjectBounds);
 	}
 
-	bool Scene::DoesHit(const Ray& ray) const
+	void Scene::RefitAccelerationStructure()
 	{
-		//todo W2
-		for (const Sphere& spheres : m_SphereGeometries)
+		if (m_Objects.size() != GetTopLevelObjectCount())
 		{
-			 if (GeometryUtils::HitTest_Sphere(spheres, ray))
-			 {
-				return true;
-			 }
-			 
+			BuildAccelerationStructure();
+			return;
 		}
 
-		for (const Plane& planes : m_PlaneGeometries)
+		UpdatePrimitivePackets();
+		UpdateObjectBounds();
+		m_TopLevelBVH.Refit(m_ObjectBounds);
+
+		//objects drifted too far from where the tree was built for, a rebuild is cheaper than tracing through it
+		if (m_TopLevelBVH.GetCostRatio() > BVH::REBUILD_COST_RATIO)
 		{
-			if (GeometryUtils::HitTest_Plane(planes, ray))
-			{
-				return true;
-			}
+			m_TopLevelBVH.Build(m_ObjectBounds);
 		}
-		for (const Triangle& triangles : m_Triangles)
-		{
-			if (GeometryUtils::HitTest_Triangle(triangles,ray))
+	}
+
+	void Scene::PrintAccelerationStructureInfo() const
+	{
+		const auto getFormatName = [](BVHNodeFormat format)
 			{
-				return true;
-			}
+				switch (format)
+				{
+				case BVHNodeFormat::Quantized16: return "16 bit";
+				case BVHNodeFormat::Quantized8: return "8 bit";
+				default: return "full";
+				}
+			};
+
+		for (size_t meshIdx{}; meshIdx < m_TriangleMeshGeometries.size(); ++meshIdx)
+		{
+			const BVH& bvh = m_TriangleMeshGeometries[meshIdx].bvh;
+			std::cout << "Mesh " << meshIdx << ": " << m_TriangleMeshGeometries[meshIdx].indices.size() / 3 << " triangles, "
+				<< getFormatName(bvh.GetNodeFormat()) << " nodes, " << bvh.GetTraversalByteSize() << " bytes traced, "
+				<< bvh.GetByteSize() << " bytes total" << std::endl;
 		}
 
-		for (const TriangleMesh& Meshes : m_TriangleMeshGeometries)
+		std::cout << "Top level: " << m_Objects.size() << " objects, " << getFormatName(m_TopLevelBVH.GetNodeFormat()) << " nodes, "
+			<< m_TopLevelBVH.GetTraversalByteSize() << " bytes traced, " << m_TopLevelBVH.GetByteSize() << " bytes total" << std::endl;
+	}
+
+	size_t Scene::GetTopLevelObjectCount() const
+	{
+		return (m_bSpheresInTopLevelBVH ? m_SphereGeometries.size() : 0) + m_Triangles.size() + m_TriangleMeshGeometries.size();
+	}
+
+	void Scene::UpdatePrimitivePackets()
+	{
+		BuildPrimitivePackets(m_SphereGeometries, m_SpherePackets);
+		BuildPrimitivePackets(m_PlaneGeometries, m_PlanePackets);
+	}
+
+	void Scene::UpdateObjectBounds()
+	{
+		m_ObjectBounds.resize(m_Objects.size());
+
+		for (size_t objectIdx{}; objectIdx < m_Objects.size(); ++objectIdx)
 		{
-			if (GeometryUtils::HitTest_TriangleMesh(Meshes, ray))
+			const SceneObject& object = m_Objects[objectIdx];
+			AABB& bounds = m_ObjectBounds[objectIdx];
+
+			switch (object.type)
 			{
-				return true;
+			case SceneObjectType::Sphere:
+			{
+				const Sphere& sphere = m_SphereGeometries[object.index];
+				const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+				bounds = { sphere.origin - extent, sphere.origin + extent };
+				break;
+			}
+			case SceneObjectType::Triangle:
+			{
+				const Triangle& triangle = m_Triangles[object.index];
+				bounds = {};
+				bounds.Grow(triangle.v0);
+				bounds.Grow(triangle.v1);
+				bounds.Grow(triangle.v2);
+				break;
+			}
+			case SceneObjectType::TriangleMesh:
+			{
+				const TriangleMesh& mesh = m_TriangleMeshGeometries[object.index];
+				bounds = { mesh.transformedMinAABB, mesh.transformedMaxAABB };
+				break;
+			}
+			case SceneObjectType::Plane:
+				break;
 			}
 		}
-
-		return false;
 	}
+#pragma endregion
 
 #pragma region Scene Helpers
 	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
@@ -289,18 +366,21 @@ namespace dae {
 		
 		TriangleMesh* pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLamber_White);
 		pMesh->AppendTriangle(baseTriangle, true);
+		pMesh->UpdateGeometry();
 		pMesh->Translate({ -1.75f, 4.5f, 0.f });
 		pMesh->UpdateTransforms();
 		m_meshes.push_back(pMesh);
 		
 		pMesh = AddTriangleMesh(TriangleCullMode::FrontFaceCulling, matLamber_White);
 		pMesh->AppendTriangle(baseTriangle, true);
+		pMesh->UpdateGeometry();
 		pMesh->Translate({0.f, 4.5f, 0.f});
 		pMesh->UpdateTransforms();
 		m_meshes.push_back(pMesh);
 		
 		pMesh = AddTriangleMesh(TriangleCullMode::NoCulling, matLamber_White);
 		pMesh->AppendTriangle(baseTriangle, true);
+		pMesh->UpdateGeometry();
 		pMesh->Translate({1.75f, 4.5f, 0.f});
 		pMesh->UpdateTransforms();
 		m_meshes.push_back(pMesh);
@@ -313,6 +393,7 @@ namespace dae {
 	void Scene_W4::Update(Timer* pTimer)
 	{
 		Scene::Update(pTimer);
+		if (!m_bAnimate) return;
 
 		const float yawAngle{ ((cos(pTimer->GetTotal()) + 1.f) / 2.f * PI_2 * PI_2) };
 		
@@ -321,8 +402,10 @@ namespace dae {
 		{
 			m->RotateY(yawAngle);
 			m->UpdateTransforms();
-			m->UpdateAABB();
 		}
+
+		RefitAccelerationStructure();
+		m_bChanged = true;
 	}
 
 	void Scene_W4_Bunny::Initialize()
@@ -353,6 +436,9 @@ namespace dae {
 
 		m_mesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLamber_White);
 		Utils::ParseOBJ("resources/lowpoly_bunny.obj", m_mesh->positions, m_mesh->normals, m_mesh->indices);
+		m_mesh->bvhCacheDirectory = "cache";
+		m_mesh->UpdateGeometry();
+		m_mesh->UpdateTransforms();
 
 
 		AddPointLight({ .0f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f,.61f,.45f });
@@ -363,11 +449,16 @@ namespace dae {
 
 	void Scene_W4_Bunny::Update(Timer* pTimer)
 	{
+		//this scene never moves its camera, only the animation changes it
+		m_bChanged = m_bAnimate;
+		if (!m_bAnimate) return;
+
 		const float yawAngle{ ((cos(pTimer->GetTotal()) + 1.f) / 2.f * PI_2 * PI_2) };
 
 		m_mesh->RotateY(yawAngle);
 		m_mesh->UpdateTransforms();
-		m_mesh->UpdateAABB();
+
+		RefitAccelerationStructure();
 
 	}
 
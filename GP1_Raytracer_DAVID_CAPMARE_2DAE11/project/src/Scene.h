@@ -5,6 +5,7 @@
 #include "Maths.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "SimdDispatch.h"
 
 namespace dae
 {
@@ -15,6 +16,37 @@ namespace dae
 	struct Sphere;
 	struct Light;
 
+	enum class SceneObjectType : uint8_t
+	{
+		Sphere,
+		Triangle,
+		TriangleMesh,
+		Plane //never in the top level, planes are infinite
+	};
+
+	//Reference from a top-level leaf into one of the geometry containers
+	struct SceneObject
+	{
+		SceneObjectType type{};
+		uint32_t index{};
+	};
+
+	//Object that blocked the last shadow ray towards a light, tried before traversing for the next one
+	struct ShadowOccluder
+	{
+		SceneObject object{};
+		uint32_t triangleIdx{}; //within the mesh for mesh occluders
+		bool isValid{};
+	};
+
+	//What the closest hit search keeps per candidate, the HitRecord is only built for the final one
+	struct DeferredHit
+	{
+		float t{ FLT_MAX }; //stays FLT_MAX on a miss
+		SceneObject object{};
+		uint32_t triangleIdx{}; //within the mesh for mesh hits
+	};
+
 	enum class LightingMode
 	{
 		ObservedArea, //Lambert cosine
@@ -26,6 +58,10 @@ namespace dae
 	//Scene Base Class
 	class Scene
 	{
+		//the queries are compiled once per SIMD level in SimdKernels.cpp
+		template<SimdLevel Level>
+		friend struct SimdKernels;
+
 	public:
 		Scene();
 		virtual ~Scene();
@@ -38,13 +74,42 @@ namespace dae
 		virtual void Initialize() = 0;
 		virtual void Update(dae::Timer* pTimer)
 		{
-			m_Camera.Update(pTimer);
+			m_bChanged = m_Camera.Update(pTimer);
 		}
 
+		//Whether the last Update moved the camera or anything in the scene, the renderer restarts its accumulation then
+		bool HasChanged() const { return m_bChanged; }
+
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+
+		/**
+		 * \brief GetClosestHit for the active lanes of a coherent packet (primary rays), the top level and mesh hierarchies
+		 * are walked once for all of them. closestHits holds one record per lane, packet.max shrinks to the hits
+		 */
+		void GetClosestHits(RayPacket8& packet, HitRecord* closestHits) const;
 		bool DoesHit(const Ray& ray) const;
 
+		/**
+		 * \brief Any-hit query for shadow rays, stops at the first occluder and never fills a hit record.
+		 * lastOccluder is tested before anything else and replaced by the new occluder, keep one per light and thread
+		 */
+		bool DoesHit(const Ray& ray, ShadowOccluder& lastOccluder) const;
+
+		/**
+		 * \brief Builds the top-level hierarchy over all spheres, triangles and meshes, call after Initialize
+		 */
+		void BuildAccelerationStructure();
+
+		/**
+		 * \brief Refits the top-level hierarchy to the current object bounds, rebuilds it when objects were added.
+		 * Only the top level is touched, meshes keep their own hierarchy
+		 */
+		void RefitAccelerationStructure();
+
+		//Prints the triangle count, node format and bytes of every mesh hierarchy and of the top level
+		void PrintAccelerationStructureInfo() const;
+
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
@@ -52,6 +117,8 @@ namespace dae
 
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_bShadowEnabled{ true };
+		//Off freezes the animated scenes, so a still camera keeps refining the same image
+		bool m_bAnimate{ true };
 
 
 	protected:
@@ -65,7 +132,23 @@ namespace dae
 		std::vector<Triangle> m_Triangles{};
 
 		Camera m_Camera{};
+		bool m_bChanged{ true };
+
+		//Top-level hierarchy over every bounded object, planes are infinite and stay outside of it
+		BVH m_TopLevelBVH{};
+		std::vector<SceneObject> m_Objects{};
+		std::vector<AABB> m_ObjectBounds{};
+
+		//Planes, and spheres left out of the top level, are tested 8 at a time from these copies
+		std::vector<SpherePacket8> m_SpherePackets{};
+		std::vector<PlanePacket8> m_PlanePackets{};
+
+		//Clear before BuildAccelerationStructure to test the spheres as a flat list of packets instead
+		bool m_bSpheresInTopLevelBVH{ true };
 
+		void UpdateObjectBounds();
+		void UpdatePrimitivePackets();
+		size_t GetTopLevelObjectCount() const;
 
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
@@ -0,0 +1,139 @@
+#include "SimdDispatch.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace dae
+{
+	namespace
+	{
+		struct CpuidRegisters
+		{
+			uint32_t eax{}, ebx{}, ecx{}, edx{};
+		};
+
+		CpuidRegisters Cpuid(uint32_t leaf, uint32_t subLeaf = 0)
+		{
+			CpuidRegisters registers{};
+#ifdef _MSC_VER
+			int values[4]{};
+			__cpuidex(values, int(leaf), int(subLeaf));
+			registers = { uint32_t(values[0]), uint32_t(values[1]), uint32_t(values[2]), uint32_t(values[3]) };
+#else
+			__cpuid_count(leaf, subLeaf, registers.eax, registers.ebx, registers.ecx, registers.edx);
+#endif
+			return registers;
+		}
+
+		//Which register sets the OS saves on a context switch, the CPU flags alone are not enough to use them
+		uint64_t GetEnabledRegisterState()
+		{
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			uint32_t low{}, high{};
+			__asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+			return (uint64_t(high) << 32) | low;
+#endif
+		}
+
+		bool HasBit(uint32_t value, int bit)
+		{
+			return (value >> bit) & 1;
+		}
+
+		const SimdKernelTable& GetTable(SimdLevel level)
+		{
+			switch (level)
+			{
+			case SimdLevel::SSE41: return GetSimdKernelTable<SimdLevel::SSE41>();
+			case SimdLevel::AVX2: return GetSimdKernelTable<SimdLevel::AVX2>();
+			case SimdLevel::AVX512: return GetSimdKernelTable<SimdLevel::AVX512>();
+			default: return GetSimdKernelTable<SimdLevel::SSE2>();
+			}
+		}
+
+		struct ActiveKernels
+		{
+			SimdLevel level{ DetectSimdLevel() };
+			const SimdKernelTable* pTable{ &GetTable(level) };
+		};
+
+		ActiveKernels& GetActiveKernels()
+		{
+			static ActiveKernels activeKernels{};
+			return activeKernels;
+		}
+	}
+
+	SimdLevel DetectSimdLevel()
+	{
+		static const SimdLevel detectedLevel = []
+			{
+				const uint32_t maxLeaf{ Cpuid(0).eax };
+				const CpuidRegisters features{ Cpuid(1) };
+				const CpuidRegisters extendedFeatures{ maxLeaf >= 7 ? Cpuid(7) : CpuidRegisters{} };
+
+				if (!HasBit(features.ecx, 19)) return SimdLevel::SSE2;
+
+				//AVX state needs OSXSAVE and the OS saving the xmm and ymm halves
+				const bool osSavesYmm{ HasBit(features.ecx, 27) && (GetEnabledRegisterState() & 0x6) == 0x6 };
+				const bool hasAvx2{ osSavesYmm && HasBit(features.ecx, 28) && HasBit(features.ecx, 12) && HasBit(extendedFeatures.ebx, 5) };
+				if (!hasAvx2) return SimdLevel::SSE41;
+
+				//the mask registers and the upper zmm halves on top of that
+				const bool osSavesZmm{ (GetEnabledRegisterState() & 0xE6) == 0xE6 };
+				const bool hasAvx512{ osSavesZmm && HasBit(extendedFeatures.ebx, 16) && HasBit(extendedFeatures.ebx, 17)
+					&& HasBit(extendedFeatures.ebx, 30) && HasBit(extendedFeatures.ebx, 31) };
+				return hasAvx512 ? SimdLevel::AVX512 : SimdLevel::AVX2;
+			}();
+
+		return detectedLevel;
+	}
+
+	SimdLevel SetSimdLevel(SimdLevel level)
+	{
+		ActiveKernels& activeKernels = GetActiveKernels();
+		activeKernels.level = std::min(level, DetectSimdLevel());
+		activeKernels.pTable = &GetTable(activeKernels.level);
+		return activeKernels.level;
+	}
+
+	SimdLevel GetSimdLevel()
+	{
+		return GetActiveKernels().level;
+	}
+
+	const SimdKernelTable& GetSimdKernels()
+	{
+		return *GetActiveKernels().pTable;
+	}
+
+	const char* GetSimdLevelName(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SimdLevel::SSE41: return "sse4.1";
+		case SimdLevel::AVX2: return "avx2";
+		case SimdLevel::AVX512: return "avx512";
+		default: return "sse2";
+		}
+	}
+
+	bool ParseSimdLevel(std::string_view name, SimdLevel& level)
+	{
+		for (SimdLevel candidate : { SimdLevel::SSE2, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512 })
+		{
+			if (name != GetSimdLevelName(candidate)) continue;
+
+			level = candidate;
+			return true;
+		}
+		return false;
+	}
+}
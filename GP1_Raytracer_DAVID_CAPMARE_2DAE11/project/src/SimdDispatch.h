@@ -0,0 +1,82 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string_view>
+
+//The SIMD kernels (SimdKernels.cpp) are compiled once per level, CMake sets DAE_SIMD_LEVEL to the level of each copy.
+//Everything in Utils.h lives in a namespace per level so the copies never share an inline function
+#ifdef DAE_SIMD_LEVEL
+#define DAE_SIMD_CONCAT_(a, b) a##b
+#define DAE_SIMD_CONCAT(a, b) DAE_SIMD_CONCAT_(a, b)
+#define DAE_SIMD_NAMESPACE DAE_SIMD_CONCAT(Simd_, DAE_SIMD_LEVEL)
+#else
+#define DAE_SIMD_NAMESPACE Simd_Default
+#endif
+
+//MSVC has no /arch for SSE4.1 and never defines __SSE4_1__, CMake passes DAE_SIMD_SSE41 for that copy instead
+#if (defined(__SSE4_1__) || defined(__AVX__)) && !defined(DAE_SIMD_SSE41)
+#define DAE_SIMD_SSE41
+#endif
+
+namespace dae
+{
+	class Scene;
+	class Renderer;
+	struct Ray;
+	struct RayPacket8;
+	struct HitRecord;
+	struct ShadowOccluder;
+	struct Transform;
+	struct Vector3;
+
+	enum class SimdLevel : uint8_t
+	{
+		SSE2,
+		SSE41,
+		AVX2, //with FMA
+		AVX512 //F, DQ, BW and VL
+	};
+
+	//Entry points of one compiled copy of the kernels, the Scene and Renderer calls of the same name forward to these
+	struct SimdKernelTable
+	{
+		void (*getClosestHit)(const Scene& scene, const Ray& ray, HitRecord& closestHit);
+		void (*getClosestHits)(const Scene& scene, RayPacket8& packet, HitRecord* closestHits);
+		bool (*doesHit)(const Scene& scene, const Ray& ray, ShadowOccluder& lastOccluder);
+
+		void (*generatePrimaryRays)(const Renderer& renderer, uint32_t packetIndex, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin, RayPacket8& packet);
+		void (*renderPixel)(const Renderer& renderer, Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin);
+		void (*renderPacket)(const Renderer& renderer, Scene* pScene, uint32_t packetIndex, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin);
+	};
+
+	//Specialized once per level in SimdKernels.cpp, friend of the classes whose internals the kernels walk
+	template<SimdLevel Level>
+	struct SimdKernels;
+
+	template<SimdLevel Level>
+	const SimdKernelTable& GetSimdKernelTable();
+
+	template<> const SimdKernelTable& GetSimdKernelTable<SimdLevel::SSE2>();
+	template<> const SimdKernelTable& GetSimdKernelTable<SimdLevel::SSE41>();
+	template<> const SimdKernelTable& GetSimdKernelTable<SimdLevel::AVX2>();
+	template<> const SimdKernelTable& GetSimdKernelTable<SimdLevel::AVX512>();
+
+	//Highest level the CPU and the OS support, read once from CPUID
+	SimdLevel DetectSimdLevel();
+
+	/**
+	 * \brief Switches every following query and render call to the kernels of level. Levels above DetectSimdLevel are clamped
+	 * to it, so forcing one can never run instructions the CPU lacks. Returns the level that is now active
+	 */
+	SimdLevel SetSimdLevel(SimdLevel level);
+	SimdLevel GetSimdLevel();
+
+	//Starts out at DetectSimdLevel
+	const SimdKernelTable& GetSimdKernels();
+
+	const char* GetSimdLevelName(SimdLevel level);
+
+	//Accepts the names used on the command line: sse2, sse4.1, avx2 and avx512
+	bool ParseSimdLevel(std::string_view name, SimdLevel& level);
+}
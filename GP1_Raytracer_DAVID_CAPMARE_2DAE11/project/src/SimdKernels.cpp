@@ -0,0 +1,567 @@
+//Compiled once per SimdLevel, CMake sets DAE_SIMD_LEVEL and the matching instruction set flags for every copy.
+//Everything the renderer does per ray and per pixel lives here, SimdDispatch.cpp picks the copy at startup
+
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Project includes
+#include "SimdDispatch.h"
+#include "Renderer.h"
+#include "Maths.h"
+#include "Transform.h"
+#include "Material.h"
+#include "Scene.h"
+#include "Utils.h"
+
+#include <bit>
+
+#ifndef DAE_SIMD_LEVEL
+#error SimdKernels.cpp is compiled once per SimdLevel, define DAE_SIMD_LEVEL (see CMakeLists.txt)
+#endif
+
+#define SOFT_SHADOWS
+
+namespace dae
+{
+	inline namespace DAE_SIMD_NAMESPACE
+	{
+		//A type of this level only, so the thread_local std::vector of ShadePixel is never shared with another copy of the kernels
+		struct CachedOccluder : ShadowOccluder
+		{
+		};
+	}
+
+	template<>
+	struct SimdKernels<SimdLevel::DAE_SIMD_LEVEL>
+	{
+#pragma region Scene Queries
+		//The searches below only carry t and what was hit, origin, normal and material are filled in once at the end
+		static void GetClosestHit(const Scene& scene, const Ray& ray, HitRecord& closestHit)
+		{
+			DeferredHit closest{};
+			FindClosestHit(scene, ray, closest);
+			if (closest.t < FLT_MAX) closestHit = GetHitRecord(scene, ray, closest);
+		}
+
+		static void FindClosestHit(const Scene& scene, const Ray& ray, DeferredHit& closest)
+		{
+			//todo W1
+			HitTest_Planes(scene, ray, closest);
+			if (!scene.m_bSpheresInTopLevelBVH) HitTest_FlatSpheres(scene, ray, closest);
+
+			//everything behind the closest plane is culled by the top-level traversal
+			Ray traversalRay{ ray };
+			traversalRay.max = std::min(ray.max, closest.t);
+
+			GeometryUtils::Traverse_BVH(scene.m_TopLevelBVH, traversalRay, [&](uint32_t objectIdx, Ray& currentRay)
+				{
+					if (HitTest_Object(scene, scene.m_Objects[objectIdx], currentRay, closest)) currentRay.max = closest.t;
+					return false;
+				});
+		}
+
+		static void GetClosestHits(const Scene& scene, RayPacket8& packet, HitRecord* closestHits)
+		{
+			DeferredHit closest[RayPacket8::WIDTH]{};
+			const uint32_t activeMask{ packet.activeMask };
+
+			//planes and flat spheres stay per lane, their hits cull the traversal like in GetClosestHit
+			for (uint32_t lanes{ activeMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane = std::countr_zero(lanes);
+				const Ray ray{ packet.GetRay(lane) };
+				HitTest_Planes(scene, ray, closest[lane]);
+				if (!scene.m_bSpheresInTopLevelBVH) HitTest_FlatSpheres(scene, ray, closest[lane]);
+				packet.max[lane] = std::min(packet.max[lane], closest[lane].t);
+			}
+
+			GeometryUtils::Traverse_BVHPacket(scene.m_TopLevelBVH, packet, [&](uint32_t objectIdx, uint32_t laneMask, RayPacket8& currentPacket)
+				{
+					const SceneObject& object = scene.m_Objects[objectIdx];
+					if (object.type == SceneObjectType::TriangleMesh)
+					{
+						uint32_t triangleIndices[RayPacket8::WIDTH];
+						for (uint32_t hitMask{ GeometryUtils::HitTest_TriangleMesh(scene.m_TriangleMeshGeometries[object.index], currentPacket, laneMask, triangleIndices) }; hitMask; hitMask &= hitMask - 1)
+						{
+							const int lane = std::countr_zero(hitMask);
+							closest[lane] = { currentPacket.max[lane], object, triangleIndices[lane] };
+						}
+						return;
+					}
+
+					for (; laneMask; laneMask &= laneMask - 1)
+					{
+						const int lane = std::countr_zero(laneMask);
+						if (HitTest_Object(scene, object, currentPacket.GetRay(lane), closest[lane])) currentPacket.max[lane] = closest[lane].t;
+					}
+				});
+
+			for (uint32_t lanes{ activeMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane = std::countr_zero(lanes);
+				if (closest[lane].t < FLT_MAX) closestHits[lane] = GetHitRecord(scene, packet.GetRay(lane), closest[lane]);
+			}
+		}
+
+		static bool DoesHit(const Scene& scene, const Ray& ray, ShadowOccluder& lastOccluder)
+		{
+			//neighbouring shadow rays towards the same light are mostly blocked by the same triangle or sphere
+			if (lastOccluder.isValid && HitTest_CachedOccluder(scene, lastOccluder, ray)) return true;
+
+			//todo W2
+			if (GeometryUtils::HitTest_PlanePackets(scene.m_PlanePackets, ray)) return true;
+
+			uint32_t sphereIdx{};
+			if (!scene.m_bSpheresInTopLevelBVH && GeometryUtils::HitTest_SpherePackets(scene.m_SpherePackets, ray, sphereIdx))
+			{
+				lastOccluder = { { SceneObjectType::Sphere, sphereIdx }, 0, true };
+				return true;
+			}
+
+			bool didHit{ false };
+			Ray traversalRay{ ray };
+
+			GeometryUtils::Traverse_BVH(scene.m_TopLevelBVH, traversalRay, [&](uint32_t objectIdx, Ray& currentRay)
+				{
+					uint32_t triangleIdx{};
+					if (!HitTest_Occluder(scene, scene.m_Objects[objectIdx], currentRay, triangleIdx)) return false;
+
+					lastOccluder = { scene.m_Objects[objectIdx], triangleIdx, true };
+					didHit = true;
+					return true;
+				});
+
+			return didHit;
+		}
+
+		//The packets only find the closest primitive, t comes from the scalar test so it is the same as before
+		static bool HitTest_Planes(const Scene& scene, const Ray& ray, DeferredHit& closest)
+		{
+			float t{};
+			uint32_t planeIdx{};
+			if (!GeometryUtils::HitTest_PlanePackets(scene.m_PlanePackets, ray, t, planeIdx)) return false;
+			if (!GeometryUtils::HitTest_Plane(scene.m_PlaneGeometries[planeIdx], ray, t) || !(t < closest.t)) return false;
+
+			closest = { t, { SceneObjectType::Plane, planeIdx } };
+			return true;
+		}
+
+		static bool HitTest_FlatSpheres(const Scene& scene, const Ray& ray, DeferredHit& closest)
+		{
+			Ray culledRay{ ray };
+			culledRay.max = std::min(ray.max, closest.t);
+
+			float t{};
+			uint32_t sphereIdx{};
+			if (!GeometryUtils::HitTest_SpherePackets(scene.m_SpherePackets, culledRay, t, sphereIdx)) return false;
+			if (!GeometryUtils::HitTest_Sphere(scene.m_SphereGeometries[sphereIdx], culledRay, t) || !(t < closest.t)) return false;
+
+			closest = { t, { SceneObjectType::Sphere, sphereIdx } };
+			return true;
+		}
+
+		static bool HitTest_Occluder(const Scene& scene, const SceneObject& object, const Ray& ray, uint32_t& triangleIdx)
+		{
+			switch (object.type)
+			{
+			case SceneObjectType::Sphere:
+				return GeometryUtils::HitTest_Sphere(scene.m_SphereGeometries[object.index], ray);
+			case SceneObjectType::Triangle:
+				return GeometryUtils::HitTest_Triangle(scene.m_Triangles[object.index], ray);
+			case SceneObjectType::TriangleMesh:
+				return GeometryUtils::HitTest_TriangleMesh(scene.m_TriangleMeshGeometries[object.index], ray, triangleIdx);
+			case SceneObjectType::Plane:
+				return GeometryUtils::HitTest_Plane(scene.m_PlaneGeometries[object.index], ray);
+			}
+			return false;
+		}
+
+		//The occluder can come from an earlier frame or scene, so its indices are checked before use
+		static bool HitTest_CachedOccluder(const Scene& scene, const ShadowOccluder& occluder, const Ray& ray)
+		{
+			const uint32_t index = occluder.object.index;
+			switch (occluder.object.type)
+			{
+			case SceneObjectType::Sphere:
+				return index < scene.m_SphereGeometries.size() && GeometryUtils::HitTest_Sphere(scene.m_SphereGeometries[index], ray);
+			case SceneObjectType::Triangle:
+				return index < scene.m_Triangles.size() && GeometryUtils::HitTest_Triangle(scene.m_Triangles[index], ray);
+			case SceneObjectType::TriangleMesh:
+			{
+				if (index >= scene.m_TriangleMeshGeometries.size()) return false;
+
+				const TriangleMesh& mesh = scene.m_TriangleMeshGeometries[index];
+				return occluder.triangleIdx < mesh.indices.size() / 3
+					&& GeometryUtils::HitTest_MeshTriangle(mesh, occluder.triangleIdx, GeometryUtils::GetObjectRay(mesh, ray));
+			}
+			case SceneObjectType::Plane:
+				return index < scene.m_PlaneGeometries.size() && GeometryUtils::HitTest_Plane(scene.m_PlaneGeometries[index], ray);
+			}
+			return false;
+		}
+
+		//Closest hit only, shadow rays go through HitTest_Occluder. Replaces closest when the object is hit in front of it
+		static bool HitTest_Object(const Scene& scene, const SceneObject& object, const Ray& ray, DeferredHit& closest)
+		{
+			float t{};
+			uint32_t triangleIdx{};
+			bool didHit{ false };
+			switch (object.type)
+			{
+			case SceneObjectType::Sphere:
+				didHit = GeometryUtils::HitTest_Sphere(scene.m_SphereGeometries[object.index], ray, t);
+				break;
+			case SceneObjectType::Triangle:
+				didHit = GeometryUtils::HitTest_Triangle(scene.m_Triangles[object.index], ray, t);
+				break;
+			case SceneObjectType::TriangleMesh:
+				didHit = GeometryUtils::HitTest_TriangleMesh(scene.m_TriangleMeshGeometries[object.index], ray, t, triangleIdx);
+				break;
+			case SceneObjectType::Plane:
+				didHit = GeometryUtils::HitTest_Plane(scene.m_PlaneGeometries[object.index], ray, t);
+				break;
+			}
+			if (!didHit || !(t < closest.t)) return false;
+
+			closest = { t, object, triangleIdx };
+			return true;
+		}
+
+		//Full record of the final hit of a search, the same record the HitRecord tests would have written for it
+		static HitRecord GetHitRecord(const Scene& scene, const Ray& ray, const DeferredHit& hit)
+		{
+			const uint32_t index = hit.object.index;
+			switch (hit.object.type)
+			{
+			case SceneObjectType::Sphere:
+				return GeometryUtils::GetHitRecord(scene.m_SphereGeometries[index], ray, hit.t);
+			case SceneObjectType::Triangle:
+				return GeometryUtils::GetHitRecord(scene.m_Triangles[index], ray, hit.t);
+			case SceneObjectType::TriangleMesh:
+				return GeometryUtils::GetHitRecord(scene.m_TriangleMeshGeometries[index], hit.triangleIdx, ray, hit.t);
+			case SceneObjectType::Plane:
+				return GeometryUtils::GetHitRecord(scene.m_PlaneGeometries[index], ray, hit.t);
+			}
+			return {};
+		}
+#pragma endregion
+
+#pragma region Rendering
+		//Same math as Renderer::GeneratePrimaryRay in the same order, one pixel per lane. Lanes past the image border stay inactive
+		static void GeneratePrimaryRays(const Renderer& renderer, uint32_t packetIndex, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin, RayPacket8& packet)
+		{
+			constexpr int PACKET_WIDTH{ Renderer::PACKET_WIDTH };
+			static_assert(PACKET_WIDTH * Renderer::PACKET_HEIGHT == RayPacket8::WIDTH);
+
+			const uint32_t packetsPerRow{ uint32_t((renderer.m_Width + PACKET_WIDTH - 1) / PACKET_WIDTH) };
+			const uint32_t firstX{ (packetIndex % packetsPerRow) * PACKET_WIDTH }, firstY{ (packetIndex / packetsPerRow) * Renderer::PACKET_HEIGHT };
+
+			alignas(32) float pixelX[RayPacket8::WIDTH], pixelY[RayPacket8::WIDTH];
+			packet.activeMask = 0;
+			for (int lane{}; lane < RayPacket8::WIDTH; ++lane)
+			{
+				pixelX[lane] = float(firstX + lane % PACKET_WIDTH);
+				pixelY[lane] = float(firstY + lane / PACKET_WIDTH);
+				if (pixelX[lane] < renderer.m_Width && pixelY[lane] < renderer.m_Height) packet.activeMask |= 1u << lane;
+
+				packet.originX[lane] = cameraOrigin.x;
+				packet.originY[lane] = cameraOrigin.y;
+				packet.originZ[lane] = cameraOrigin.z;
+				packet.min[lane] = Ray{}.min;
+				packet.max[lane] = Ray{}.max;
+			}
+
+			const Vector3 axisX{ cameraToWorld.GetAxisX() }, axisY{ cameraToWorld.GetAxisY() }, axisZ{ cameraToWorld.GetAxisZ() };
+#ifdef __AVX2__
+			const __m256 half = _mm256_set1_ps(.5f), one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f);
+			const __m256 rx = _mm256_add_ps(_mm256_load_ps(pixelX), half);
+			const __m256 ry = _mm256_add_ps(_mm256_load_ps(pixelY), half);
+			const __m256 cx = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(two, _mm256_div_ps(rx, _mm256_set1_ps(float(renderer.m_Width)))), one), _mm256_set1_ps(aspectRatio)), _mm256_set1_ps(fov));
+			const __m256 cy = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_div_ps(ry, _mm256_set1_ps(float(renderer.m_Height))))), _mm256_set1_ps(fov));
+
+			//TransformVector(cx, cy, 1), then Normalized
+			const auto transform = [&](float x, float y, float z)
+				{
+					return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(x), cx), _mm256_mul_ps(_mm256_set1_ps(y), cy)), _mm256_mul_ps(_mm256_set1_ps(z), one));
+				};
+			const __m256 directionX = transform(axisX.x, axisY.x, axisZ.x);
+			const __m256 directionY = transform(axisX.y, axisY.y, axisZ.y);
+			const __m256 directionZ = transform(axisX.z, axisY.z, axisZ.z);
+			const __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, directionX), _mm256_mul_ps(directionY, directionY)), _mm256_mul_ps(directionZ, directionZ)));
+
+			const __m256 normalizedX = _mm256_div_ps(directionX, magnitude);
+			const __m256 normalizedY = _mm256_div_ps(directionY, magnitude);
+			const __m256 normalizedZ = _mm256_div_ps(directionZ, magnitude);
+			_mm256_store_ps(packet.directionX, normalizedX);
+			_mm256_store_ps(packet.directionY, normalizedY);
+			_mm256_store_ps(packet.directionZ, normalizedZ);
+			_mm256_store_ps(packet.invDirectionX, _mm256_div_ps(one, normalizedX));
+			_mm256_store_ps(packet.invDirectionY, _mm256_div_ps(one, normalizedY));
+			_mm256_store_ps(packet.invDirectionZ, _mm256_div_ps(one, normalizedZ));
+#else
+			for (int lane{}; lane < RayPacket8::WIDTH; ++lane)
+			{
+				const uint32_t activeMask{ packet.activeMask };
+				packet.SetRay(lane, renderer.GeneratePrimaryRay(uint32_t(pixelX[lane]), uint32_t(pixelY[lane]), fov, aspectRatio, cameraToWorld, cameraOrigin));
+				packet.activeMask = activeMask;
+			}
+#endif
+		}
+
+		static void RenderPacket(const Renderer& renderer, Scene* pScene, uint32_t packetIndex, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin)
+		{
+			RayPacket8 packet{};
+			GeneratePrimaryRays(renderer, packetIndex, fov, aspectRatio, cameraToWorld, cameraOrigin, packet);
+
+			const uint32_t packetsPerRow{ uint32_t((renderer.m_Width + Renderer::PACKET_WIDTH - 1) / Renderer::PACKET_WIDTH) };
+			const uint32_t firstX{ (packetIndex % packetsPerRow) * Renderer::PACKET_WIDTH }, firstY{ (packetIndex / packetsPerRow) * Renderer::PACKET_HEIGHT };
+			const auto getPixelIndex = [&](int lane) { return (firstY + lane / Renderer::PACKET_WIDTH) * renderer.m_Width + firstX + lane % Renderer::PACKET_WIDTH; };
+
+			//converged pixels only get their mean written again, their lanes leave the packet before anything is traced
+			ColorRGB colors[RayPacket8::WIDTH]{};
+			const uint32_t writeMask{ packet.activeMask };
+			for (uint32_t lanes{ writeMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane = std::countr_zero(lanes);
+				const PixelSamples& samples{ renderer.m_pPixelSamples[getPixelIndex(lane)] };
+				if (!IsConverged(renderer, samples)) continue;
+
+				colors[lane] = samples.GetMean();
+				packet.activeMask &= ~(1u << lane);
+			}
+
+			HitRecord closestHits[RayPacket8::WIDTH]{};
+			if (packet.activeMask) GetClosestHits(*pScene, packet, closestHits);
+
+			//only the primary rays travel together, shading and shadow rays stay per pixel
+			for (uint32_t lanes{ packet.activeMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane = std::countr_zero(lanes);
+				Ray viewRay{ packet.GetRay(lane) };
+				viewRay.max = Ray{}.max;
+				colors[lane] = SamplePixel(renderer, *pScene, viewRay, closestHits[lane], getPixelIndex(lane));
+			}
+
+			//the active lanes of a row are the pixels left of the image border
+			for (uint32_t row{}; row < Renderer::PACKET_HEIGHT; ++row)
+			{
+				const uint32_t rowMask{ (writeMask >> (row * Renderer::PACKET_WIDTH)) & ((1u << Renderer::PACKET_WIDTH) - 1) };
+				if (rowMask) WritePixels(renderer, colors + row * Renderer::PACKET_WIDTH, firstX, firstY + row, uint32_t(std::popcount(rowMask)));
+			}
+		}
+
+		static void RenderPixel(const Renderer& renderer, Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Transform& cameraToWorld, const Vector3& cameraOrigin)
+		{
+			const uint32_t px{ pixelIndex % renderer.m_Width }, py{ pixelIndex / renderer.m_Width };
+
+			const PixelSamples& samples{ renderer.m_pPixelSamples[pixelIndex] };
+			if (IsConverged(renderer, samples))
+			{
+				const ColorRGB meanColor{ samples.GetMean() };
+				WritePixels(renderer, &meanColor, px, py, 1);
+				return;
+			}
+
+			const Ray viewRay{ renderer.GeneratePrimaryRay(px, py, fov, aspectRatio, cameraToWorld, cameraOrigin) };
+
+			HitRecord closestHit{};
+			GetClosestHit(*pScene, viewRay, closestHit);
+
+			const ColorRGB finalColor{ SamplePixel(renderer, *pScene, viewRay, closestHit, pixelIndex) };
+			WritePixels(renderer, &finalColor, px, py, 1);
+		}
+
+		static ColorRGB ShadePixel(const Scene& scene, const Ray& viewRay, const HitRecord& closestHit)
+		{
+			const std::vector<Material*>& materials{ scene.GetMaterials() };
+
+			ColorRGB finalColor{};
+
+
+			if (closestHit.didHit)
+			{
+				const std::vector<Light>& lights{ scene.GetLights() };
+
+				//the last occluder per light stays with the thread, the pixels it renders next are mostly its neighbours
+				thread_local std::vector<CachedOccluder> lastOccluders{};
+				lastOccluders.resize(lights.size());
+
+				for (size_t lightIdx{}; lightIdx < lights.size(); ++lightIdx)
+				{
+					const Light& light = lights[lightIdx];
+
+					Vector3 LightDirection = LightUtils::GetDirectionToLight(light, closestHit.origin);
+					const float normalizedDistance = LightDirection.Normalize();
+					const Ray lightRay{ closestHit.origin + closestHit.normal * 0.0005f, LightDirection, 0.0001f, normalizedDistance };
+
+
+					ColorRGB Radiance{ 1,1,1 };
+					float observedArea{ 1 };
+					ColorRGB BRDF{ 1,1,1 };
+
+					float shadowFactor = 1.0f;
+
+#ifdef SOFT_SHADOWS
+
+					const float lightRadius = .1f;
+					const int numShadowSamples = 3;
+
+					for (int i = 0; i < numShadowSamples; ++i)
+					{
+						Vector3 randomizedLightPosition = LightUtils::GetRandomPointNearLight(light, lightRadius);
+
+						Vector3 lightDirection = (randomizedLightPosition - closestHit.origin).Normalized();
+						float distanceToLight = (randomizedLightPosition - closestHit.origin).Magnitude();
+						Ray lightRay(closestHit.origin + closestHit.normal * 0.0005f, lightDirection, 0.0001f, distanceToLight);
+
+						if (!DoesHit(scene, lightRay, lastOccluders[lightIdx]))
+						{
+							shadowFactor += 1.0f;
+						}
+					}
+					shadowFactor /= numShadowSamples;
+
+#endif // SOFT_SHADOWS
+
+
+
+					switch (scene.m_CurrentLightingMode)
+					{
+					case LightingMode::ObservedArea:
+						observedArea = Vector3::Dot(closestHit.normal, LightDirection);
+
+						break;
+					case LightingMode::Radiance:
+						Radiance = LightUtils::GetRadiance(light, closestHit.origin);
+						break;
+					case LightingMode::BRDF:
+						BRDF = materials[closestHit.materialIndex]->Shade(closestHit, LightDirection, -viewRay.direction);
+						break;
+					case LightingMode::Combined:
+						BRDF = materials[closestHit.materialIndex]->Shade(closestHit, LightDirection, -viewRay.direction);
+						Radiance = LightUtils::GetRadiance(light, closestHit.origin);
+						observedArea = Vector3::Dot(closestHit.normal, LightDirection);
+						break;
+					default:
+						break;
+					}
+
+					if (observedArea < 0)
+					{
+						continue;
+					}
+
+#ifdef SOFT_SHADOWS
+					finalColor += Radiance * observedArea * BRDF * shadowFactor;
+#else
+					if (DoesHit(scene, lightRay, lastOccluders[lightIdx]) && scene.m_bShadowEnabled)
+					{
+						finalColor *= 1.f;
+					}
+					else
+					{
+						finalColor += Radiance * observedArea * BRDF;
+					}
+#endif // _DEBUG
+
+
+				}
+
+			}
+
+			return finalColor;
+		}
+
+		//Samples left over from before the last restart never count
+		static bool IsConverged(const Renderer& renderer, const PixelSamples& samples)
+		{
+			return renderer.m_AccumulatedFrames > 1 && renderer.m_AdaptiveThreshold > 0.f && samples.IsConverged(renderer.m_AdaptiveThreshold);
+		}
+
+		//Shades the pixel once, or a few times while its error is well above the threshold, adds every sample to the
+		//accumulation and returns the mean of all of them
+		static ColorRGB SamplePixel(const Renderer& renderer, const Scene& scene, const Ray& viewRay, const HitRecord& closestHit, uint32_t pixelIndex)
+		{
+			PixelSamples& samples{ renderer.m_pPixelSamples[pixelIndex] };
+			if (renderer.m_AccumulatedFrames <= 1) samples = {};
+
+			uint32_t sampleSets{ 1 };
+			if (renderer.m_AdaptiveThreshold > 0.f && samples.count >= Renderer::MIN_ADAPTIVE_SAMPLES)
+			{
+				//clamped as a float, a bright pixel or a tiny threshold can put the ratio past what fits in a uint32_t
+				const float ratio{ std::min(samples.GetError() / renderer.m_AdaptiveThreshold, float(Renderer::MAX_SAMPLE_SETS)) };
+				sampleSets = std::max(uint32_t(ratio), 1u);
+			}
+
+			for (uint32_t sampleSet{}; sampleSet < sampleSets; ++sampleSet)
+			{
+				samples.Add(ShadePixel(scene, viewRay, closestHit));
+			}
+			return samples.GetMean();
+		}
+
+		//MaxToOne and SDL_MapRGB for count pixels of one row. 32 bit surfaces without lost bits are packed 4 pixels at a time
+		static void WritePixels(const Renderer& renderer, const ColorRGB* colors, uint32_t px, uint32_t py, uint32_t count)
+		{
+			const SDL_PixelFormat* pFormat{ renderer.m_pBuffer->format };
+			uint32_t* pPixels{ renderer.m_pBufferPixels + px + (py * renderer.m_Width) };
+			uint32_t pixelIdx{};
+
+#if defined(__SSE2__) || defined(_M_X64)
+			if (pFormat->BytesPerPixel == 4 && !pFormat->Rloss && !pFormat->Gloss && !pFormat->Bloss)
+			{
+				const __m128 one = _mm_set1_ps(1.f), maxByte = _mm_set1_ps(255.f);
+				const __m128i alpha = _mm_set1_epi32(int(pFormat->Amask));
+				for (; pixelIdx + 4 <= count; pixelIdx += 4)
+				{
+					const ColorRGB* pColors{ colors + pixelIdx };
+					__m128 r = _mm_setr_ps(pColors[0].r, pColors[1].r, pColors[2].r, pColors[3].r);
+					__m128 g = _mm_setr_ps(pColors[0].g, pColors[1].g, pColors[2].g, pColors[3].g);
+					__m128 b = _mm_setr_ps(pColors[0].b, pColors[1].b, pColors[2].b, pColors[3].b);
+
+					//dividing by one leaves the channel as is, so the lanes at or below one go through the same division
+					const __m128 maxValue = _mm_max_ps(r, _mm_max_ps(g, b));
+					const __m128 divisor = GeometryUtils::Select4(one, maxValue, _mm_cmpgt_ps(maxValue, one));
+					r = _mm_div_ps(r, divisor);
+					g = _mm_div_ps(g, divisor);
+					b = _mm_div_ps(b, divisor);
+
+					const __m128i red = _mm_sll_epi32(_mm_cvttps_epi32(_mm_mul_ps(r, maxByte)), _mm_cvtsi32_si128(pFormat->Rshift));
+					const __m128i green = _mm_sll_epi32(_mm_cvttps_epi32(_mm_mul_ps(g, maxByte)), _mm_cvtsi32_si128(pFormat->Gshift));
+					const __m128i blue = _mm_sll_epi32(_mm_cvttps_epi32(_mm_mul_ps(b, maxByte)), _mm_cvtsi32_si128(pFormat->Bshift));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(pPixels + pixelIdx), _mm_or_si128(_mm_or_si128(red, green), _mm_or_si128(blue, alpha)));
+				}
+			}
+#endif
+
+			for (; pixelIdx < count; ++pixelIdx)
+			{
+				ColorRGB finalColor{ colors[pixelIdx] };
+				finalColor.MaxToOne();
+
+				pPixels[pixelIdx] = SDL_MapRGB(pFormat,
+					static_cast<uint8_t>(finalColor.r * 255),
+					static_cast<uint8_t>(finalColor.g * 255),
+					static_cast<uint8_t>(finalColor.b * 255));
+			}
+		}
+#pragma endregion
+	};
+
+	template<>
+	const SimdKernelTable& GetSimdKernelTable<SimdLevel::DAE_SIMD_LEVEL>()
+	{
+		using Kernels = SimdKernels<SimdLevel::DAE_SIMD_LEVEL>;
+		static constexpr SimdKernelTable table
+		{
+			&Kernels::GetClosestHit,
+			&Kernels::GetClosestHits,
+			&Kernels::DoesHit,
+			&Kernels::GeneratePrimaryRays,
+			&Kernels::RenderPixel,
+			&Kernels::RenderPacket
+		};
+		return table;
+	}
+}
@@ -0,0 +1,126 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace dae;
+
+namespace
+{
+	uint64_t PackRange(uint32_t begin, uint32_t end)
+	{
+		return (uint64_t(end) << 32) | begin;
+	}
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount) :
+	m_ThreadCount{ threadCount ? threadCount : std::max(std::thread::hardware_concurrency(), 1u) },
+	m_pQueues{ std::make_unique<WorkerQueue[]>(m_ThreadCount) }
+{
+	m_Threads.reserve(m_ThreadCount - 1);
+	for (uint32_t workerIndex{ 1 }; workerIndex < m_ThreadCount; ++workerIndex)
+	{
+		m_Threads.emplace_back([this, workerIndex] { WorkerLoop(workerIndex); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	m_bStop.store(true);
+	m_Generation.fetch_add(1, std::memory_order_release);
+	m_Generation.notify_all();
+
+	for (std::thread& thread : m_Threads) thread.join();
+}
+
+void ThreadPool::Run(uint32_t taskCount, TaskFunction function, const void* pTask)
+{
+	if (m_ThreadCount == 1)
+	{
+		for (uint32_t index{}; index < taskCount; ++index) function(pTask, index);
+		return;
+	}
+
+	m_TaskFunction = function;
+	m_pTask = pTask;
+	for (uint32_t workerIndex{}; workerIndex < m_ThreadCount; ++workerIndex)
+	{
+		const uint32_t begin{ uint32_t(uint64_t(taskCount) * workerIndex / m_ThreadCount) };
+		const uint32_t end{ uint32_t(uint64_t(taskCount) * (workerIndex + 1) / m_ThreadCount) };
+		m_pQueues[workerIndex].range.store(PackRange(begin, end), std::memory_order_relaxed);
+	}
+
+	m_BusyWorkers.store(m_ThreadCount - 1, std::memory_order_relaxed);
+	m_Generation.fetch_add(1, std::memory_order_release);
+	m_Generation.notify_all();
+
+	RunTasks(0);
+
+	//a stolen task can still be running after the queues ran dry, so wait for every worker to check out
+	for (uint32_t busyWorkers{}; (busyWorkers = m_BusyWorkers.load(std::memory_order_acquire)) != 0;)
+	{
+		m_BusyWorkers.wait(busyWorkers, std::memory_order_acquire);
+	}
+}
+
+void ThreadPool::WorkerLoop(uint32_t workerIndex)
+{
+	uint32_t seenGeneration{};
+	while (true)
+	{
+		m_Generation.wait(seenGeneration, std::memory_order_acquire);
+		seenGeneration = m_Generation.load(std::memory_order_acquire);
+		if (m_bStop.load()) return;
+
+		RunTasks(workerIndex);
+
+		if (m_BusyWorkers.fetch_sub(1, std::memory_order_acq_rel) == 1) m_BusyWorkers.notify_one();
+	}
+}
+
+void ThreadPool::RunTasks(uint32_t workerIndex)
+{
+	uint32_t index{};
+	while (Pop(workerIndex, index) || Steal(workerIndex, index))
+	{
+		m_TaskFunction(m_pTask, index);
+	}
+}
+
+bool ThreadPool::Pop(uint32_t workerIndex, uint32_t& index)
+{
+	std::atomic<uint64_t>& range = m_pQueues[workerIndex].range;
+	uint64_t current{ range.load(std::memory_order_relaxed) };
+	while (true)
+	{
+		const uint32_t begin{ uint32_t(current) }, end{ uint32_t(current >> 32) };
+		if (begin >= end) return false;
+
+		if (range.compare_exchange_weak(current, PackRange(begin + 1, end), std::memory_order_acq_rel, std::memory_order_relaxed))
+		{
+			index = begin;
+			return true;
+		}
+	}
+}
+
+bool ThreadPool::Steal(uint32_t workerIndex, uint32_t& index)
+{
+	//the back of a queue is the work its owner would reach last
+	for (uint32_t offset{ 1 }; offset < m_ThreadCount; ++offset)
+	{
+		std::atomic<uint64_t>& range = m_pQueues[(workerIndex + offset) % m_ThreadCount].range;
+		uint64_t current{ range.load(std::memory_order_relaxed) };
+		while (true)
+		{
+			const uint32_t begin{ uint32_t(current) }, end{ uint32_t(current >> 32) };
+			if (begin >= end) break;
+
+			if (range.compare_exchange_weak(current, PackRange(begin, end - 1), std::memory_order_acq_rel, std::memory_order_relaxed))
+			{
+				index = end - 1;
+				return true;
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	/**
+	 * \brief Persistent worker threads that run ParallelFor over task indices. Every worker owns a queue of indices,
+	 * pops from its front and steals from the back of the others once it runs dry. Dispatching never allocates
+	 */
+	class ThreadPool final
+	{
+	public:
+		//0 picks std::thread::hardware_concurrency. The calling thread works along, so threadCount - 1 threads are started
+		explicit ThreadPool(uint32_t threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		/**
+		 * \brief Calls task(index) once for every index below taskCount and returns when all of them are done.
+		 * The queues start out as contiguous ranges, so neighbouring indices mostly end up on the same thread
+		 */
+		template<typename Task>
+		void ParallelFor(uint32_t taskCount, const Task& task)
+		{
+			Run(taskCount, [](const void* pTask, uint32_t index) { (*static_cast<const Task*>(pTask))(index); }, &task);
+		}
+
+		uint32_t GetThreadCount() const { return m_ThreadCount; }
+
+	private:
+		using TaskFunction = void(*)(const void* pTask, uint32_t index);
+
+		//begin in the low and end in the high 32 bits, so popping and stealing are a single compare exchange each
+		struct alignas(64) WorkerQueue
+		{
+			std::atomic<uint64_t> range{};
+		};
+
+		void Run(uint32_t taskCount, TaskFunction function, const void* pTask);
+		void WorkerLoop(uint32_t workerIndex);
+		void RunTasks(uint32_t workerIndex);
+
+		bool Pop(uint32_t workerIndex, uint32_t& index);
+		bool Steal(uint32_t workerIndex, uint32_t& index);
+
+		uint32_t m_ThreadCount{};
+		std::unique_ptr<WorkerQueue[]> m_pQueues{};
+		std::vector<std::thread> m_Threads{};
+
+		TaskFunction m_TaskFunction{};
+		const void* m_pTask{};
+
+		//bumped once per ParallelFor, the workers sleep on it in between
+		std::atomic<uint32_t> m_Generation{};
+		std::atomic<uint32_t> m_BusyWorkers{};
+		std::atomic<bool> m_bStop{};
+	};
+}
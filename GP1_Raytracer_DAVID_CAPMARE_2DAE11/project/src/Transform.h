@@ -0,0 +1,187 @@
+#pragma once
+#include <cstddef>
+
+#include "Vector3.h"
+#include "Matrix.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define DAE_TRANSFORM_SSE
+#endif
+
+namespace dae
+{
+	//Affine transform as 3x4, a Matrix without the constant w column. Row i holds component i of the three axes, with the
+	//translation in the w lane. Same math and operation order as the Matrix calls of the same name, so the results match bit for bit
+	struct alignas(16) Transform
+	{
+		Transform() = default;
+
+		DAE_INLINE Transform(const Vector3& xAxis, const Vector3& yAxis, const Vector3& zAxis, const Vector3& t) :
+			m{
+				{ xAxis.x, yAxis.x, zAxis.x, t.x },
+				{ xAxis.y, yAxis.y, zAxis.y, t.y },
+				{ xAxis.z, yAxis.z, zAxis.z, t.z }
+			}
+		{
+		}
+
+		//Drops the w column, only meant for affine matrices
+		DAE_INLINE explicit Transform(const Matrix& matrix) :
+			Transform(matrix.GetAxisX(), matrix.GetAxisY(), matrix.GetAxisZ(), matrix.GetTranslation())
+		{
+		}
+
+		DAE_INLINE Matrix ToMatrix() const
+		{
+			return { GetAxisX(), GetAxisY(), GetAxisZ(), GetTranslation() };
+		}
+
+		DAE_INLINE Vector3 TransformVector(const Vector3& v) const
+		{
+			return TransformVector(v.x, v.y, v.z);
+		}
+
+		//A single point or vector is plain float math, turning the rows into SSE columns would cost more than the 9 multiply-adds
+		DAE_INLINE Vector3 TransformVector(float x, float y, float z) const
+		{
+			return Vector3{
+				m[0][0] * x + m[0][1] * y + m[0][2] * z,
+				m[1][0] * x + m[1][1] * y + m[1][2] * z,
+				m[2][0] * x + m[2][1] * y + m[2][2] * z
+			};
+		}
+
+		DAE_INLINE Vector3 TransformPoint(const Vector3& p) const
+		{
+			return TransformPoint(p.x, p.y, p.z);
+		}
+
+		DAE_INLINE Vector3 TransformPoint(float x, float y, float z) const
+		{
+			return Vector3{
+				m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3],
+				m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3],
+				m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3]
+			};
+		}
+
+		//TransformPoint over an array, the columns are only set up once. out may be points itself
+		DAE_INLINE void TransformPoints(const Vector3* points, Vector3* out, size_t count) const
+		{
+#ifdef DAE_TRANSFORM_SSE
+			__m128 axisX, axisY, axisZ, translation;
+			LoadColumns(axisX, axisY, axisZ, translation);
+			for (size_t idx{}; idx < count; ++idx)
+			{
+				const Vector3& p = points[idx];
+				out[idx] = ToVector3(_mm_add_ps(TransformColumns(axisX, axisY, axisZ, _mm_set1_ps(p.x), _mm_set1_ps(p.y), _mm_set1_ps(p.z)), translation));
+			}
+#else
+			for (size_t idx{}; idx < count; ++idx)
+			{
+				out[idx] = TransformPoint(points[idx]);
+			}
+#endif
+		}
+
+		DAE_INLINE Vector3 GetAxisX() const
+		{
+			return { m[0][0], m[1][0], m[2][0] };
+		}
+
+		DAE_INLINE Vector3 GetAxisY() const
+		{
+			return { m[0][1], m[1][1], m[2][1] };
+		}
+
+		DAE_INLINE Vector3 GetAxisZ() const
+		{
+			return { m[0][2], m[1][2], m[2][2] };
+		}
+
+		DAE_INLINE Vector3 GetTranslation() const
+		{
+			return { m[0][3], m[1][3], m[2][3] };
+		}
+
+		DAE_INLINE static Transform CreateTranslation(const Vector3& t)
+		{
+			return { Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, t };
+		}
+
+		DAE_INLINE static Transform CreateRotationY(float yaw)
+		{
+			return Transform{ Matrix::CreateRotationY(yaw) };
+		}
+
+		DAE_INLINE static Transform CreateScale(const Vector3& s)
+		{
+			return { { s.x, 0, 0 }, { 0, s.y, 0 }, { 0, 0, s.z }, Vector3::Zero };
+		}
+
+		//Inverts the 3x4 part and moves the translation along, like Matrix::Inverse
+		DAE_INLINE static Transform Inverse(const Transform& t)
+		{
+			const Vector3 xAxis = t.GetAxisX();
+			const Vector3 yAxis = t.GetAxisY();
+			const Vector3 zAxis = t.GetAxisZ();
+
+			const Vector3 c0 = Vector3::Cross(yAxis, zAxis);
+			const Vector3 c1 = Vector3::Cross(zAxis, xAxis);
+			const Vector3 c2 = Vector3::Cross(xAxis, yAxis);
+			const float invDeterminant = 1.f / Vector3::Dot(xAxis, c0);
+
+			const Transform inverseAxes{
+				Vector3{ c0.x, c1.x, c2.x } * invDeterminant,
+				Vector3{ c0.y, c1.y, c2.y } * invDeterminant,
+				Vector3{ c0.z, c1.z, c2.z } * invDeterminant,
+				Vector3::Zero
+			};
+			return { inverseAxes.GetAxisX(), inverseAxes.GetAxisY(), inverseAxes.GetAxisZ(), -inverseAxes.TransformVector(t.GetTranslation()) };
+		}
+
+		//This transform followed by t, the same order as Matrix::operator*
+		DAE_INLINE Transform operator*(const Transform& t) const
+		{
+			return { t.TransformVector(GetAxisX()), t.TransformVector(GetAxisY()), t.TransformVector(GetAxisZ()), t.TransformPoint(GetTranslation()) };
+		}
+
+		DAE_INLINE bool operator==(const Transform& t) const
+		{
+			return GetAxisX() == t.GetAxisX() && GetAxisY() == t.GetAxisY() && GetAxisZ() == t.GetAxisZ() && GetTranslation() == t.GetTranslation();
+		}
+
+	private:
+		float m[3][4]
+		{
+			{ 1, 0, 0, 0 },
+			{ 0, 1, 0, 0 },
+			{ 0, 0, 1, 0 }
+		};
+
+#ifdef DAE_TRANSFORM_SSE
+		//The rows transposed into the axes and the translation, w is 0. Only worth it for more than one point or vector
+		DAE_INLINE void LoadColumns(__m128& axisX, __m128& axisY, __m128& axisZ, __m128& translation) const
+		{
+			axisX = _mm_load_ps(m[0]);
+			axisY = _mm_load_ps(m[1]);
+			axisZ = _mm_load_ps(m[2]);
+			translation = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(axisX, axisY, axisZ, translation);
+		}
+
+		DAE_INLINE static __m128 TransformColumns(__m128 axisX, __m128 axisY, __m128 axisZ, __m128 x, __m128 y, __m128 z)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(axisX, x), _mm_mul_ps(axisY, y)), _mm_mul_ps(axisZ, z));
+		}
+
+		//Straight from the register, without a round trip through memory
+		DAE_INLINE static Vector3 ToVector3(__m128 v)
+		{
+			return { _mm_cvtss_f32(v), _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))), _mm_cvtss_f32(_mm_movehl_ps(v, v)) };
+		}
+#endif
+	};
+	static_assert(sizeof(Transform) == 48);
+}
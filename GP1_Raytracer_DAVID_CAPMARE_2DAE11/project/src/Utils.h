@@ -2,22 +2,28 @@
 #include <fstream>
 #include "Maths.h"
 #include <iostream>
+#include <sstream>
 #include "DataTypes.h"
 
+#include <bit>
 #include <random>
+#include <type_traits>
 #include "SquirellNoise5.hpp"
 #include <immintrin.h>
-
-//#define USE_SIMD_OP 
+#include "SimdDispatch.h"
 
 
 namespace dae
 {
+	//one copy per SIMD level, see SimdDispatch.h
+	inline namespace DAE_SIMD_NAMESPACE
+	{
 	namespace GeometryUtils
 	{
 #pragma region Sphere HitTest
 		//SPHERE HIT-TESTS
-		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Closest-hit roots without a record, writes t on a hit within the ray. GetHitRecord fills in the rest for the final hit
+		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, float& t)
 		{
 			const float A{ ray.direction.SqrMagnitude() };
 			const float B{ Vector3::Dot(2 * ray.direction, ray.origin - sphere.origin) };
@@ -25,65 +31,360 @@ namespace dae
 
 			const float discriminant{ B * B - 4 * A * C };
 
-			hitRecord = HitRecord{};
-
 			if (discriminant < .0f) return false;
 
 			const float discriminantSqrt{ sqrt(discriminant) };
-			float t{ (-B - discriminantSqrt) / (2 * A) };
+			t = (-B - discriminantSqrt) / (2 * A);
 
 			if (t < 0) t = (-B + discriminantSqrt) / (2 * A);
 			if (t < ray.min || ray.max < t) return false;
-			if (ignoreHitRecord) return true;
 
+			return true;
+		}
+
+		inline HitRecord GetHitRecord(const Sphere& sphere, const Ray& ray, float t)
+		{
+			HitRecord hitRecord{};
 			hitRecord.t = t;
 			hitRecord.origin = ray.origin + hitRecord.t * ray.direction;
 			hitRecord.normal = (hitRecord.origin - sphere.origin) / sphere.radius;
 			hitRecord.materialIndex = sphere.materialIndex;
 			hitRecord.didHit = true;
 
-			return hitRecord.didHit;
+			return hitRecord;
+		}
 
+		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			hitRecord = HitRecord{};
+
+			float t{};
+			if (!HitTest_Sphere(sphere, ray, t)) return false;
+			if (!ignoreHitRecord) hitRecord = GetHitRecord(sphere, ray, t);
+
+			return true;
 		}
 
+		//Any-hit test for shadow rays, same roots as above without touching a hit record
 		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Sphere(sphere, ray, temp, true);
+			const Vector3 toOrigin{ ray.origin - sphere.origin };
+			const float A{ ray.direction.SqrMagnitude() };
+			const float B{ 2 * Vector3::Dot(ray.direction, toOrigin) };
+			const float C{ toOrigin.SqrMagnitude() - sphere.radius * sphere.radius };
+
+			const float discriminant{ B * B - 4 * A * C };
+			if (discriminant < .0f) return false;
+
+			const float discriminantSqrt{ sqrt(discriminant) };
+			float t{ (-B - discriminantSqrt) / (2 * A) };
+			if (t < 0) t = (-B + discriminantSqrt) / (2 * A);
+
+			return ray.min <= t && t <= ray.max;
 		}
 #pragma endregion
 #pragma region Plane HitTest
 		//PLANE HIT-TESTS
-		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Writes t on a hit within the ray, GetHitRecord fills in the rest for the final hit
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, float& t)
 		{
 			//todo W1
-			hitRecord = HitRecord{};
 			const float denominator{ Vector3::Dot(ray.direction, plane.normal) }; // dot is 0 if ray is parallel to the plane
 			if (denominator < FLT_EPSILON && denominator > -FLT_EPSILON) return false; // if ray is parallel to the plane don't render
 
-			const float t{ Vector3::Dot(plane.origin - ray.origin, plane.normal) / denominator };
+			t = Vector3::Dot(plane.origin - ray.origin, plane.normal) / denominator;
+
+			return t > ray.min && t < ray.max;
+		}
+
+		inline HitRecord GetHitRecord(const Plane& plane, const Ray& ray, float t)
+		{
+			HitRecord hitRecord{};
+			hitRecord.t = t;
+			hitRecord.didHit = true;
+			hitRecord.normal = plane.normal;
+			hitRecord.origin = ray.origin + hitRecord.t * ray.direction;
+			hitRecord.materialIndex = plane.materialIndex;
+
+			return hitRecord;
+		}
+
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			hitRecord = HitRecord{};
+
+			float t{};
+			if (!HitTest_Plane(plane, ray, t)) return false;
+			if (!ignoreHitRecord) hitRecord = GetHitRecord(plane, ray, t);
+
+			return true;
+		}
+
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray)
+		{
+			float t{};
+			return HitTest_Plane(plane, ray, t);
+		}
+#pragma endregion
+#pragma region Sphere and Plane Packet HitTest
 
-			if (t > ray.min && t < ray.max)
+		//Lane masks of the packet tests as a SIMD mask, lane i is all ones when bit i is set
+#ifdef __AVX2__
+		inline __m256 GetLaneMask8(uint32_t laneMask)
+		{
+			const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+			return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(laneMask)), bits), bits));
+		}
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+		inline __m128 GetLaneMask4(uint32_t laneMask)
+		{
+			const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+			return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(int(laneMask)), bits), bits));
+		}
+
+		//Picks b where the mask is set, SSE2 has no blendv
+		inline __m128 Select4(__m128 a, __m128 b, __m128 mask)
+		{
+#ifdef DAE_SIMD_SSE41
+			return _mm_blendv_ps(a, b, mask);
+#else
+			return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+#endif
+		}
+#endif
+
+		//Same roots and operation order as HitTest_Sphere, one sphere per lane. Returns the lanes hit within the ray and writes their t
+		inline uint32_t HitTest_SpherePacket(const SpherePacket8& packet, const Ray& ray, float* distances)
+		{
+			const float A{ ray.direction.SqrMagnitude() };
+			const Vector3 twoDirection{ 2 * ray.direction };
+#ifdef __AVX2__
+			const __m256 toOriginX = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(packet.originX));
+			const __m256 toOriginY = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(packet.originY));
+			const __m256 toOriginZ = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(packet.originZ));
+
+			const __m256 B = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(twoDirection.x), toOriginX), _mm256_mul_ps(_mm256_set1_ps(twoDirection.y), toOriginY)), _mm256_mul_ps(_mm256_set1_ps(twoDirection.z), toOriginZ));
+			const __m256 C = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toOriginX, toOriginX), _mm256_mul_ps(toOriginY, toOriginY)), _mm256_mul_ps(toOriginZ, toOriginZ)), _mm256_load_ps(packet.radiusSquared));
+			const __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(B, B), _mm256_mul_ps(_mm256_set1_ps(4 * A), C));
+
+			//negative discriminants give NaN roots, their lanes are masked below
+			const __m256 discriminantSqrt = _mm256_sqrt_ps(discriminant);
+			const __m256 minusB = _mm256_xor_ps(B, _mm256_set1_ps(-0.f));
+			const __m256 twoA = _mm256_set1_ps(2 * A);
+			const __m256 tNear = _mm256_div_ps(_mm256_sub_ps(minusB, discriminantSqrt), twoA);
+			const __m256 tFar = _mm256_div_ps(_mm256_add_ps(minusB, discriminantSqrt), twoA);
+			const __m256 t = _mm256_blendv_ps(tNear, tFar, _mm256_cmp_ps(tNear, _mm256_setzero_ps(), _CMP_LT_OQ));
+
+			__m256 valid = _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ);
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(ray.min), _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(ray.max), _CMP_LE_OQ));
+
+			_mm256_store_ps(distances, t);
+			return static_cast<uint32_t>(_mm256_movemask_ps(valid)) & packet.laneMask;
+#elif defined(__SSE2__) || defined(_M_X64)
+			uint32_t hitMask{ 0 };
+			for (int half{ 0 }; half < SpherePacket8::WIDTH; half += 4)
 			{
-				if (ignoreHitRecord) return true;
-				hitRecord.t = t;
-				hitRecord.didHit = true;
-				hitRecord.normal = plane.normal;
-				hitRecord.origin = ray.origin + hitRecord.t * ray.direction;
-				hitRecord.materialIndex = plane.materialIndex;
+				const __m128 toOriginX = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(packet.originX + half));
+				const __m128 toOriginY = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(packet.originY + half));
+				const __m128 toOriginZ = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(packet.originZ + half));
+
+				const __m128 B = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(twoDirection.x), toOriginX), _mm_mul_ps(_mm_set1_ps(twoDirection.y), toOriginY)), _mm_mul_ps(_mm_set1_ps(twoDirection.z), toOriginZ));
+				const __m128 C = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(toOriginX, toOriginX), _mm_mul_ps(toOriginY, toOriginY)), _mm_mul_ps(toOriginZ, toOriginZ)), _mm_load_ps(packet.radiusSquared + half));
+				const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(B, B), _mm_mul_ps(_mm_set1_ps(4 * A), C));
+
+				const __m128 discriminantSqrt = _mm_sqrt_ps(discriminant);
+				const __m128 minusB = _mm_xor_ps(B, _mm_set1_ps(-0.f));
+				const __m128 twoA = _mm_set1_ps(2 * A);
+				const __m128 tNear = _mm_div_ps(_mm_sub_ps(minusB, discriminantSqrt), twoA);
+				const __m128 tFar = _mm_div_ps(_mm_add_ps(minusB, discriminantSqrt), twoA);
+				const __m128 t = Select4(tNear, tFar, _mm_cmplt_ps(tNear, _mm_setzero_ps()));
+
+				__m128 valid = _mm_cmpge_ps(discriminant, _mm_setzero_ps());
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(t, _mm_set1_ps(ray.min)));
+				valid = _mm_and_ps(valid, _mm_cmple_ps(t, _mm_set1_ps(ray.max)));
+
+				_mm_store_ps(distances + half, t);
+				hitMask |= static_cast<uint32_t>(_mm_movemask_ps(valid)) << half;
 			}
+			return hitMask & packet.laneMask;
+#else
+			uint32_t hitMask{ 0 };
+			for (uint32_t lanes{ packet.laneMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane = std::countr_zero(lanes);
+				const Vector3 toOrigin{ ray.origin.x - packet.originX[lane], ray.origin.y - packet.originY[lane], ray.origin.z - packet.originZ[lane] };
+				const float B{ Vector3::Dot(twoDirection, toOrigin) };
+				const float C{ toOrigin.SqrMagnitude() - packet.radiusSquared[lane] };
 
-			return hitRecord.didHit;
+				const float discriminant{ B * B - 4 * A * C };
+				if (discriminant < .0f) continue;
+
+				const float discriminantSqrt{ sqrt(discriminant) };
+				float t{ (-B - discriminantSqrt) / (2 * A) };
+				if (t < 0) t = (-B + discriminantSqrt) / (2 * A);
+
+				distances[lane] = t;
+				if (ray.min <= t && t <= ray.max) hitMask |= 1u << lane;
+			}
+			return hitMask;
+#endif
 		}
 
-		inline bool HitTest_Plane(const Plane& plane, const Ray& ray)
+		//Same test as HitTest_Plane, one plane per lane. Returns the lanes hit strictly within the ray and writes their t
+		inline uint32_t HitTest_PlanePacket(const PlanePacket8& packet, const Ray& ray, float* distances)
+		{
+#ifdef __AVX2__
+			const __m256 normalX = _mm256_load_ps(packet.normalX);
+			const __m256 normalY = _mm256_load_ps(packet.normalY);
+			const __m256 normalZ = _mm256_load_ps(packet.normalZ);
+
+			const __m256 denominator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ray.direction.x), normalX), _mm256_mul_ps(_mm256_set1_ps(ray.direction.y), normalY)), _mm256_mul_ps(_mm256_set1_ps(ray.direction.z), normalZ));
+			const __m256 toPlaneX = _mm256_sub_ps(_mm256_load_ps(packet.originX), _mm256_set1_ps(ray.origin.x));
+			const __m256 toPlaneY = _mm256_sub_ps(_mm256_load_ps(packet.originY), _mm256_set1_ps(ray.origin.y));
+			const __m256 toPlaneZ = _mm256_sub_ps(_mm256_load_ps(packet.originZ), _mm256_set1_ps(ray.origin.z));
+			const __m256 t = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toPlaneX, normalX), _mm256_mul_ps(toPlaneY, normalY)), _mm256_mul_ps(toPlaneZ, normalZ)), denominator);
+
+			//parallel rays get no hit
+			__m256 valid = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.f), denominator), _mm256_set1_ps(FLT_EPSILON), _CMP_GE_OQ);
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(ray.min), _CMP_GT_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(ray.max), _CMP_LT_OQ));
+
+			_mm256_store_ps(distances, t);
+			return static_cast<uint32_t>(_mm256_movemask_ps(valid)) & packet.laneMask;
+#elif defined(__SSE2__) || defined(_M_X64)
+			uint32_t hitMask{ 0 };
+			for (int half{ 0 }; half < PlanePacket8::WIDTH; half += 4)
+			{
+				const __m128 normalX = _mm_load_ps(packet.normalX + half);
+				const __m128 normalY = _mm_load_ps(packet.normalY + half);
+				const __m128 normalZ = _mm_load_ps(packet.normalZ + half);
+
+				const __m128 denominator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(ray.direction.x), normalX), _mm_mul_ps(_mm_set1_ps(ray.direction.y), normalY)), _mm_mul_ps(_mm_set1_ps(ray.direction.z), normalZ));
+				const __m128 toPlaneX = _mm_sub_ps(_mm_load_ps(packet.originX + half), _mm_set1_ps(ray.origin.x));
+				const __m128 toPlaneY = _mm_sub_ps(_mm_load_ps(packet.originY + half), _mm_set1_ps(ray.origin.y));
+				const __m128 toPlaneZ = _mm_sub_ps(_mm_load_ps(packet.originZ + half), _mm_set1_ps(ray.origin.z));
+				const __m128 t = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(toPlaneX, normalX), _mm_mul_ps(toPlaneY, normalY)), _mm_mul_ps(toPlaneZ, normalZ)), denominator);
+
+				__m128 valid = _mm_cmpge_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), denominator), _mm_set1_ps(FLT_EPSILON));
+				valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, _mm_set1_ps(ray.min)));
+				valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(ray.max)));
+
+				_mm_store_ps(distances + half, t);
+				hitMask |= static_cast<uint32_t>(_mm_movemask_ps(valid)) << half;
+			}
+			return hitMask & packet.laneMask;
+#else
+			uint32_t hitMask{ 0 };
+			for (uint32_t lanes{ packet.laneMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane = std::countr_zero(lanes);
+				const Vector3 normal{ packet.normalX[lane], packet.normalY[lane], packet.normalZ[lane] };
+				const float denominator{ Vector3::Dot(ray.direction, normal) };
+				if (denominator < FLT_EPSILON && denominator > -FLT_EPSILON) continue;
+
+				const Vector3 toPlane{ packet.originX[lane] - ray.origin.x, packet.originY[lane] - ray.origin.y, packet.originZ[lane] - ray.origin.z };
+				distances[lane] = Vector3::Dot(toPlane, normal) / denominator;
+				if (distances[lane] > ray.min && distances[lane] < ray.max) hitMask |= 1u << lane;
+			}
+			return hitMask;
+#endif
+		}
+
+		//Closest primitive over all packets. Every lane keeps its own nearest t and index over the packets, the lanes are reduced
+		//once at the end. Ties go to the lowest index like in a scalar loop over the primitives
+		template<typename Packet, typename PacketTest>
+		inline bool HitTest_ClosestInPackets(std::span<const Packet> packets, const Ray& ray, const PacketTest& packetTest, float& closestT, uint32_t& closestIdx)
+		{
+			alignas(32) float bestT[Packet::WIDTH];
+			alignas(32) uint32_t bestIdx[Packet::WIDTH];
+			std::fill_n(bestT, Packet::WIDTH, FLT_MAX);
+			std::fill_n(bestIdx, Packet::WIDTH, UINT32_MAX);
+
+			alignas(32) float distances[Packet::WIDTH];
+			for (const Packet& packet : packets)
+			{
+				const uint32_t hitMask = packetTest(packet, ray, distances);
+				if (!hitMask) continue;
+#ifdef __AVX2__
+				const __m256 t = _mm256_load_ps(distances);
+				const __m256 closer = _mm256_and_ps(GetLaneMask8(hitMask), _mm256_cmp_ps(t, _mm256_load_ps(bestT), _CMP_LT_OQ));
+				_mm256_store_ps(bestT, _mm256_blendv_ps(_mm256_load_ps(bestT), t, closer));
+				_mm256_store_ps(reinterpret_cast<float*>(bestIdx), _mm256_blendv_ps(_mm256_load_ps(reinterpret_cast<const float*>(bestIdx)), _mm256_load_ps(reinterpret_cast<const float*>(packet.index)), closer));
+#elif defined(__SSE2__) || defined(_M_X64)
+				for (int half{ 0 }; half < Packet::WIDTH; half += 4)
+				{
+					const __m128 t = _mm_load_ps(distances + half);
+					const __m128 closer = _mm_and_ps(GetLaneMask4(hitMask >> half), _mm_cmplt_ps(t, _mm_load_ps(bestT + half)));
+					_mm_store_ps(bestT + half, Select4(_mm_load_ps(bestT + half), t, closer));
+					_mm_store_ps(reinterpret_cast<float*>(bestIdx + half), Select4(_mm_load_ps(reinterpret_cast<const float*>(bestIdx + half)), _mm_loadu_ps(reinterpret_cast<const float*>(packet.index + half)), closer));
+				}
+#else
+				for (uint32_t lanes{ hitMask }; lanes; lanes &= lanes - 1)
+				{
+					const int lane = std::countr_zero(lanes);
+					if (distances[lane] < bestT[lane])
+					{
+						bestT[lane] = distances[lane];
+						bestIdx[lane] = packet.index[lane];
+					}
+				}
+#endif
+			}
+
+			closestIdx = UINT32_MAX;
+			for (int lane{ 0 }; lane < Packet::WIDTH; ++lane)
+			{
+				if (bestIdx[lane] == UINT32_MAX) continue;
+				if (closestIdx == UINT32_MAX || bestT[lane] < closestT || (bestT[lane] == closestT && bestIdx[lane] < closestIdx))
+				{
+					closestT = bestT[lane];
+					closestIdx = bestIdx[lane];
+				}
+			}
+			return closestIdx != UINT32_MAX;
+		}
+
+		//Any-hit over all packets, hands back the index of one hit primitive
+		template<typename Packet, typename PacketTest>
+		inline bool HitTest_AnyInPackets(std::span<const Packet> packets, const Ray& ray, const PacketTest& packetTest, uint32_t& hitIdx)
+		{
+			alignas(32) float distances[Packet::WIDTH];
+			for (const Packet& packet : packets)
+			{
+				const uint32_t hitMask = packetTest(packet, ray, distances);
+				if (!hitMask) continue;
+
+				hitIdx = packet.index[std::countr_zero(hitMask)];
+				return true;
+			}
+			return false;
+		}
+
+		inline bool HitTest_SpherePackets(std::span<const SpherePacket8> packets, const Ray& ray, float& t, uint32_t& sphereIdx)
 		{
-			HitRecord temp{};
-			return HitTest_Plane(plane, ray, temp, true);
+			return HitTest_ClosestInPackets(packets, ray, HitTest_SpherePacket, t, sphereIdx);
+		}
+
+		inline bool HitTest_SpherePackets(std::span<const SpherePacket8> packets, const Ray& ray, uint32_t& sphereIdx)
+		{
+			return HitTest_AnyInPackets(packets, ray, HitTest_SpherePacket, sphereIdx);
+		}
+
+		inline bool HitTest_PlanePackets(std::span<const PlanePacket8> packets, const Ray& ray, float& t, uint32_t& planeIdx)
+		{
+			return HitTest_ClosestInPackets(packets, ray, HitTest_PlanePacket, t, planeIdx);
+		}
+
+		inline bool HitTest_PlanePackets(std::span<const PlanePacket8> packets, const Ray& ray)
+		{
+			uint32_t planeIdx{};
+			return HitTest_AnyInPackets(packets, ray, HitTest_PlanePacket, planeIdx);
 		}
 #pragma endregion
 #pragma region Triangle HitTest
-#ifdef USE_SIMD_OP
+#ifdef DAE_SIMD_SSE41
 		//TRIANGLE HIT-TESTS
 		// https://stackoverflow.blog/2020/07/08/improving-performance-with-simd-intrinsics-in-three-use-cases/ thank god to this
 		inline bool CalculateVerticesSIMD(const Vector3& P, const Vector3& n, const Vector3& v0, const Vector3& v1, const Vector3& v2) {
@@ -137,9 +438,37 @@ namespace dae
 
 
 		}
-#endif // USE_SIMD_OP
+#endif // DAE_SIMD_SSE41
 
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Calls function with cullMode as a std::integral_constant, the tests it instantiates know the cull mode at compile time.
+		//Called once per mesh or object, never per triangle
+		template<typename Function>
+		inline decltype(auto) DispatchCullMode(TriangleCullMode cullMode, const Function& function)
+		{
+			switch (cullMode)
+			{
+			case TriangleCullMode::FrontFaceCulling:
+				return function(std::integral_constant<TriangleCullMode, TriangleCullMode::FrontFaceCulling>{});
+			case TriangleCullMode::BackFaceCulling:
+				return function(std::integral_constant<TriangleCullMode, TriangleCullMode::BackFaceCulling>{});
+			default:
+				return function(std::integral_constant<TriangleCullMode, TriangleCullMode::NoCulling>{});
+			}
+		}
+
+		//nv is the dot of the face normal and the ray direction, shadow rays cull the opposite faces
+		template<TriangleCullMode CullMode, HitQuery Query>
+		constexpr bool IsCulled(float nv)
+		{
+			const float facing{ (Query == HitQuery::Any) ? nv : -nv };
+			if constexpr (CullMode == TriangleCullMode::FrontFaceCulling) return facing > 0;
+			else if constexpr (CullMode == TriangleCullMode::BackFaceCulling) return facing < 0;
+			else return false;
+		}
+
+		//Writes t on a hit within the ray, GetHitRecord fills in the rest for the final hit
+		template<TriangleCullMode CullMode, HitQuery Query>
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, float& t)
 		{
 			//todo W5
 			const Vector3 a = triangle.v1 - triangle.v0;
@@ -149,30 +478,16 @@ namespace dae
 			const float nv = Vector3::Dot(n, ray.direction);
 
 			if (AreEqual(nv, 0)) return false;
-
-			const int Direction = (ignoreHitRecord) ? 1 : -1;
-
-			switch (triangle.cullMode)
-			{
-			case TriangleCullMode::FrontFaceCulling:
-				if (nv * Direction > 0) { return false; }
-				break;
-			case TriangleCullMode::BackFaceCulling:
-				if (nv * Direction < 0) { return false; }
-				break;
-			case TriangleCullMode::NoCulling:
-				break;
-
-			}
+			if (IsCulled<CullMode, Query>(nv)) return false;
 
 			const Vector3 L = triangle.v0 - ray.origin;
 
-			const float t = Vector3::Dot(L,n) / nv;
+			t = Vector3::Dot(L,n) / nv;
 			if (t < ray.min || t > ray.max) return false;
 
 			const Vector3 P = ray.origin + ray.direction * t;
 
-#ifdef USE_SIMD_OP
+#ifdef DAE_SIMD_SSE41
 			if (!CalculateVerticesSIMD(P, n, triangle.v0, triangle.v1, triangle.v2)) return false;
 #else
 			const Vector3 e0 = triangle.v1 - triangle.v0;
@@ -186,103 +501,952 @@ namespace dae
 			const Vector3 e2 = triangle.v0 - triangle.v2;
 			const Vector3 p2 = P - triangle.v2;
 			if (Vector3::Dot(Vector3::Cross(e2, p2), n) < 0) return false;
-#endif 
-			 
+#endif
 
-			
+			return true;
+		}
 
-			if (!ignoreHitRecord)
-			{
-				hitRecord.didHit = true;
-				hitRecord.materialIndex = triangle.materialIndex;
-				hitRecord.normal = n;
-				hitRecord.origin = P;
-				hitRecord.t = t;
+		//Same normal and hit point as the test above, rebuilt from t
+		inline HitRecord GetHitRecord(const Triangle& triangle, const Ray& ray, float t)
+		{
+			HitRecord hitRecord{};
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = triangle.materialIndex;
+			hitRecord.normal = Vector3::Cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0).Normalized();
+			hitRecord.origin = ray.origin + ray.direction * t;
+			hitRecord.t = t;
 
-			}
+			return hitRecord;
+		}
+
+		template<TriangleCullMode CullMode, HitQuery Query>
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord)
+		{
+			float t{};
+			if (!HitTest_Triangle<CullMode, Query>(triangle, ray, t)) return false;
+			if constexpr (Query == HitQuery::Closest) hitRecord = GetHitRecord(triangle, ray, t);
+
+			return true;
+		}
+
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, float& t)
+		{
+			return DispatchCullMode(triangle.cullMode, [&](auto cullModeConstant)
+				{
+					return HitTest_Triangle<decltype(cullModeConstant)::value, HitQuery::Closest>(triangle, ray, t);
+				});
+		}
+
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			return DispatchCullMode(triangle.cullMode, [&](auto cullModeConstant)
+				{
+					constexpr TriangleCullMode CullMode{ decltype(cullModeConstant)::value };
+					return (ignoreHitRecord)
+						? HitTest_Triangle<CullMode, HitQuery::Any>(triangle, ray, hitRecord)
+						: HitTest_Triangle<CullMode, HitQuery::Closest>(triangle, ray, hitRecord);
+				});
+		}
+
+		//Any-hit test for shadow rays. The normal is never normalized, t and the edge signs do not depend on its length.
+		//Culls the same faces as HitQuery::Any above
+		template<TriangleCullMode CullMode>
+		inline bool HitTest_Triangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const Ray& ray)
+		{
+			const Vector3 n = Vector3::Cross(v1 - v0, v2 - v0);
+			const float nv = Vector3::Dot(n, ray.direction);
+
+			//same parallel threshold as the normalized test
+			if (nv * nv < FLT_EPSILON * FLT_EPSILON * n.SqrMagnitude()) return false;
+			if (IsCulled<CullMode, HitQuery::Any>(nv)) return false;
+
+			const float t = Vector3::Dot(v0 - ray.origin, n) / nv;
+			if (t < ray.min || t > ray.max) return false;
+
+			const Vector3 P = ray.origin + ray.direction * t;
+			if (Vector3::Dot(Vector3::Cross(v1 - v0, P - v0), n) < 0) return false;
+			if (Vector3::Dot(Vector3::Cross(v2 - v1, P - v1), n) < 0) return false;
+			if (Vector3::Dot(Vector3::Cross(v0 - v2, P - v2), n) < 0) return false;
 
 			return true;
 		}
 
 		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Triangle(triangle, ray, temp, true);
+			return DispatchCullMode(triangle.cullMode, [&](auto cullModeConstant)
+				{
+					return HitTest_Triangle<decltype(cullModeConstant)::value>(triangle.v0, triangle.v1, triangle.v2, ray);
+				});
+		}
+
+		//Moller-Trumbore on a precomputed record, no sqrt and no normal per test. Writes t on a hit within the ray.
+		//Culling and the parallel check use the stored normal exactly like the tests above, shadow rays cull the opposite faces
+		template<TriangleCullMode CullMode, HitQuery Query>
+		inline bool HitTest_TriangleRecord(const TriangleRecord& triangle, const Ray& ray, float& t)
+		{
+			const float nv = Vector3::Dot(triangle.normal, ray.direction);
+			if (AreEqual(nv, 0)) return false;
+			if (IsCulled<CullMode, Query>(nv)) return false;
+
+			const Vector3 p = Vector3::Cross(ray.direction, triangle.edge2);
+			const float invDeterminant = 1.f / Vector3::Dot(triangle.edge1, p);
+
+			const Vector3 s = ray.origin - triangle.v0;
+			const float u = Vector3::Dot(s, p) * invDeterminant;
+			if (u < 0.f || u > 1.f) return false;
+
+			const Vector3 q = Vector3::Cross(s, triangle.edge1);
+			const float v = Vector3::Dot(ray.direction, q) * invDeterminant;
+			if (v < 0.f || u + v > 1.f) return false;
+
+			t = Vector3::Dot(triangle.edge2, q) * invDeterminant;
+			return ray.min <= t && t <= ray.max;
+		}
+
+		inline bool HitTest_TriangleRecord(const TriangleRecord& triangle, TriangleCullMode cullMode, const Ray& ray, bool ignoreHitRecord, float& t)
+		{
+			return DispatchCullMode(cullMode, [&](auto cullModeConstant)
+				{
+					constexpr TriangleCullMode CullMode{ decltype(cullModeConstant)::value };
+					return (ignoreHitRecord)
+						? HitTest_TriangleRecord<CullMode, HitQuery::Any>(triangle, ray, t)
+						: HitTest_TriangleRecord<CullMode, HitQuery::Closest>(triangle, ray, t);
+				});
+		}
+
+		//HitTest_TriangleRecord on the lanes of activeMask at once. Returns the lanes hit within the ray and writes their t
+		template<TriangleCullMode CullMode, HitQuery Query>
+		inline uint32_t HitTest_TrianglePacket(const TrianglePacket8& packet, uint32_t activeMask, const Ray& ray, float* distances)
+		{
+#ifdef __AVX2__
+			const __m256 directionX = _mm256_set1_ps(ray.direction.x);
+			const __m256 directionY = _mm256_set1_ps(ray.direction.y);
+			const __m256 directionZ = _mm256_set1_ps(ray.direction.z);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.f);
+
+			//parallel rays and culled faces, the sign flips for shadow rays
+			const __m256 nv = _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_load_ps(packet.normalX), directionX),
+				_mm256_mul_ps(_mm256_load_ps(packet.normalY), directionY)),
+				_mm256_mul_ps(_mm256_load_ps(packet.normalZ), directionZ));
+			const __m256 absNv = _mm256_andnot_ps(_mm256_set1_ps(-0.f), nv);
+			__m256 valid = _mm256_cmp_ps(absNv, _mm256_set1_ps(FLT_EPSILON), _CMP_GE_OQ);
+
+			if constexpr (CullMode != TriangleCullMode::NoCulling)
+			{
+				const __m256 facing = (Query == HitQuery::Any) ? nv : _mm256_sub_ps(zero, nv);
+				constexpr int keep{ (CullMode == TriangleCullMode::FrontFaceCulling) ? _CMP_LE_OQ : _CMP_GE_OQ };
+				valid = _mm256_and_ps(valid, _mm256_cmp_ps(facing, zero, keep));
+			}
+
+			const __m256 edge1X = _mm256_load_ps(packet.edge1X);
+			const __m256 edge1Y = _mm256_load_ps(packet.edge1Y);
+			const __m256 edge1Z = _mm256_load_ps(packet.edge1Z);
+			const __m256 edge2X = _mm256_load_ps(packet.edge2X);
+			const __m256 edge2Y = _mm256_load_ps(packet.edge2Y);
+			const __m256 edge2Z = _mm256_load_ps(packet.edge2Z);
+
+			//p = direction x edge2
+			const __m256 pX = _mm256_sub_ps(_mm256_mul_ps(directionY, edge2Z), _mm256_mul_ps(directionZ, edge2Y));
+			const __m256 pY = _mm256_sub_ps(_mm256_mul_ps(directionZ, edge2X), _mm256_mul_ps(directionX, edge2Z));
+			const __m256 pZ = _mm256_sub_ps(_mm256_mul_ps(directionX, edge2Y), _mm256_mul_ps(directionY, edge2X));
+			const __m256 determinant = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge1X, pX), _mm256_mul_ps(edge1Y, pY)), _mm256_mul_ps(edge1Z, pZ));
+			const __m256 invDeterminant = _mm256_div_ps(one, determinant);
+
+			const __m256 sX = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(packet.v0X));
+			const __m256 sY = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(packet.v0Y));
+			const __m256 sZ = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(packet.v0Z));
+			const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sX, pX), _mm256_mul_ps(sY, pY)), _mm256_mul_ps(sZ, pZ)), invDeterminant);
+
+			//q = s x edge1
+			const __m256 qX = _mm256_sub_ps(_mm256_mul_ps(sY, edge1Z), _mm256_mul_ps(sZ, edge1Y));
+			const __m256 qY = _mm256_sub_ps(_mm256_mul_ps(sZ, edge1X), _mm256_mul_ps(sX, edge1Z));
+			const __m256 qZ = _mm256_sub_ps(_mm256_mul_ps(sX, edge1Y), _mm256_mul_ps(sY, edge1X));
+			const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, qX), _mm256_mul_ps(directionY, qY)), _mm256_mul_ps(directionZ, qZ)), invDeterminant);
+			const __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge2X, qX), _mm256_mul_ps(edge2Y, qY)), _mm256_mul_ps(edge2Z, qZ)), invDeterminant);
+
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(ray.min), _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(ray.max), _CMP_LE_OQ));
+
+			_mm256_store_ps(distances, t);
+			return static_cast<uint32_t>(_mm256_movemask_ps(valid)) & activeMask;
+#else
+			uint32_t hitMask{ 0 };
+			while (activeMask)
+			{
+				const int lane = std::countr_zero(activeMask);
+				activeMask &= activeMask - 1;
+
+				const TriangleRecord triangle{
+					Vector3{ packet.v0X[lane], packet.v0Y[lane], packet.v0Z[lane] },
+					Vector3{ packet.edge1X[lane], packet.edge1Y[lane], packet.edge1Z[lane] },
+					Vector3{ packet.edge2X[lane], packet.edge2Y[lane], packet.edge2Z[lane] },
+					Vector3{ packet.normalX[lane], packet.normalY[lane], packet.normalZ[lane] } };
+				if (HitTest_TriangleRecord<CullMode, Query>(triangle, ray, distances[lane])) hitMask |= 1u << lane;
+			}
+			return hitMask;
+#endif
+		}
+
+		inline uint32_t HitTest_TrianglePacket(const TrianglePacket8& packet, uint32_t activeMask, TriangleCullMode cullMode, const Ray& ray, bool ignoreHitRecord, float* distances)
+		{
+			return DispatchCullMode(cullMode, [&](auto cullModeConstant)
+				{
+					constexpr TriangleCullMode CullMode{ decltype(cullModeConstant)::value };
+					return (ignoreHitRecord)
+						? HitTest_TrianglePacket<CullMode, HitQuery::Any>(packet, activeMask, ray, distances)
+						: HitTest_TrianglePacket<CullMode, HitQuery::Closest>(packet, activeMask, ray, distances);
+				});
 		}
 #pragma endregion
 #pragma region TriangeMesh HitTest
 
-		inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		//Tests the ray against the 8 child boxes of a wide node within [ray.min, ray.max].
+		//Returns one bit per hit slot and writes the entry distance of every slot, unused slots are inverted and always miss.
+		//A NaN plane distance (ray on a box face with a zero direction component) is ignored the same way in both paths
+		//The near and far plane of every axis come from the sign bits the ray was made with
+		inline uint32_t SlabTest_BVH8Bounds(const BVH8Bounds& bounds, const Ray& ray, float* distances)
 		{
-			float tx1 = (mesh.transformedMinAABB.x - ray.origin.x) / ray.direction.x;
-			float tx2 = (mesh.transformedMaxAABB.x - ray.origin.x) / ray.direction.x;
+			const float* nearX = ray.negativeX ? bounds.maxX : bounds.minX;
+			const float* nearY = ray.negativeY ? bounds.maxY : bounds.minY;
+			const float* nearZ = ray.negativeZ ? bounds.maxZ : bounds.minZ;
+			const float* farX = ray.negativeX ? bounds.minX : bounds.maxX;
+			const float* farY = ray.negativeY ? bounds.minY : bounds.maxY;
+			const float* farZ = ray.negativeZ ? bounds.minZ : bounds.maxZ;
+
+#ifdef __AVX2__
+			const __m256 originX = _mm256_set1_ps(ray.origin.x);
+			const __m256 originY = _mm256_set1_ps(ray.origin.y);
+			const __m256 originZ = _mm256_set1_ps(ray.origin.z);
+			const __m256 invDirectionX = _mm256_set1_ps(ray.invDirection.x);
+			const __m256 invDirectionY = _mm256_set1_ps(ray.invDirection.y);
+			const __m256 invDirectionZ = _mm256_set1_ps(ray.invDirection.z);
+
+			//max/min return their second operand when one is NaN, so the ray interval always goes second
+			__m256 tmin = _mm256_set1_ps(ray.min);
+			tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearZ), originZ), invDirectionZ), tmin);
+			tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearY), originY), invDirectionY), tmin);
+			tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearX), originX), invDirectionX), tmin);
+
+			__m256 tmax = _mm256_set1_ps(ray.max);
+			tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farZ), originZ), invDirectionZ), tmax);
+			tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farY), originY), invDirectionY), tmax);
+			tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farX), originX), invDirectionX), tmax);
+
+			_mm256_store_ps(distances, tmin);
+			return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ)));
+#else
+			uint32_t hitMask{ 0 };
+			for (int slot{ 0 }; slot < BVH::WIDTH; ++slot)
+			{
+				float tmin = ray.min;
+				tmin = std::max(tmin, (nearZ[slot] - ray.origin.z) * ray.invDirection.z);
+				tmin = std::max(tmin, (nearY[slot] - ray.origin.y) * ray.invDirection.y);
+				tmin = std::max(tmin, (nearX[slot] - ray.origin.x) * ray.invDirection.x);
+
+				float tmax = ray.max;
+				tmax = std::min(tmax, (farZ[slot] - ray.origin.z) * ray.invDirection.z);
+				tmax = std::min(tmax, (farY[slot] - ray.origin.y) * ray.invDirection.y);
+				tmax = std::min(tmax, (farX[slot] - ray.origin.x) * ray.invDirection.x);
+
+				distances[slot] = tmin;
+				if (tmin <= tmax) hitMask |= 1u << slot;
+			}
+			return hitMask;
+#endif
+		}
 
-			float tmin = std::min(tx1, tx2);
-			float tmax = std::max(tx1, tx2);
+		//Decodes the grid coordinates of one axis, q * 2^exponent is exact so the result matches the encoder bit for bit
+		template<typename Quantized>
+		inline void DecodeQuantizedAxis(const Quantized* quantized, float origin, int8_t exponent, float* decoded)
+		{
+			const float scale = GetQuantizedScale(exponent);
+#ifdef __AVX2__
+			__m256i quantizedInts;
+			if constexpr (sizeof(Quantized) == 1)
+				quantizedInts = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(quantized)));
+			else
+				quantizedInts = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(quantized)));
+
+			_mm256_store_ps(decoded, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(quantizedInts), _mm256_set1_ps(scale)), _mm256_set1_ps(origin)));
+#else
+			for (int slot{ 0 }; slot < BVH::WIDTH; ++slot)
+			{
+				decoded[slot] = origin + quantized[slot] * scale;
+			}
+#endif
+		}
 
-			float ty1 = (mesh.transformedMinAABB.y - ray.origin.y) / ray.direction.y;
-			float ty2 = (mesh.transformedMaxAABB.y - ray.origin.y) / ray.direction.y;
+		//Child bounds and slot contents for both node layouts, so one traversal serves all of them
+		inline const BVH8Bounds& GetBVH8Bounds(const BVH8Node& node, BVH8Bounds&)
+		{
+			return node.bounds;
+		}
 
-			tmin = std::min(tmin, std::min(ty1, ty2));
-			tmax = std::max(tmax, std::max(ty1, ty2));
+		template<typename Quantized>
+		inline const BVH8Bounds& GetBVH8Bounds(const BVH8QuantizedNode<Quantized>& node, BVH8Bounds& decoded)
+		{
+			DecodeQuantizedAxis(node.qMinX, node.origin.x, node.exponent[0], decoded.minX);
+			DecodeQuantizedAxis(node.qMinY, node.origin.y, node.exponent[1], decoded.minY);
+			DecodeQuantizedAxis(node.qMinZ, node.origin.z, node.exponent[2], decoded.minZ);
+			DecodeQuantizedAxis(node.qMaxX, node.origin.x, node.exponent[0], decoded.maxX);
+			DecodeQuantizedAxis(node.qMaxY, node.origin.y, node.exponent[1], decoded.maxY);
+			DecodeQuantizedAxis(node.qMaxZ, node.origin.z, node.exponent[2], decoded.maxZ);
+			return decoded;
+		}
 
-			float tz1 = (mesh.transformedMinAABB.z - ray.origin.z) / ray.direction.z;
-			float tz2 = (mesh.transformedMaxAABB.z - ray.origin.z) / ray.direction.z;
+		inline void GetBVH8Slot(const BVH8Node& node, int slot, uint32_t& childIndex, uint32_t& primitiveCount)
+		{
+			childIndex = node.childIndex[slot];
+			primitiveCount = node.primitiveCount[slot];
+		}
 
-			tmin = std::min(tmin, std::min(tz1, tz2));
-			tmax = std::max(tmax, std::max(tz1, tz2));
+		template<typename Quantized>
+		inline void GetBVH8Slot(const BVH8QuantizedNode<Quantized>& node, int slot, uint32_t& childIndex, uint32_t& primitiveCount)
+		{
+			if (node.interiorMask & (1 << slot))
+			{
+				childIndex = node.childBase + node.meta[slot];
+				primitiveCount = 0;
+				return;
+			}
 
-			return (tmax > 0 && tmax >= tmin);
+			//the leaf primitives start after the ones of the leaf slots before this one
+			childIndex = node.primitiveBase;
+			for (int previousSlot{ 0 }; previousSlot < slot; ++previousSlot)
+			{
+				if (!(node.interiorMask & (1 << previousSlot))) childIndex += node.meta[previousSlot];
+			}
+			primitiveCount = node.meta[slot];
 		}
 
-
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//The primitive positions of one hit leaf slot, in primitive order of the hierarchy
+		struct BVH8LeafRange
 		{
+			uint32_t first;
+			uint32_t count;
+			float distance;
+		};
+
+		//Walks the 8-wide hierarchy nearest child first. The hit leaf slots of a node are handed to leafTest(leaves, leafCount, ray)
+		//together, nearest first, instead of going through the stack. They are stored next to each other, so a packet test can take
+		//them all at once. leafTest may shrink ray.max to cull everything behind a hit and returns true to end the traversal early
+		template<typename Node, typename LeafTest>
+		inline void Traverse_BVH8(std::span<const Node> nodes, Ray& ray, LeafTest& leafTest)
+		{
+			if (nodes.empty()) return;
 
-			if (!SlabTest_TriangleMesh(mesh,ray))
+			struct StackEntry
 			{
-				return false;
+				uint32_t nodeIdx;
+				float distance;
+			};
+
+			//every level pushes at most WIDTH - 1 entries on top of the one it continues with
+			StackEntry stack[(BVH::MAX_DEPTH + 1) * BVH::WIDTH];
+			int stackSize{ 0 };
+			BVH8Bounds decodedBounds;
+			alignas(32) float distances[BVH::WIDTH];
+			BVH8LeafRange leaves[BVH::WIDTH];
+			uint32_t nodeIdx{ 0 };
+
+			while (true)
+			{
+				const Node& node = nodes[nodeIdx];
+				uint32_t hitMask = SlabTest_BVH8Bounds(GetBVH8Bounds(node, decodedBounds), ray, distances);
+
+				//insert the hit children sorted, the nearest interior one ends up on top of the stack and the nearest leaf first
+				const int firstEntry{ stackSize };
+				int leafCount{ 0 };
+				while (hitMask)
+				{
+					const int slot = std::countr_zero(hitMask);
+					hitMask &= hitMask - 1;
+
+					uint32_t childIndex, primitiveCount;
+					GetBVH8Slot(node, slot, childIndex, primitiveCount);
+
+					if (primitiveCount > 0)
+					{
+						const BVH8LeafRange leaf{ childIndex, primitiveCount, distances[slot] };
+						int leafIdx{ leafCount++ };
+						while (leafIdx > 0 && leaves[leafIdx - 1].distance > leaf.distance)
+						{
+							leaves[leafIdx] = leaves[leafIdx - 1];
+							--leafIdx;
+						}
+						leaves[leafIdx] = leaf;
+						continue;
+					}
+
+					const StackEntry entry{ childIndex, distances[slot] };
+					int entryIdx{ stackSize++ };
+					while (entryIdx > firstEntry && stack[entryIdx - 1].distance < entry.distance)
+					{
+						stack[entryIdx] = stack[entryIdx - 1];
+						--entryIdx;
+					}
+					stack[entryIdx] = entry;
+				}
+
+				if (leafCount > 0 && leafTest(static_cast<const BVH8LeafRange*>(leaves), leafCount, ray)) return;
+
+				//entries pushed before a closer hit shrank the ray are skipped here
+				do
+				{
+					if (stackSize == 0) return;
+					--stackSize;
+				} while (stack[stackSize].distance > ray.max);
+
+				nodeIdx = stack[stackSize].nodeIdx;
 			}
+		}
 
-			Triangle CurrentTri{};
-			HitRecord tempHit{};
-			
-			for (size_t idx{0}; idx < mesh.indices.size(); idx += 3)
+		//Same walk with the leaf ranges of every node, for the packet tests
+		template<typename LeafTest>
+		inline void Traverse_BVHLeaves(const BVH& bvh, Ray& ray, LeafTest&& leafTest)
+		{
+			switch (bvh.GetNodeFormat())
 			{
-				
-				CurrentTri = { mesh.transformedPositions[mesh.indices[idx]],mesh.transformedPositions[mesh.indices[idx + 1]],mesh.transformedPositions[mesh.indices[idx + 2]] };
-				CurrentTri.normal = mesh.transformedNormals[mesh.indices[idx/3]];
-				CurrentTri.cullMode = mesh.cullMode;
-				CurrentTri.materialIndex = mesh.materialIndex;
+			case BVHNodeFormat::Full:
+				Traverse_BVH8(bvh.GetWideNodes(), ray, leafTest);
+				break;
+			case BVHNodeFormat::Quantized16:
+				Traverse_BVH8(bvh.GetQuantizedNodes16(), ray, leafTest);
+				break;
+			case BVHNodeFormat::Quantized8:
+				Traverse_BVH8(bvh.GetQuantizedNodes8(), ray, leafTest);
+				break;
+			}
+		}
 
-				if (HitTest_Triangle(CurrentTri, ray, tempHit, ignoreHitRecord))
+		//leafTest(primitiveIdx, ray) runs for every primitive of a reached leaf, with the same early out as above
+		template<typename LeafTest>
+		inline void Traverse_BVH(const BVH& bvh, Ray& ray, LeafTest&& leafTest)
+		{
+			const std::span<const uint32_t> primitiveIndices = bvh.GetPrimitiveIndices();
+			Traverse_BVHLeaves(bvh, ray, [&](const BVH8LeafRange* leaves, int leafCount, Ray& currentRay)
 				{
-					if (ignoreHitRecord)
+					for (int leafIdx{ 0 }; leafIdx < leafCount; ++leafIdx)
 					{
-						return true;
+						const BVH8LeafRange& leaf = leaves[leafIdx];
+						if (leaf.distance > currentRay.max) continue;
+
+						for (uint32_t i{ 0 }; i < leaf.count; ++i)
+						{
+							if (leafTest(primitiveIndices[leaf.first + i], currentRay)) return true;
+						}
 					}
+					return false;
+				});
+		}
 
-					if (tempHit.t < hitRecord.t)
+		//The leaf ranges of one node within reach, sorted by their first primitive and split into groups that share no packet
+		struct LeafPacketGroups
+		{
+			int order[BVH::WIDTH];
+			int groupEnds[BVH::WIDTH]; // one past the last entry of order in each group
+			uint32_t firstPackets[BVH::WIDTH];
+			uint32_t endPackets[BVH::WIDTH];
+			int groupCount;
+		};
+
+		inline LeafPacketGroups GroupLeafPackets(const BVH8LeafRange* leaves, int leafCount, float maxDistance)
+		{
+			constexpr uint32_t packetWidth{ TrianglePacket8::WIDTH };
+
+			LeafPacketGroups groups;
+			int orderCount{ 0 };
+			for (int leafIdx{ 0 }; leafIdx < leafCount; ++leafIdx)
+			{
+				if (leaves[leafIdx].distance > maxDistance) continue;
+
+				int orderIdx{ orderCount++ };
+				while (orderIdx > 0 && leaves[groups.order[orderIdx - 1]].first > leaves[leafIdx].first)
+				{
+					groups.order[orderIdx] = groups.order[orderIdx - 1];
+					--orderIdx;
+				}
+				groups.order[orderIdx] = leafIdx;
+			}
+
+			//a group grows while the next range starts in its last packet
+			groups.groupCount = 0;
+			for (int orderIdx{ 0 }; orderIdx < orderCount; ++orderIdx)
+			{
+				const BVH8LeafRange& leaf = leaves[groups.order[orderIdx]];
+				const uint32_t firstPacket{ leaf.first / packetWidth };
+				const uint32_t endPacket{ (leaf.first + leaf.count + packetWidth - 1) / packetWidth };
+
+				const int groupIdx{ groups.groupCount - 1 };
+				if (groupIdx >= 0 && firstPacket < groups.endPackets[groupIdx])
+				{
+					groups.endPackets[groupIdx] = std::max(groups.endPackets[groupIdx], endPacket);
+					groups.groupEnds[groupIdx] = orderIdx + 1;
+					continue;
+				}
+
+				groups.firstPackets[groups.groupCount] = firstPacket;
+				groups.endPackets[groups.groupCount] = endPacket;
+				groups.groupEnds[groups.groupCount] = orderIdx + 1;
+				++groups.groupCount;
+			}
+			return groups;
+		}
+
+		//Splits the leaf ranges of one node into lane masks per triangle packet and calls packetTest(packetIdx, activeMask, ray)
+		//for each, with the same early out. Only the packets of each group are walked, so a leaf appended at the end of the
+		//primitives does not drag in every packet between it and its siblings
+		template<typename PacketTest>
+		inline bool ForEachLeafPacket(const BVH8LeafRange* leaves, int leafCount, Ray& ray, PacketTest& packetTest)
+		{
+			constexpr uint32_t packetWidth{ TrianglePacket8::WIDTH };
+
+			//the leaves come nearest first, the packets are walked in storage order
+			const LeafPacketGroups groups{ GroupLeafPackets(leaves, leafCount, ray.max) };
+			int groupFirst{ 0 };
+			for (int groupIdx{ 0 }; groupIdx < groups.groupCount; ++groupIdx)
+			{
+				for (uint32_t packetIdx{ groups.firstPackets[groupIdx] }; packetIdx < groups.endPackets[groupIdx]; ++packetIdx)
+				{
+					const uint32_t packetFirst{ packetIdx * packetWidth };
+					uint32_t activeMask{ 0 };
+					for (int orderIdx{ groupFirst }; orderIdx < groups.groupEnds[groupIdx]; ++orderIdx)
 					{
-						hitRecord = tempHit;
+						const BVH8LeafRange& leaf = leaves[groups.order[orderIdx]];
+						if (leaf.distance > ray.max) continue;
+
+						const uint32_t rangeFirst = std::max(leaf.first, packetFirst);
+						const uint32_t rangeLast = std::min(leaf.first + leaf.count, packetFirst + packetWidth);
+						if (rangeFirst >= rangeLast) continue;
+
+						activeMask |= ((1u << (rangeLast - rangeFirst)) - 1) << (rangeFirst - packetFirst);
 					}
+
+					if (activeMask && packetTest(packetIdx, activeMask, ray)) return true;
 				}
+				groupFirst = groups.groupEnds[groupIdx];
 			}
+			return false;
+		}
 
+		//The direction is not normalized after the transform, so t means the same in object and world space
+		inline Ray GetObjectRay(const TriangleMesh& mesh, const Ray& ray)
+		{
+			return Ray{ mesh.inverseTransform.TransformPoint(ray.origin), mesh.inverseTransform.TransformVector(ray.direction), ray.min, ray.max };
+		}
 
-			return hitRecord.didHit;
+		//Tests a single triangle of the mesh against an object space ray without a hit record
+		inline bool HitTest_MeshTriangle(const TriangleMesh& mesh, uint32_t triIdx, const Ray& objectRay)
+		{
+			float t;
+			return DispatchCullMode(mesh.cullMode, [&](auto cullModeConstant)
+				{
+					return HitTest_TriangleRecord<decltype(cullModeConstant)::value, HitQuery::Any>(mesh.triangleRecords[triIdx], objectRay, t);
+				});
 		}
 
-		
+		//Any-hit test for shadow rays, stops at the first triangle in range and hands it back so it can be tried first next time
+		template<TriangleCullMode CullMode>
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, uint32_t& occluderIdx)
+		{
+			bool didHit{ false };
+			Ray objectRay{ GetObjectRay(mesh, ray) };
+			auto packetTest = [&](uint32_t packetIdx, uint32_t activeMask, Ray& currentRay)
+				{
+					const TrianglePacket8& packet = mesh.trianglePackets[packetIdx];
+					alignas(32) float distances[TrianglePacket8::WIDTH];
+					const uint32_t hitMask = HitTest_TrianglePacket<CullMode, HitQuery::Any>(packet, activeMask, currentRay, distances);
+					if (!hitMask) return false;
+
+					occluderIdx = packet.triangleIdx[std::countr_zero(hitMask)];
+					didHit = true;
+					return true;
+				};
+
+			Traverse_BVHLeaves(mesh.bvh, objectRay, [&](const BVH8LeafRange* leaves, int leafCount, Ray& currentRay)
+				{
+					return ForEachLeafPacket(leaves, leafCount, currentRay, packetTest);
+				});
+
+			return didHit;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, uint32_t& occluderIdx)
+		{
+			return DispatchCullMode(mesh.cullMode, [&](auto cullModeConstant)
+				{
+					return HitTest_TriangleMesh<decltype(cullModeConstant)::value>(mesh, ray, occluderIdx);
+				});
+		}
 
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_TriangleMesh(mesh, ray, temp, true);
+			uint32_t occluderIdx{};
+			return HitTest_TriangleMesh(mesh, ray, occluderIdx);
+		}
+
+		//Closest hit within the ray, writes its t and the triangle hit. GetHitRecord fills in the rest for the final hit
+		template<TriangleCullMode CullMode>
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, float& t, uint32_t& triangleIdx)
+		{
+			bool didHit{ false };
+
+			//max shrinks to the closest hit so far, so every node behind it gets culled
+			Ray objectRay{ GetObjectRay(mesh, ray) };
+			auto packetTest = [&](uint32_t packetIdx, uint32_t activeMask, Ray& currentRay)
+				{
+					const TrianglePacket8& packet = mesh.trianglePackets[packetIdx];
+					alignas(32) float distances[TrianglePacket8::WIDTH];
+					uint32_t hitMask = HitTest_TrianglePacket<CullMode, HitQuery::Closest>(packet, activeMask, currentRay, distances);
+
+					//every lane hit lies within the ray, the nearest of them is the new closest hit
+					while (hitMask)
+					{
+						const int lane = std::countr_zero(hitMask);
+						hitMask &= hitMask - 1;
+						if (distances[lane] > currentRay.max) continue;
+
+						didHit = true;
+						triangleIdx = packet.triangleIdx[lane];
+						currentRay.max = distances[lane];
+					}
+					return false;
+				};
+
+			Traverse_BVHLeaves(mesh.bvh, objectRay, [&](const BVH8LeafRange* leaves, int leafCount, Ray& currentRay)
+				{
+					return ForEachLeafPacket(leaves, leafCount, currentRay, packetTest);
+				});
+
+			//t means the same in object and world space, see GetObjectRay
+			if (didHit) t = objectRay.max;
+			return didHit;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, float& t, uint32_t& triangleIdx)
+		{
+			return DispatchCullMode(mesh.cullMode, [&](auto cullModeConstant)
+				{
+					return HitTest_TriangleMesh<decltype(cullModeConstant)::value>(mesh, ray, t, triangleIdx);
+				});
 		}
 
-		
+		//Only the closest hit is brought back to world space
+		inline HitRecord GetHitRecord(const TriangleMesh& mesh, uint32_t triangleIdx, const Ray& ray, float t)
+		{
+			HitRecord hitRecord{};
+			hitRecord.t = t;
+			hitRecord.origin = ray.origin + ray.direction * hitRecord.t;
+			hitRecord.normal = mesh.TransformNormal(mesh.triangleRecords[triangleIdx].normal);
+			hitRecord.materialIndex = mesh.materialIndex;
+			hitRecord.didHit = true;
+
+			return hitRecord;
+		}
 
+		template<TriangleCullMode CullMode>
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord)
+		{
+			hitRecord = HitRecord{};
+
+			float t{};
+			uint32_t triangleIdx{};
+			if (!HitTest_TriangleMesh<CullMode>(mesh, ray, t, triangleIdx)) return false;
+
+			hitRecord = GetHitRecord(mesh, triangleIdx, ray, t);
+			return true;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (ignoreHitRecord)
+			{
+				hitRecord = HitRecord{};
+				return HitTest_TriangleMesh(mesh, ray);
+			}
+
+			return DispatchCullMode(mesh.cullMode, [&](auto cullModeConstant)
+				{
+					return HitTest_TriangleMesh<decltype(cullModeConstant)::value>(mesh, ray, hitRecord);
+				});
+		}
+
+
+#pragma endregion
+#pragma region Packet HitTest
+
+		//Tests every active ray of the packet against one child box of a wide node, with the same near plane choice and NaN
+		//handling as SlabTest_BVH8Bounds. Returns the lanes that hit it and writes the nearest entry distance over those lanes
+		inline uint32_t SlabTest_Packet(const BVH8Bounds& bounds, int slot, const RayPacket8& packet, uint32_t activeMask, float& nearest)
+		{
+			alignas(32) float distances[RayPacket8::WIDTH];
+#ifdef __AVX2__
+			const __m256 invDirectionX = _mm256_load_ps(packet.invDirectionX);
+			const __m256 invDirectionY = _mm256_load_ps(packet.invDirectionY);
+			const __m256 invDirectionZ = _mm256_load_ps(packet.invDirectionZ);
+
+			//blendv picks on the sign bit, so negative inverse directions take the max plane as near plane
+			const __m256 minX = _mm256_set1_ps(bounds.minX[slot]), maxX = _mm256_set1_ps(bounds.maxX[slot]);
+			const __m256 minY = _mm256_set1_ps(bounds.minY[slot]), maxY = _mm256_set1_ps(bounds.maxY[slot]);
+			const __m256 minZ = _mm256_set1_ps(bounds.minZ[slot]), maxZ = _mm256_set1_ps(bounds.maxZ[slot]);
+			const __m256 originX = _mm256_load_ps(packet.originX);
+			const __m256 originY = _mm256_load_ps(packet.originY);
+			const __m256 originZ = _mm256_load_ps(packet.originZ);
+
+			__m256 tmin = _mm256_load_ps(packet.min);
+			tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_blendv_ps(minZ, maxZ, invDirectionZ), originZ), invDirectionZ), tmin);
+			tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_blendv_ps(minY, maxY, invDirectionY), originY), invDirectionY), tmin);
+			tmin = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_blendv_ps(minX, maxX, invDirectionX), originX), invDirectionX), tmin);
+
+			__m256 tmax = _mm256_load_ps(packet.max);
+			tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_blendv_ps(maxZ, minZ, invDirectionZ), originZ), invDirectionZ), tmax);
+			tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_blendv_ps(maxY, minY, invDirectionY), originY), invDirectionY), tmax);
+			tmax = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_blendv_ps(maxX, minX, invDirectionX), originX), invDirectionX), tmax);
+
+			_mm256_store_ps(distances, tmin);
+			uint32_t hitMask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ))) & activeMask;
+#else
+			uint32_t hitMask{ 0 };
+			for (uint32_t laneMask{ activeMask }; laneMask; laneMask &= laneMask - 1)
+			{
+				const int lane = std::countr_zero(laneMask);
+				const bool negativeX{ packet.invDirectionX[lane] < 0.f }, negativeY{ packet.invDirectionY[lane] < 0.f }, negativeZ{ packet.invDirectionZ[lane] < 0.f };
+
+				float tmin = packet.min[lane];
+				tmin = std::max(tmin, ((negativeZ ? bounds.maxZ[slot] : bounds.minZ[slot]) - packet.originZ[lane]) * packet.invDirectionZ[lane]);
+				tmin = std::max(tmin, ((negativeY ? bounds.maxY[slot] : bounds.minY[slot]) - packet.originY[lane]) * packet.invDirectionY[lane]);
+				tmin = std::max(tmin, ((negativeX ? bounds.maxX[slot] : bounds.minX[slot]) - packet.originX[lane]) * packet.invDirectionX[lane]);
+
+				float tmax = packet.max[lane];
+				tmax = std::min(tmax, ((negativeZ ? bounds.minZ[slot] : bounds.maxZ[slot]) - packet.originZ[lane]) * packet.invDirectionZ[lane]);
+				tmax = std::min(tmax, ((negativeY ? bounds.minY[slot] : bounds.maxY[slot]) - packet.originY[lane]) * packet.invDirectionY[lane]);
+				tmax = std::min(tmax, ((negativeX ? bounds.minX[slot] : bounds.maxX[slot]) - packet.originX[lane]) * packet.invDirectionX[lane]);
+
+				distances[lane] = tmin;
+				if (tmin <= tmax) hitMask |= 1u << lane;
+			}
+#endif
+			nearest = FLT_MAX;
+			for (uint32_t laneMask{ hitMask }; laneMask; laneMask &= laneMask - 1)
+			{
+				nearest = std::min(nearest, distances[std::countr_zero(laneMask)]);
+			}
+			return hitMask;
+		}
+
+		//Walks the 8-wide hierarchy once for the whole packet instead of once per ray. Every child box is tested against the
+		//active rays and only entered with the lanes that hit it, nearest first by the closest lane.
+		//leafTest(primitiveIdx, laneMask, packet) runs per primitive of a reached leaf and may shrink packet.max per lane
+		template<typename Node, typename LeafTest>
+		inline void Traverse_BVH8Packet(std::span<const Node> nodes, std::span<const uint32_t> primitiveIndices, RayPacket8& packet, LeafTest& leafTest)
+		{
+			if (nodes.empty() || !packet.activeMask) return;
+
+			struct StackEntry
+			{
+				uint32_t childIndex;
+				uint32_t primitiveCount;
+				uint32_t laneMask;
+				float distance;
+			};
+
+			//the farthest lane interval, an entry further away than it has no lane left to hit
+			const auto getFarthestMax = [&packet](uint32_t laneMask)
+				{
+					float farthest{ -FLT_MAX };
+					for (; laneMask; laneMask &= laneMask - 1)
+					{
+						farthest = std::max(farthest, packet.max[std::countr_zero(laneMask)]);
+					}
+					return farthest;
+				};
+
+			StackEntry stack[(BVH::MAX_DEPTH + 1) * BVH::WIDTH];
+			int stackSize{ 0 };
+			BVH8Bounds decodedBounds;
+			uint32_t nodeIdx{ 0 };
+			uint32_t nodeLanes{ packet.activeMask };
+
+			while (true)
+			{
+				const Node& node = nodes[nodeIdx];
+				const BVH8Bounds& bounds = GetBVH8Bounds(node, decodedBounds);
+
+				//unused slots are inverted and never hit, same as in the single ray test
+				const int firstEntry{ stackSize };
+				for (int slot{ 0 }; slot < BVH::WIDTH; ++slot)
+				{
+					StackEntry entry{};
+					entry.laneMask = SlabTest_Packet(bounds, slot, packet, nodeLanes, entry.distance);
+					if (!entry.laneMask) continue;
+
+					GetBVH8Slot(node, slot, entry.childIndex, entry.primitiveCount);
+
+					int entryIdx{ stackSize++ };
+					while (entryIdx > firstEntry && stack[entryIdx - 1].distance < entry.distance)
+					{
+						stack[entryIdx] = stack[entryIdx - 1];
+						--entryIdx;
+					}
+					stack[entryIdx] = entry;
+				}
+
+				while (true)
+				{
+					if (stackSize == 0) return;
+
+					const StackEntry entry = stack[--stackSize];
+					if (entry.distance > getFarthestMax(entry.laneMask)) continue;
+
+					if (entry.primitiveCount == 0)
+					{
+						nodeIdx = entry.childIndex;
+						nodeLanes = entry.laneMask;
+						break;
+					}
+
+					for (uint32_t i{ 0 }; i < entry.primitiveCount; ++i)
+					{
+						leafTest(primitiveIndices[entry.childIndex + i], entry.laneMask, packet);
+					}
+				}
+			}
+		}
+
+		template<typename LeafTest>
+		inline void Traverse_BVHPacket(const BVH& bvh, RayPacket8& packet, LeafTest&& leafTest)
+		{
+			switch (bvh.GetNodeFormat())
+			{
+			case BVHNodeFormat::Full:
+				Traverse_BVH8Packet(bvh.GetWideNodes(), bvh.GetPrimitiveIndices(), packet, leafTest);
+				break;
+			case BVHNodeFormat::Quantized16:
+				Traverse_BVH8Packet(bvh.GetQuantizedNodes16(), bvh.GetPrimitiveIndices(), packet, leafTest);
+				break;
+			case BVHNodeFormat::Quantized8:
+				Traverse_BVH8Packet(bvh.GetQuantizedNodes8(), bvh.GetPrimitiveIndices(), packet, leafTest);
+				break;
+			}
+		}
+
+		//HitTest_TriangleRecord for the rays of activeMask against one triangle. Returns the lanes hit within their interval and writes their t
+		template<TriangleCullMode CullMode>
+		inline uint32_t HitTest_TriangleRecord(const TriangleRecord& triangle, const RayPacket8& packet, uint32_t activeMask, float* distances)
+		{
+#ifdef __AVX2__
+			const __m256 directionX = _mm256_load_ps(packet.directionX);
+			const __m256 directionY = _mm256_load_ps(packet.directionY);
+			const __m256 directionZ = _mm256_load_ps(packet.directionZ);
+			const __m256 edge1X = _mm256_set1_ps(triangle.edge1.x), edge1Y = _mm256_set1_ps(triangle.edge1.y), edge1Z = _mm256_set1_ps(triangle.edge1.z);
+			const __m256 edge2X = _mm256_set1_ps(triangle.edge2.x), edge2Y = _mm256_set1_ps(triangle.edge2.y), edge2Z = _mm256_set1_ps(triangle.edge2.z);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.f);
+
+			const __m256 nv = _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_set1_ps(triangle.normal.x), directionX),
+				_mm256_mul_ps(_mm256_set1_ps(triangle.normal.y), directionY)),
+				_mm256_mul_ps(_mm256_set1_ps(triangle.normal.z), directionZ));
+			__m256 valid = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.f), nv), _mm256_set1_ps(FLT_EPSILON), _CMP_GE_OQ);
+
+			//closest hits only, the facing is -nv
+			if constexpr (CullMode == TriangleCullMode::FrontFaceCulling) valid = _mm256_and_ps(valid, _mm256_cmp_ps(nv, zero, _CMP_GE_OQ));
+			else if constexpr (CullMode == TriangleCullMode::BackFaceCulling) valid = _mm256_and_ps(valid, _mm256_cmp_ps(nv, zero, _CMP_LE_OQ));
+
+			const __m256 pX = _mm256_sub_ps(_mm256_mul_ps(directionY, edge2Z), _mm256_mul_ps(directionZ, edge2Y));
+			const __m256 pY = _mm256_sub_ps(_mm256_mul_ps(directionZ, edge2X), _mm256_mul_ps(directionX, edge2Z));
+			const __m256 pZ = _mm256_sub_ps(_mm256_mul_ps(directionX, edge2Y), _mm256_mul_ps(directionY, edge2X));
+			const __m256 invDeterminant = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge1X, pX), _mm256_mul_ps(edge1Y, pY)), _mm256_mul_ps(edge1Z, pZ)));
+
+			const __m256 sX = _mm256_sub_ps(_mm256_load_ps(packet.originX), _mm256_set1_ps(triangle.v0.x));
+			const __m256 sY = _mm256_sub_ps(_mm256_load_ps(packet.originY), _mm256_set1_ps(triangle.v0.y));
+			const __m256 sZ = _mm256_sub_ps(_mm256_load_ps(packet.originZ), _mm256_set1_ps(triangle.v0.z));
+			const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sX, pX), _mm256_mul_ps(sY, pY)), _mm256_mul_ps(sZ, pZ)), invDeterminant);
+
+			const __m256 qX = _mm256_sub_ps(_mm256_mul_ps(sY, edge1Z), _mm256_mul_ps(sZ, edge1Y));
+			const __m256 qY = _mm256_sub_ps(_mm256_mul_ps(sZ, edge1X), _mm256_mul_ps(sX, edge1Z));
+			const __m256 qZ = _mm256_sub_ps(_mm256_mul_ps(sX, edge1Y), _mm256_mul_ps(sY, edge1X));
+			const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, qX), _mm256_mul_ps(directionY, qY)), _mm256_mul_ps(directionZ, qZ)), invDeterminant);
+			const __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge2X, qX), _mm256_mul_ps(edge2Y, qY)), _mm256_mul_ps(edge2Z, qZ)), invDeterminant);
+
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_load_ps(packet.min), _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_load_ps(packet.max), _CMP_LE_OQ));
+
+			_mm256_store_ps(distances, t);
+			return static_cast<uint32_t>(_mm256_movemask_ps(valid)) & activeMask;
+#else
+			uint32_t hitMask{ 0 };
+			for (; activeMask; activeMask &= activeMask - 1)
+			{
+				const int lane = std::countr_zero(activeMask);
+				if (HitTest_TriangleRecord<CullMode, HitQuery::Closest>(triangle, packet.GetRay(lane), distances[lane])) hitMask |= 1u << lane;
+			}
+			return hitMask;
+#endif
+		}
+
+		//Closest hit of the rays of laneMask against the mesh. Returns the lanes that found something within their packet.max,
+		//packet.max shrinks to those hits and triangleIndices holds the triangle per hit lane
+		template<TriangleCullMode CullMode>
+		inline uint32_t HitTest_TriangleMesh(const TriangleMesh& mesh, RayPacket8& packet, uint32_t laneMask, uint32_t* triangleIndices)
+		{
+			RayPacket8 objectPacket{};
+			for (uint32_t lanes{ laneMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane = std::countr_zero(lanes);
+				objectPacket.SetRay(lane, GetObjectRay(mesh, packet.GetRay(lane)));
+			}
+
+			uint32_t hitMask{ 0 };
+			Traverse_BVHPacket(mesh.bvh, objectPacket, [&](uint32_t triIdx, uint32_t activeMask, RayPacket8& currentPacket)
+				{
+					alignas(32) float distances[RayPacket8::WIDTH];
+					for (uint32_t lanes{ HitTest_TriangleRecord<CullMode>(mesh.triangleRecords[triIdx], currentPacket, activeMask, distances) }; lanes; lanes &= lanes - 1)
+					{
+						const int lane = std::countr_zero(lanes);
+						currentPacket.max[lane] = distances[lane];
+						triangleIndices[lane] = triIdx;
+						hitMask |= 1u << lane;
+					}
+				});
+
+			//t means the same in object and world space, see GetObjectRay
+			for (uint32_t lanes{ hitMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane = std::countr_zero(lanes);
+				packet.max[lane] = objectPacket.max[lane];
+			}
+			return hitMask;
+		}
+
+		inline uint32_t HitTest_TriangleMesh(const TriangleMesh& mesh, RayPacket8& packet, uint32_t laneMask, uint32_t* triangleIndices)
+		{
+			return DispatchCullMode(mesh.cullMode, [&](auto cullModeConstant)
+				{
+					return HitTest_TriangleMesh<decltype(cullModeConstant)::value>(mesh, packet, laneMask, triangleIndices);
+				});
+		}
+
+		//Same as above with a full record per hit lane
+		inline void HitTest_TriangleMesh(const TriangleMesh& mesh, RayPacket8& packet, uint32_t laneMask, HitRecord* hitRecords)
+		{
+			uint32_t triangleIndices[RayPacket8::WIDTH]{};
+			for (uint32_t hitMask{ HitTest_TriangleMesh(mesh, packet, laneMask, triangleIndices) }; hitMask; hitMask &= hitMask - 1)
+			{
+				const int lane = std::countr_zero(hitMask);
+				hitRecords[lane] = GetHitRecord(mesh, triangleIndices[lane], packet.GetRay(lane), packet.max[lane]);
+			}
+		}
 #pragma endregion
 	}
 
@@ -338,6 +1502,7 @@ namespace dae
 
 		}
 	}
+	}
 
 	namespace Utils
 	{
@@ -370,12 +1535,30 @@ namespace dae
 				}
 				else if (sCommand == "f")
 				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
+					//Faces can be polygons with v/vt/vn entries, only the position index is used
+					std::string faceLine;
+					std::getline(file, faceLine);
+
+					std::istringstream faceStream(faceLine);
+					std::string faceVertex;
+					std::vector<int> faceIndices{};
+					while (faceStream >> faceVertex)
+					{
+						faceIndices.push_back(std::stoi(faceVertex) - 1);
+					}
+
+					//Triangulate as a fan around the first vertex
+					for (size_t idx{ 1 }; idx + 1 < faceIndices.size(); ++idx)
+					{
+						indices.push_back(faceIndices[0]);
+						indices.push_back(faceIndices[idx]);
+						indices.push_back(faceIndices[idx + 1]);
+					}
 
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
+					//getline already consumed the end of the line
+					if (file.eof())
+						break;
+					continue;
 				}
 				//read till end of line and ignore all remaining chars
 				file.ignore(1000, '\n');
@@ -1,8 +1,11 @@
 #pragma once
+#include <cassert>
+
+#include "MathHelpers.h"
+#include "Vector4.h"
 
 namespace dae
 {
-	struct Vector4;
 	struct Vector3
 	{
 		float x{};
@@ -10,42 +13,180 @@ namespace dae
 		float z{};
 
 		Vector3() = default;
-		Vector3(float _x, float _y, float _z);
-		Vector3(const Vector3& from, const Vector3& to);
-		Vector3(const Vector4& v);
-
-		float Magnitude() const;
-		float SqrMagnitude() const;
-		float Normalize();
-		Vector3 Normalized() const;
-
-		static float Dot(const Vector3& v1, const Vector3& v2);
-		static Vector3 Cross(const Vector3& v1, const Vector3& v2);
-		static Vector3 Project(const Vector3& v1, const Vector3& v2);
-		static Vector3 Reject(const Vector3& v1, const Vector3& v2);
-		static Vector3 Reflect(const Vector3& v1, const Vector3& v2);
-		static Vector3 Lico(float f1, const Vector3& v1, float f2, const Vector3& v2, float f3, const Vector3& v3);
-
-		static Vector3 Max(const Vector3& v1, const Vector3& v2);
-		static Vector3 Min(const Vector3& v1, const Vector3& v2);
-
-		Vector4 ToPoint4() const;
-		Vector4 ToVector4() const;
-
-		//Member Operators
-		Vector3 operator*(float scale) const;
-		Vector3 operator/(float scale) const;
-		Vector3 operator+(const Vector3& v) const;
-		Vector3 operator-(const Vector3& v) const;
-		Vector3 operator-() const;
-		//Vector3& operator-();
-		Vector3& operator+=(const Vector3& v);
-		Vector3& operator-=(const Vector3& v);
-		Vector3& operator/=(float scale);
-		Vector3& operator*=(float scale);
-		float& operator[](int index);
-		float operator[](int index) const;
-		bool operator==(const Vector3& v) const;
+		DAE_INLINE constexpr Vector3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+		DAE_INLINE constexpr Vector3(const Vector3& from, const Vector3& to) : x(to.x - from.x), y(to.y - from.y), z(to.z - from.z) {}
+		DAE_INLINE constexpr Vector3(const Vector4& v) : x(v.x), y(v.y), z(v.z) {}
+
+		DAE_INLINE float Magnitude() const
+		{
+			return std::sqrt(x * x + y * y + z * z);
+		}
+
+		DAE_INLINE constexpr float SqrMagnitude() const
+		{
+			return x * x + y * y + z * z;
+		}
+
+		DAE_INLINE float Normalize()
+		{
+			const float m = Magnitude();
+			x /= m;
+			y /= m;
+			z /= m;
+
+			return m;
+		}
+
+		DAE_INLINE Vector3 Normalized() const
+		{
+			const float m = Magnitude();
+			return { x / m, y / m, z / m };
+		}
+
+		DAE_INLINE static constexpr float Dot(const Vector3& v1, const Vector3& v2)
+		{
+			return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+		}
+
+		DAE_INLINE static constexpr Vector3 Cross(const Vector3& v1, const Vector3& v2)
+		{
+			return Vector3{
+				v1.y * v2.z - v1.z * v2.y,
+				v1.z * v2.x - v1.x * v2.z,
+				v1.x * v2.y - v1.y * v2.x
+			};
+		}
+
+		DAE_INLINE static constexpr Vector3 Project(const Vector3& v1, const Vector3& v2)
+		{
+			return v2 * (Dot(v1, v2) / Dot(v2, v2));
+		}
+
+		DAE_INLINE static constexpr Vector3 Reject(const Vector3& v1, const Vector3& v2)
+		{
+			return v1 - v2 * (Dot(v1, v2) / Dot(v2, v2));
+		}
+
+		DAE_INLINE static constexpr Vector3 Reflect(const Vector3& v1, const Vector3& v2)
+		{
+			return v1 - v2 * (2.f * Dot(v1, v2));
+		}
+
+		//Linear combination f1 * v1 + f2 * v2 + f3 * v3
+		DAE_INLINE static constexpr Vector3 Lico(float f1, const Vector3& v1, float f2, const Vector3& v2, float f3, const Vector3& v3)
+		{
+			return v1 * f1 + v2 * f2 + v3 * f3;
+		}
+
+		DAE_INLINE static constexpr Vector3 Max(const Vector3& v1, const Vector3& v2)
+		{
+			return {
+				std::max(v1.x, v2.x),
+				std::max(v1.y, v2.y),
+				std::max(v1.z, v2.z)
+			};
+		}
+
+		DAE_INLINE static constexpr Vector3 Min(const Vector3& v1, const Vector3& v2)
+		{
+			return {
+				std::min(v1.x, v2.x),
+				std::min(v1.y, v2.y),
+				std::min(v1.z, v2.z)
+			};
+		}
+
+		DAE_INLINE constexpr Vector4 ToPoint4() const
+		{
+			return { x, y, z, 1 };
+		}
+
+		DAE_INLINE constexpr Vector4 ToVector4() const
+		{
+			return { x, y, z, 0 };
+		}
+
+#pragma region Member Operators
+		DAE_INLINE constexpr Vector3 operator*(float scale) const
+		{
+			return { x * scale, y * scale, z * scale };
+		}
+
+		DAE_INLINE constexpr Vector3 operator/(float scale) const
+		{
+			return { x / scale, y / scale, z / scale };
+		}
+
+		DAE_INLINE constexpr Vector3 operator+(const Vector3& v) const
+		{
+			return { x + v.x, y + v.y, z + v.z };
+		}
+
+		DAE_INLINE constexpr Vector3 operator-(const Vector3& v) const
+		{
+			return { x - v.x, y - v.y, z - v.z };
+		}
+
+		DAE_INLINE constexpr Vector3 operator-() const
+		{
+			return { -x, -y, -z };
+		}
+
+		DAE_INLINE constexpr Vector3& operator+=(const Vector3& v)
+		{
+			x += v.x;
+			y += v.y;
+			z += v.z;
+			return *this;
+		}
+
+		DAE_INLINE constexpr Vector3& operator-=(const Vector3& v)
+		{
+			x -= v.x;
+			y -= v.y;
+			z -= v.z;
+			return *this;
+		}
+
+		DAE_INLINE constexpr Vector3& operator/=(float scale)
+		{
+			x /= scale;
+			y /= scale;
+			z /= scale;
+			return *this;
+		}
+
+		DAE_INLINE constexpr Vector3& operator*=(float scale)
+		{
+			x *= scale;
+			y *= scale;
+			z *= scale;
+			return *this;
+		}
+
+		DAE_INLINE constexpr float& operator[](int index)
+		{
+			assert(index <= 2 && index >= 0);
+
+			if (index == 0) return x;
+			if (index == 1) return y;
+			return z;
+		}
+
+		DAE_INLINE constexpr float operator[](int index) const
+		{
+			assert(index <= 2 && index >= 0);
+
+			if (index == 0) return x;
+			if (index == 1) return y;
+			return z;
+		}
+
+		DAE_INLINE bool operator==(const Vector3& v) const
+		{
+			return AreEqual(x, v.x) && AreEqual(y, v.y) && AreEqual(z, v.z);
+		}
+#pragma endregion
 
 		static const Vector3 UnitX;
 		static const Vector3 UnitY;
@@ -53,8 +194,15 @@ namespace dae
 		static const Vector3 Zero;
 	};
 
+	inline constexpr Vector3 Vector3::UnitX{ 1, 0, 0 };
+	inline constexpr Vector3 Vector3::UnitY{ 0, 1, 0 };
+	inline constexpr Vector3 Vector3::UnitZ{ 0, 0, 1 };
+	inline constexpr Vector3 Vector3::Zero{ 0, 0, 0 };
+
+	DAE_INLINE constexpr Vector4::Vector4(const Vector3& v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+
 	//Global Operators
-	inline Vector3 operator*(float scale, const Vector3& v)
+	DAE_INLINE constexpr Vector3 operator*(float scale, const Vector3& v)
 	{
 		return { v.x * scale, v.y * scale, v.z * scale };
 	}
@@ -7,14 +7,19 @@
 #undef main
 
 //Standard includes
+#include <charconv>
 #include <iostream>
+#include <string_view>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
+#include "FramePipeline.h"
 #include "Scene.h"
+#include "SimdDispatch.h"
 
 //#define USE_BUNNY  //uncomment so that you can use the bunny scene
+#define PIPELINED_FRAME_LOOP //screenshots are written on their own thread while the next frames render
 
 using namespace dae;
 
@@ -30,9 +35,49 @@ void ShutDown(SDL_Window* pWindow)
 
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	//--simd=sse2|sse4.1|avx2|avx512 overrides the detected kernel level, to benchmark the levels against each other
+	constexpr std::string_view simdOption{ "--simd=" };
+	//--threads=N and --tile=N set the render thread count (0 for all hardware threads) and the tile size in pixels
+	constexpr std::string_view threadsOption{ "--threads=" };
+	constexpr std::string_view tileOption{ "--tile=" };
+	//--buffers=2|3 lets 2 or 3 screenshots queue up while the pipelined frame loop keeps rendering
+	constexpr std::string_view buffersOption{ "--buffers=" };
+	//--frame-time=N lowers the render resolution until a frame renders in about N milliseconds
+	constexpr std::string_view frameTimeOption{ "--frame-time=" };
+	uint32_t threadCount{};
+	uint32_t tileSize{ Renderer::DEFAULT_TILE_SIZE };
+	uint32_t bufferCount{ FramePipeline::DEFAULT_BUFFER_COUNT };
+	uint32_t targetFrameTime{};
+
+	for (int argIdx{ 1 }; argIdx < argc; ++argIdx)
+	{
+		const std::string_view argument{ args[argIdx] };
+		const auto parseCount = [&](std::string_view option, uint32_t& count)
+			{
+				const std::string_view value{ argument.substr(option.size()) };
+				if (std::from_chars(value.data(), value.data() + value.size(), count).ec != std::errc{})
+				{
+					std::cout << "Expected a number after " << option << std::endl;
+				}
+			};
+
+		if (argument.starts_with(threadsOption)) parseCount(threadsOption, threadCount);
+		if (argument.starts_with(tileOption)) parseCount(tileOption, tileSize);
+		if (argument.starts_with(buffersOption)) parseCount(buffersOption, bufferCount);
+		if (argument.starts_with(frameTimeOption)) parseCount(frameTimeOption, targetFrameTime);
+		if (!argument.starts_with(simdOption)) continue;
+
+		SimdLevel level{};
+		if (!ParseSimdLevel(argument.substr(simdOption.size()), level))
+		{
+			std::cout << "Unknown SIMD level " << argument.substr(simdOption.size()) << ", expected sse2, sse4.1, avx2 or avx512" << std::endl;
+		}
+		else if (SetSimdLevel(level) != level)
+		{
+			std::cout << "This CPU does not support " << GetSimdLevelName(level) << std::endl;
+		}
+	}
+	std::cout << "SIMD kernels: " << GetSimdLevelName(GetSimdLevel()) << " (detected " << GetSimdLevelName(DetectSimdLevel()) << ")" << std::endl;
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -52,6 +97,10 @@ int main(int argc, char* args[])
 	//Initialize "framework"
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
+	if (threadCount) pRenderer->SetThreadCount(threadCount);
+	pRenderer->SetTileSize(tileSize);
+	pRenderer->SetTargetFrameTime(float(targetFrameTime));
+	std::cout << "Render threads: " << pRenderer->GetThreadCount() << ", tiles of " << pRenderer->GetTileSize() << " pixels" << std::endl;
 
 #ifdef USE_BUNNY
 	const auto pScene = new Scene_W4_Bunny();
@@ -60,6 +109,13 @@ int main(int argc, char* args[])
 #endif
 
 	pScene->Initialize();
+	pScene->BuildAccelerationStructure();
+	pScene->PrintAccelerationStructureInfo();
+
+#ifdef PIPELINED_FRAME_LOOP
+	const auto pPipeline = new FramePipeline(pWindow, pRenderer, bufferCount);
+	std::cout << "Frame buffers: " << pPipeline->GetBufferCount() << std::endl;
+#endif
 
 	//Start loop
 	pTimer->Start();
@@ -93,6 +149,28 @@ int main(int argc, char* args[])
 					pScene->m_bShadowEnabled = !pScene->m_bShadowEnabled;
 				}
 
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+				{
+					pRenderer->PrintPrimaryRayThroughput(pScene);
+				}
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+				{
+					pRenderer->SetAccumulation(!pRenderer->IsAccumulating());
+					std::cout << "Progressive accumulation " << (pRenderer->IsAccumulating() ? "on" : "off") << std::endl;
+				}
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
+				{
+					pScene->m_bAnimate = !pScene->m_bAnimate;
+				}
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+				{
+					pRenderer->SetAdaptiveThreshold(pRenderer->GetAdaptiveThreshold() > 0.f ? 0.f : Renderer::DEFAULT_ADAPTIVE_THRESHOLD);
+					std::cout << "Adaptive sampling " << (pRenderer->GetAdaptiveThreshold() > 0.f ? "on" : "off") << std::endl;
+				}
+
 				if (e.key.keysym.scancode == SDL_SCANCODE_F3)
 				{
 					if (pScene->m_CurrentLightingMode == LightingMode::Combined)
@@ -119,7 +197,13 @@ int main(int argc, char* args[])
 		pScene->Update(pTimer);
 
 		//--------- Render ---------
+#ifdef PIPELINED_FRAME_LOOP
+		//the screenshot is written by the pipeline's save thread once this frame is on screen
+		pPipeline->RenderFrame(pScene, takeScreenshot);
+		takeScreenshot = false;
+#else
 		pRenderer->Render(pScene);
+#endif
 
 		//--------- Timer ---------
 		pTimer->Update();
@@ -127,9 +211,13 @@ int main(int argc, char* args[])
 		if (printTimer >= 1.f)
 		{
 			printTimer = 0.f;
-			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			std::cout << "dFPS: " << pTimer->GetdFPS();
+			if (targetFrameTime) std::cout << " (resolution scale " << pRenderer->GetResolutionScale() << ")";
+			if (pRenderer->GetAccumulatedFrames() > 1) std::cout << " (" << pRenderer->GetAccumulatedFrames() << " frames accumulated)";
+			std::cout << std::endl;
 		}
 
+#ifndef PIPELINED_FRAME_LOOP
 		//Save screenshot after full render
 		if (takeScreenshot)
 		{
@@ -139,10 +227,14 @@ int main(int argc, char* args[])
 				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
 			takeScreenshot = false;
 		}
+#endif
 	}
 	pTimer->Stop();
 
 	//Shutdown "framework"
+#ifdef PIPELINED_FRAME_LOOP
+	delete pPipeline;
+#endif
 	delete pScene;
 	delete pRenderer;
 	delete pTimer;
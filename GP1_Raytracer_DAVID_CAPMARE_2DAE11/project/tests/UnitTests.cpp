@@ -2,6 +2,16 @@
 #include "../src/Vector3.h"
 #include "../src/Vector4.h"
 #include "../src/Matrix.h"
+#include "../src/Utils.h"
+#include "../src/Scene.h"
+#include "../src/ThreadPool.h"
+#include "../src/ResolutionController.h"
+#include "../src/Renderer.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
 
 namespace dae
 {
@@ -37,6 +47,746 @@ namespace dae
 
 	// W1
 
+	// Builds a cloud of random triangles, used to check the acceleration structures against brute force
+	static TriangleMesh CreateRandomMesh(int triangleCount, unsigned int seed)
+	{
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<float> center{ -5.f, 5.f };
+		std::uniform_real_distribution<float> offset{ -.5f, .5f };
+
+		TriangleMesh mesh{};
+		mesh.cullMode = TriangleCullMode::NoCulling;
+		for (int idx{}; idx < triangleCount; ++idx)
+		{
+			const Vector3 c{ center(rng), center(rng), center(rng) };
+			mesh.AppendTriangle({ c + Vector3{ offset(rng), offset(rng), offset(rng) },
+				c + Vector3{ offset(rng), offset(rng), offset(rng) },
+				c + Vector3{ offset(rng), offset(rng), offset(rng) } }, true);
+		}
+		mesh.UpdateGeometry();
+		mesh.UpdateTransforms();
+		return mesh;
+	}
+
+	// Closest hit without any acceleration structure, on world space copies of the triangles
+	static HitRecord BruteForceClosestHit(const TriangleMesh& mesh, const Ray& ray)
+	{
+		HitRecord closestHit{};
+		HitRecord tempHit{};
+		for (size_t idx{}; idx < mesh.indices.size(); idx += 3)
+		{
+			Triangle triangle{ mesh.transform.TransformPoint(mesh.positions[mesh.indices[idx]]),
+				mesh.transform.TransformPoint(mesh.positions[mesh.indices[idx + 1]]),
+				mesh.transform.TransformPoint(mesh.positions[mesh.indices[idx + 2]]) };
+			triangle.cullMode = mesh.cullMode;
+			if (GeometryUtils::HitTest_Triangle(triangle, ray, tempHit) && tempHit.t < closestHit.t)
+			{
+				closestHit = tempHit;
+			}
+		}
+		return closestHit;
+	}
+
+	TEST(BVH, MatchesBruteForce) {
+		const TriangleMesh mesh = CreateRandomMesh(500, 1337);
+		ASSERT_FALSE(mesh.bvh.IsEmpty());
+		EXPECT_EQ(500u, mesh.bvh.GetPrimitiveIndices().size());
+
+		std::mt19937 rng{ 42 };
+		std::uniform_real_distribution<float> target{ -5.f, 5.f };
+		for (int idx{}; idx < 1000; ++idx)
+		{
+			const Vector3 origin{ 0.f, 0.f, -20.f };
+			const Ray ray{ origin, (Vector3{ target(rng), target(rng), target(rng) } - origin).Normalized() };
+
+			const HitRecord expected = BruteForceClosestHit(mesh, ray);
+			HitRecord actual{};
+			GeometryUtils::HitTest_TriangleMesh(mesh, ray, actual);
+
+			ASSERT_EQ(expected.didHit, actual.didHit);
+			ASSERT_EQ(expected.didHit, GeometryUtils::HitTest_TriangleMesh(mesh, ray));
+			if (expected.didHit)
+			{
+				// meshes intersect through Moller-Trumbore records, the brute force through the plane, so only the last bits differ
+				ASSERT_NEAR(expected.t, actual.t, 1e-4f);
+			}
+		}
+	}
+
+	TEST(BVH, WideNodes) {
+		const TriangleMesh mesh = CreateRandomMesh(500, 4);
+		const std::span<const BVH8Node> wideNodes = mesh.bvh.GetWideNodes();
+		ASSERT_FALSE(wideNodes.empty());
+
+		// every triangle sits in exactly one leaf slot
+		std::vector<int> triangleCounts(500);
+		for (const BVH8Node& node : wideNodes)
+		{
+			for (int slot{}; slot < BVH::WIDTH; ++slot)
+			{
+				for (uint32_t i{}; i < node.primitiveCount[slot]; ++i)
+				{
+					++triangleCounts[mesh.bvh.GetPrimitiveIndices()[node.childIndex[slot] + i]];
+				}
+			}
+		}
+		for (const int count : triangleCounts)
+		{
+			EXPECT_EQ(1, count);
+		}
+
+		// rays along the axes have zero direction components, which the slab test has to survive
+		std::mt19937 rng{ 5 };
+		std::uniform_real_distribution<float> target{ -5.f, 5.f };
+		const Vector3 directions[]{ Vector3::UnitX, -Vector3::UnitX, Vector3::UnitY, -Vector3::UnitY, Vector3::UnitZ, -Vector3::UnitZ };
+		for (int idx{}; idx < 600; ++idx)
+		{
+			const Vector3& direction = directions[idx % 6];
+			const Ray ray{ Vector3{ target(rng), target(rng), target(rng) } - direction * 10.f, direction };
+
+			const HitRecord expected = BruteForceClosestHit(mesh, ray);
+			HitRecord actual{};
+			GeometryUtils::HitTest_TriangleMesh(mesh, ray, actual);
+
+			ASSERT_EQ(expected.didHit, actual.didHit);
+			if (expected.didHit)
+			{
+				ASSERT_NEAR(expected.t, actual.t, 1e-4f);
+			}
+		}
+	}
+
+	TEST(BVH, TriangleRecordCulling) {
+		// one triangle facing -z, hit from both sides with every cull mode, closest hit and shadow rays
+		const Triangle triangle{ { -1.f, -1.f, 0.f }, { 0.f, 1.f, 0.f }, { 1.f, -1.f, 0.f } };
+		const Ray rays[]{ { { 0.f, 0.f, -5.f }, Vector3::UnitZ }, { { 0.f, 0.f, 5.f }, -Vector3::UnitZ } };
+
+		for (const TriangleCullMode cullMode : { TriangleCullMode::FrontFaceCulling, TriangleCullMode::BackFaceCulling, TriangleCullMode::NoCulling })
+		{
+			TriangleMesh mesh{};
+			mesh.cullMode = cullMode;
+			mesh.AppendTriangle(triangle, true);
+			mesh.UpdateGeometry();
+			mesh.UpdateTransforms();
+
+			Triangle culledTriangle{ triangle };
+			culledTriangle.cullMode = cullMode;
+			for (const Ray& ray : rays)
+			{
+				HitRecord expected{};
+				HitRecord actual{};
+				EXPECT_EQ(GeometryUtils::HitTest_Triangle(culledTriangle, ray, expected), GeometryUtils::HitTest_TriangleMesh(mesh, ray, actual));
+				EXPECT_EQ(GeometryUtils::HitTest_Triangle(culledTriangle, ray), GeometryUtils::HitTest_TriangleMesh(mesh, ray));
+				if (expected.didHit)
+				{
+					EXPECT_FLOAT_EQ(expected.t, actual.t);
+					EXPECT_EQ(expected.normal, actual.normal);
+				}
+			}
+		}
+	}
+
+	TEST(BVH, TrianglePackets) {
+		TriangleMesh mesh = CreateRandomMesh(203, 21);
+
+		// the packets follow the primitive order, switching the node format must keep it
+		for (const BVHNodeFormat format : { BVHNodeFormat::Full, BVHNodeFormat::Quantized8 })
+		{
+			mesh.bvh.SetNodeFormat(format);
+			const std::span<const uint32_t> primitiveIndices = mesh.bvh.GetPrimitiveIndices();
+			ASSERT_EQ((primitiveIndices.size() + 7) / 8, mesh.trianglePackets.size());
+			for (size_t position{}; position < primitiveIndices.size(); ++position)
+			{
+				const TrianglePacket8& packet = mesh.trianglePackets[position / 8];
+				const uint32_t triIdx = packet.triangleIdx[position % 8];
+				ASSERT_EQ(primitiveIndices[position], triIdx);
+				EXPECT_EQ(mesh.triangleRecords[triIdx].v0, (Vector3{ packet.v0X[position % 8], packet.v0Y[position % 8], packet.v0Z[position % 8] }));
+			}
+		}
+
+		// every lane of the 8-wide kernel agrees with the scalar record test, for closest hit and shadow rays
+		std::mt19937 rng{ 4 };
+		std::uniform_real_distribution<float> coordinate{ -8.f, 8.f };
+		for (const TriangleCullMode cullMode : { TriangleCullMode::FrontFaceCulling, TriangleCullMode::BackFaceCulling, TriangleCullMode::NoCulling })
+		{
+			for (int rayIdx{}; rayIdx < 300; ++rayIdx)
+			{
+				const Vector3 origin{ coordinate(rng), coordinate(rng), -12.f };
+				const Vector3 target{ coordinate(rng) * .5f, coordinate(rng) * .5f, coordinate(rng) };
+				const Ray ray{ origin, (target - origin).Normalized() };
+
+				for (size_t packetIdx{}; packetIdx < mesh.trianglePackets.size(); ++packetIdx)
+				{
+					// the last packet is only partly filled
+					const TrianglePacket8& packet = mesh.trianglePackets[packetIdx];
+					const int laneCount = static_cast<int>(std::min<size_t>(8, mesh.triangleRecords.size() - packetIdx * 8));
+					for (const bool ignoreHitRecord : { false, true })
+					{
+						alignas(32) float distances[8];
+						const uint32_t hitMask = GeometryUtils::HitTest_TrianglePacket(packet, (1u << laneCount) - 1, cullMode, ray, ignoreHitRecord, distances);
+						for (int lane{}; lane < laneCount; ++lane)
+						{
+							float t{};
+							const bool expected = GeometryUtils::HitTest_TriangleRecord(mesh.triangleRecords[packet.triangleIdx[lane]], cullMode, ray, ignoreHitRecord, t);
+							ASSERT_EQ(expected, bool(hitMask & (1u << lane)));
+							// the compiler may fuse the scalar products into FMAs, so t can differ in the last bits
+							if (expected) { EXPECT_NEAR(t, distances[lane], 1e-4f); }
+						}
+					}
+				}
+			}
+		}
+	}
+
+	TEST(BVH, RayPackets) {
+		TriangleMesh mesh = CreateRandomMesh(400, 17);
+		mesh.Translate({ 1.f, 0.f, 2.f });
+		mesh.RotateY(25.f);
+		mesh.UpdateTransforms();
+
+		// coherent rays from one origin like a block of primary rays, one lane is left out and must stay untouched
+		const Vector3 origin{ 0.f, 0.f, -20.f };
+		for (int block{}; block < 200; ++block)
+		{
+			RayPacket8 packet{};
+			Ray rays[RayPacket8::WIDTH]{};
+			for (int lane{}; lane < RayPacket8::WIDTH; ++lane)
+			{
+				const Vector3 target{ -5.f + (block % 20) * .5f + (lane % 4) * .1f, -5.f + (block / 20) * 1.f + (lane / 4) * .1f, 0.f };
+				rays[lane] = { origin, (target - origin).Normalized() };
+				if (lane != 5) packet.SetRay(lane, rays[lane]);
+			}
+
+			HitRecord packetHits[RayPacket8::WIDTH]{};
+			GeometryUtils::HitTest_TriangleMesh(mesh, packet, packet.activeMask, packetHits);
+			for (int lane{}; lane < RayPacket8::WIDTH; ++lane)
+			{
+				HitRecord expected{};
+				if (lane != 5) GeometryUtils::HitTest_TriangleMesh(mesh, rays[lane], expected);
+
+				ASSERT_EQ(expected.didHit, packetHits[lane].didHit);
+				if (expected.didHit)
+				{
+					ASSERT_FLOAT_EQ(expected.t, packetHits[lane].t);
+					ASSERT_EQ(expected.normal, packetHits[lane].normal);
+				}
+			}
+		}
+	}
+
+	TEST(Matrix, Inverse) {
+		const Matrix m = Matrix::CreateRotationY(30.f) * Matrix::CreateTranslation(1.f, 2.f, 3.f) * Matrix::CreateScale(2.f, .5f, 1.f);
+		EXPECT_EQ(Matrix{}, m * Matrix::Inverse(m));
+
+		const Vector3 p{ 4.f, -5.f, 6.f };
+		EXPECT_NEAR(0.f, (p - Matrix::Inverse(m).TransformPoint(m.TransformPoint(p))).Magnitude(), 1e-5f);
+	}
+
+	TEST(Transform, MatchesMatrix) {
+		const Matrix m = Matrix::CreateRotationY(30.f) * Matrix::CreateTranslation(1.f, 2.f, 3.f) * Matrix::CreateScale(2.f, .5f, 1.f);
+		const Transform t = Transform::CreateRotationY(30.f) * Transform::CreateTranslation({ 1.f, 2.f, 3.f }) * Transform::CreateScale({ 2.f, .5f, 1.f });
+		EXPECT_EQ(m, t.ToMatrix());
+		EXPECT_EQ(Matrix::Inverse(m), Transform::Inverse(t).ToMatrix());
+
+		Vector3 points[5]{ { 4.f, -5.f, 6.f }, { 0.f, 0.f, 0.f }, { -1.f, 2.f, .5f }, { 100.f, 0.f, -3.f }, { .1f, .2f, .3f } };
+		Vector3 transformed[5]{};
+		t.TransformPoints(points, transformed, 5);
+		for (int idx{}; idx < 5; ++idx)
+		{
+			const Vector3 expectedPoint = m.TransformPoint(points[idx]);
+			const Vector3 expectedVector = m.TransformVector(points[idx]);
+			EXPECT_EQ(expectedPoint, t.TransformPoint(points[idx]));
+			EXPECT_EQ(expectedPoint, transformed[idx]);
+			EXPECT_EQ(expectedVector, t.TransformVector(points[idx]));
+		}
+	}
+
+	TEST(BVH, InstanceTransform) {
+		TriangleMesh mesh = CreateRandomMesh(300, 99);
+		mesh.Translate({ 2.f, -1.f, 3.f });
+		mesh.RotateY(40.f);
+		mesh.Scale({ 1.5f, .75f, 1.f });
+		mesh.UpdateTransforms();
+
+		std::mt19937 rng{ 5 };
+		std::uniform_real_distribution<float> target{ -8.f, 8.f };
+		for (int idx{}; idx < 1000; ++idx)
+		{
+			const Vector3 origin{ 0.f, 0.f, -20.f };
+			const Ray ray{ origin, (Vector3{ target(rng), target(rng), target(rng) } - origin).Normalized() };
+
+			const HitRecord expected = BruteForceClosestHit(mesh, ray);
+			HitRecord actual{};
+			GeometryUtils::HitTest_TriangleMesh(mesh, ray, actual);
+
+			ASSERT_EQ(expected.didHit, actual.didHit);
+			if (expected.didHit)
+			{
+				ASSERT_NEAR(expected.t, actual.t, 1e-3f);
+				ASSERT_NEAR(1.f, std::abs(Vector3::Dot(expected.normal, actual.normal)), 1e-3f);
+				ASSERT_NEAR(0.f, (expected.origin - actual.origin).Magnitude(), 1e-3f);
+			}
+		}
+	}
+
+	static void ExpectMeshMatchesBruteForce(const TriangleMesh& mesh, unsigned int seed)
+	{
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<float> target{ -8.f, 8.f };
+		for (int idx{}; idx < 1000; ++idx)
+		{
+			const Vector3 origin{ 0.f, 0.f, -20.f };
+			const Ray ray{ origin, (Vector3{ target(rng), target(rng), target(rng) } - origin).Normalized() };
+
+			const HitRecord expected = BruteForceClosestHit(mesh, ray);
+			HitRecord actual{};
+			GeometryUtils::HitTest_TriangleMesh(mesh, ray, actual);
+
+			ASSERT_EQ(expected.didHit, actual.didHit);
+			if (expected.didHit)
+			{
+				ASSERT_NEAR(expected.t, actual.t, 1e-3f);
+			}
+		}
+	}
+
+	TEST(BVH, RefitAfterDeformation) {
+		TriangleMesh mesh = CreateRandomMesh(400, 3);
+
+		// move a few triangles, only their path to the root is refitted
+		std::vector<uint32_t> changedTriangles{ 0, 17, 123, 399 };
+		for (const uint32_t triIdx : changedTriangles)
+		{
+			for (int corner{}; corner < 3; ++corner)
+			{
+				mesh.positions[mesh.indices[triIdx * 3 + corner]] += Vector3{ 2.f, -1.f, .5f };
+			}
+		}
+		mesh.RefitGeometry(changedTriangles);
+		ExpectMeshMatchesBruteForce(mesh, 11);
+
+		// scatter everything, the refit tree gets a lot worse and is rebuilt
+		std::mt19937 rng{ 8 };
+		std::uniform_real_distribution<float> offset{ -4.f, 4.f };
+		for (size_t triIdx{}; triIdx < mesh.indices.size() / 3; ++triIdx)
+		{
+			const Vector3 move{ offset(rng), offset(rng), offset(rng) };
+			for (int corner{}; corner < 3; ++corner)
+			{
+				mesh.positions[mesh.indices[triIdx * 3 + corner]] += move;
+			}
+		}
+		mesh.RefitGeometry();
+		EXPECT_LE(mesh.bvh.GetCostRatio(), mesh.bvhRebuildCostRatio);
+		ExpectMeshMatchesBruteForce(mesh, 12);
+
+		// triangles appended at runtime are inserted into the existing tree
+		mesh.AppendTriangle({ { -9.f, -9.f, 0.f }, { 9.f, -9.f, 0.f }, { 0.f, 9.f, 0.f } });
+		EXPECT_EQ(401u, mesh.bvh.GetPrimitiveIndices().size());
+		ExpectMeshMatchesBruteForce(mesh, 13);
+
+		// full nodes take them in place, the earlier primitives keep their positions and packet lanes
+		const std::vector<uint32_t> primitiveOrder(mesh.bvh.GetPrimitiveIndices().begin(), mesh.bvh.GetPrimitiveIndices().end());
+		mesh.bvhRebuildCostRatio = FLT_MAX;
+		for (int idx{}; idx < 200; ++idx)
+		{
+			const Vector3 c{ offset(rng), offset(rng), offset(rng) };
+			mesh.AppendTriangle({ c, c + Vector3{ .3f, 0.f, 0.f }, c + Vector3{ 0.f, .3f, .1f } });
+		}
+		ASSERT_EQ(601u, mesh.bvh.GetPrimitiveIndices().size());
+		EXPECT_TRUE(std::equal(primitiveOrder.begin(), primitiveOrder.end(), mesh.bvh.GetPrimitiveIndices().begin()));
+		ExpectMeshMatchesBruteForce(mesh, 14);
+
+		// a node holding an appended leaf still only tests the packets its leaves are in, not the ones in between
+		for (const BVH8Node& node : mesh.bvh.GetWideNodes())
+		{
+			GeometryUtils::BVH8LeafRange leaves[BVH::WIDTH];
+			int leafCount{};
+			uint32_t maxPackets{};
+			for (int slot{}; slot < BVH::WIDTH; ++slot)
+			{
+				if (node.primitiveCount[slot] == 0) continue;
+				leaves[leafCount++] = { node.childIndex[slot], node.primitiveCount[slot], 0.f };
+				maxPackets += (node.childIndex[slot] + node.primitiveCount[slot] - 1) / TrianglePacket8::WIDTH - node.childIndex[slot] / TrianglePacket8::WIDTH + 1;
+			}
+
+			const GeometryUtils::LeafPacketGroups groups{ GeometryUtils::GroupLeafPackets(leaves, leafCount, FLT_MAX) };
+			uint32_t packetCount{};
+			for (int groupIdx{}; groupIdx < groups.groupCount; ++groupIdx) packetCount += groups.endPackets[groupIdx] - groups.firstPackets[groupIdx];
+			EXPECT_LE(packetCount, maxPackets);
+		}
+	}
+
+	TEST(BVH, QuantizedNodes) {
+		TriangleMesh mesh = CreateRandomMesh(2000, 21);
+		const size_t fullByteSize = mesh.bvh.GetTraversalByteSize();
+
+		for (const BVHNodeFormat format : { BVHNodeFormat::Quantized16, BVHNodeFormat::Quantized8 })
+		{
+			mesh.bvh.SetNodeFormat(format);
+			ASSERT_EQ(format, mesh.bvh.GetNodeFormat());
+			EXPECT_LT(mesh.bvh.GetTraversalByteSize(), fullByteSize);
+			ExpectMeshMatchesBruteForce(mesh, 31);
+
+			// a refit requantizes the touched nodes only, a rebuild keeps the format
+			std::vector<uint32_t> changedTriangles{ 3, 500, 1999 };
+			for (const uint32_t triIdx : changedTriangles)
+			{
+				mesh.positions[mesh.indices[triIdx * 3]] += Vector3{ -1.5f, 2.f, 1.f };
+			}
+			mesh.RefitGeometry(changedTriangles);
+			ExpectMeshMatchesBruteForce(mesh, 32);
+
+			mesh.UpdateGeometry();
+			EXPECT_EQ(format, mesh.bvh.GetNodeFormat());
+		}
+
+		// 8 bit nodes are 80 bytes against 256
+		EXPECT_LT(mesh.bvh.GetTraversalByteSize() * 2, fullByteSize);
+	}
+
+	TEST(BVH, SpatialSplits) {
+		// long thin triangles crossing the whole box, like walls added with AppendTriangle
+		std::mt19937 rng{ 17 };
+		std::uniform_real_distribution<float> position{ -5.f, 5.f };
+		std::uniform_real_distribution<float> offset{ -.2f, .2f };
+
+		TriangleMesh mesh{};
+		mesh.cullMode = TriangleCullMode::NoCulling;
+		for (int idx{}; idx < 300; ++idx)
+		{
+			const Vector3 start{ position(rng), position(rng), position(rng) };
+			const Vector3 end{ position(rng), position(rng), position(rng) };
+			mesh.AppendTriangle({ start, end, end + Vector3{ offset(rng), offset(rng), offset(rng) } }, true);
+		}
+		mesh.UpdateGeometry();
+		mesh.UpdateTransforms();
+		const float objectSplitCost = mesh.bvh.GetSAHCost();
+
+		mesh.bvh.SetBuildSettings({ BVHBuilder::SpatialSplit, .5f });
+		mesh.UpdateGeometry();
+
+		// duplicated references stay within the budget and buy a cheaper tree
+		EXPECT_GT(mesh.bvh.GetPrimitiveIndices().size(), 300u);
+		EXPECT_LE(mesh.bvh.GetPrimitiveIndices().size(), 450u);
+		EXPECT_LT(mesh.bvh.GetSAHCost(), objectSplitCost);
+		ExpectMeshMatchesBruteForce(mesh, 41);
+
+		// partial refits fall back to a full one, split triangles live in several leaves
+		mesh.positions[mesh.indices[0]] += Vector3{ 1.f, 1.f, 1.f };
+		mesh.RefitGeometry({ 0 });
+		ExpectMeshMatchesBruteForce(mesh, 42);
+	}
+
+	TEST(BVH, MortonBuilder) {
+		TriangleMesh mesh = CreateRandomMesh(3000, 51);
+		const float binnedCost = mesh.bvh.GetSAHCost();
+
+		for (const int mortonBits : { 30, 63 })
+		{
+			mesh.bvh.SetBuildSettings({ BVHBuilder::Morton, .3f, mortonBits, 0 });
+			mesh.UpdateGeometry();
+			ASSERT_EQ(3000u, mesh.bvh.GetPrimitiveIndices().size());
+			ExpectMeshMatchesBruteForce(mesh, 52);
+		}
+		const float mortonCost = mesh.bvh.GetSAHCost();
+
+		// treelet passes only ever replace a treelet by a cheaper one
+		mesh.bvh.SetBuildSettings({ BVHBuilder::Morton, .3f, 30, 2 });
+		mesh.UpdateGeometry();
+		EXPECT_LT(mesh.bvh.GetSAHCost(), mortonCost);
+		EXPECT_GT(mortonCost, binnedCost);
+		ExpectMeshMatchesBruteForce(mesh, 53);
+
+		// the tree is refitted and extended like any other
+		mesh.positions[mesh.indices[0]] += Vector3{ 1.f, -2.f, 1.f };
+		mesh.RefitGeometry({ 0 });
+		mesh.AppendTriangle({ { -9.f, -9.f, 0.f }, { 9.f, -9.f, 0.f }, { 0.f, 9.f, 0.f } });
+		ExpectMeshMatchesBruteForce(mesh, 54);
+	}
+
+	TEST(BVH, Cache) {
+		const std::filesystem::path cacheDirectory = std::filesystem::temp_directory_path() / "raytracer_bvh_cache_test";
+		std::filesystem::remove_all(cacheDirectory);
+
+		// the first build writes the cache, the second one maps it
+		TriangleMesh mesh = CreateRandomMesh(2000, 61);
+		BVH cachedBVH{};
+		EXPECT_FALSE(cachedBVH.Build(mesh.positions, mesh.indices, cacheDirectory.string()));
+		EXPECT_FALSE(cachedBVH.IsMapped());
+		ASSERT_TRUE(cachedBVH.Build(mesh.positions, mesh.indices, cacheDirectory.string()));
+		ASSERT_TRUE(cachedBVH.IsMapped());
+		EXPECT_FLOAT_EQ(mesh.bvh.GetSAHCost(), cachedBVH.GetSAHCost());
+
+		mesh.bvh = cachedBVH;
+		ExpectMeshMatchesBruteForce(mesh, 62);
+
+		// other settings or geometry miss the cache
+		BVH otherBVH{};
+		otherBVH.SetNodeFormat(BVHNodeFormat::Quantized8);
+		EXPECT_FALSE(otherBVH.Build(mesh.positions, mesh.indices, cacheDirectory.string()));
+		mesh.positions[0].x += 1.f;
+		EXPECT_FALSE(cachedBVH.Build(mesh.positions, mesh.indices, cacheDirectory.string()));
+
+		// a refit copies the mapped hierarchy into memory first
+		mesh.RefitGeometry({ 0 });
+		EXPECT_FALSE(mesh.bvh.IsMapped());
+		ExpectMeshMatchesBruteForce(mesh, 63);
+
+		// the same build writes the same bytes
+		std::filesystem::remove_all(cacheDirectory);
+		EXPECT_FALSE(cachedBVH.Build(mesh.positions, mesh.indices, cacheDirectory.string()));
+		const std::filesystem::path cacheFile = std::filesystem::directory_iterator{ cacheDirectory }->path();
+		const auto readFile = [&cacheFile]
+			{
+				std::ifstream file{ cacheFile, std::ios::binary };
+				return std::vector<char>{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+			};
+		const std::vector<char> cacheBytes = readFile();
+		std::filesystem::remove(cacheFile);
+		EXPECT_FALSE(cachedBVH.Build(mesh.positions, mesh.indices, cacheDirectory.string()));
+		EXPECT_EQ(cacheBytes, readFile());
+
+		// a child index past the end with a valid header is refused and the file is rebuilt
+		{
+			// leftFirst of the binary root, the nodes start on the first cache line after the header
+			std::fstream file{ cacheFile, std::ios::binary | std::ios::in | std::ios::out };
+			const uint32_t badChild{ 0xfffffff0 };
+			file.seekp(128 + 12);
+			file.write(reinterpret_cast<const char*>(&badChild), sizeof(badChild));
+		}
+		EXPECT_FALSE(cachedBVH.Build(mesh.positions, mesh.indices, cacheDirectory.string()));
+		EXPECT_TRUE(cachedBVH.Build(mesh.positions, mesh.indices, cacheDirectory.string()));
+
+		std::filesystem::remove_all(cacheDirectory);
+	}
+
+	// Lots of small spheres, no planes, so every hit goes through the top-level hierarchy
+	class Scene_ManySpheres final : public Scene
+	{
+	public:
+		explicit Scene_ManySpheres(int sphereCount = 2000, bool spheresInTopLevelBVH = true) :
+			m_SphereCount(sphereCount)
+		{
+			m_bSpheresInTopLevelBVH = spheresInTopLevelBVH;
+		}
+
+		void Initialize() override
+		{
+			std::mt19937 rng{ 7 };
+			std::uniform_real_distribution<float> position{ -10.f, 10.f };
+			std::uniform_real_distribution<float> radius{ .05f, .5f };
+
+			for (int idx{}; idx < m_SphereCount; ++idx)
+			{
+				// the material tells apart which primitive the hit record was built from
+				AddSphere({ position(rng), position(rng), position(rng) }, radius(rng), static_cast<unsigned char>(idx % 200));
+			}
+
+			// behind and below everything, they catch most of the rays that miss the spheres
+			AddPlane({ 0.f, 0.f, 20.f }, { 0.f, 0.f, -1.f }, 200);
+			AddPlane({ 0.f, -12.f, 0.f }, { 0.f, 1.f, 0.f }, 201);
+		}
+
+		void MoveSpheres(const Vector3& offset)
+		{
+			for (size_t idx{}; idx < m_SphereGeometries.size(); idx += 2)
+			{
+				m_SphereGeometries[idx].origin += offset;
+			}
+			RefitAccelerationStructure();
+		}
+
+	private:
+		int m_SphereCount;
+	};
+
+	static void ExpectSceneMatchesBruteForce(const Scene& scene)
+	{
+		std::mt19937 rng{ 42 };
+		std::uniform_real_distribution<float> target{ -10.f, 10.f };
+
+		// carried from ray to ray like in the renderer, a stale occluder must never decide the answer
+		ShadowOccluder lastOccluder{};
+		// every 8 rays are traced again as one packet
+		RayPacket8 packet{};
+		HitRecord expectedHits[RayPacket8::WIDTH]{};
+		for (int idx{}; idx < 1000; ++idx)
+		{
+			const Vector3 origin{ target(rng), target(rng), -30.f };
+			const Ray ray{ origin, (Vector3{ target(rng), target(rng), target(rng) } - origin).Normalized() };
+
+			HitRecord expected{};
+			HitRecord tempHit{};
+			for (const Sphere& sphere : scene.GetSphereGeometries())
+			{
+				if (GeometryUtils::HitTest_Sphere(sphere, ray, tempHit) && tempHit.t < expected.t)
+				{
+					expected = tempHit;
+				}
+			}
+			for (const Plane& plane : scene.GetPlaneGeometries())
+			{
+				if (GeometryUtils::HitTest_Plane(plane, ray, tempHit) && tempHit.t < expected.t)
+				{
+					expected = tempHit;
+				}
+			}
+
+			HitRecord actual{};
+			scene.GetClosestHit(ray, actual);
+
+			ASSERT_EQ(expected.didHit, actual.didHit);
+			ASSERT_EQ(expected.didHit, scene.DoesHit(ray));
+			ASSERT_EQ(expected.didHit, scene.DoesHit(ray, lastOccluder));
+			if (expected.didHit)
+			{
+				ASSERT_FLOAT_EQ(expected.t, actual.t);
+				ASSERT_EQ(expected.normal, actual.normal);
+				ASSERT_EQ(expected.origin, actual.origin);
+				ASSERT_EQ(expected.materialIndex, actual.materialIndex);
+			}
+
+			packet.SetRay(idx % RayPacket8::WIDTH, ray);
+			expectedHits[idx % RayPacket8::WIDTH] = expected;
+			if (idx % RayPacket8::WIDTH == RayPacket8::WIDTH - 1)
+			{
+				HitRecord packetHits[RayPacket8::WIDTH]{};
+				scene.GetClosestHits(packet, packetHits);
+				for (int lane{}; lane < RayPacket8::WIDTH; ++lane)
+				{
+					ASSERT_EQ(expectedHits[lane].didHit, packetHits[lane].didHit);
+					if (!expectedHits[lane].didHit) continue;
+
+					ASSERT_FLOAT_EQ(expectedHits[lane].t, packetHits[lane].t);
+					ASSERT_EQ(expectedHits[lane].normal, packetHits[lane].normal);
+					ASSERT_EQ(expectedHits[lane].materialIndex, packetHits[lane].materialIndex);
+				}
+				packet = {};
+			}
+		}
+	}
+
+	TEST(SceneBVH, MatchesBruteForce) {
+		Scene_ManySpheres scene{};
+		scene.Initialize();
+		scene.BuildAccelerationStructure();
+		ExpectSceneMatchesBruteForce(scene);
+
+		// refit only, the topology stays the same
+		scene.MoveSpheres({ 3.f, -2.f, 1.f });
+		ExpectSceneMatchesBruteForce(scene);
+	}
+
+	TEST(SceneBVH, FlatSpherePackets) {
+		// no hierarchy over the spheres, every ray tests all of them 8 at a time
+		Scene_ManySpheres scene{ 10000, false };
+		scene.Initialize();
+		scene.BuildAccelerationStructure();
+		ExpectSceneMatchesBruteForce(scene);
+
+		scene.MoveSpheres({ -1.f, 2.f, .5f });
+		ExpectSceneMatchesBruteForce(scene);
+	}
+
+	TEST(SimdDispatch, EveryLevelMatchesBruteForce) {
+		Scene_ManySpheres topLevelScene{}, flatScene{ 2000, false };
+		topLevelScene.Initialize();
+		topLevelScene.BuildAccelerationStructure();
+		flatScene.Initialize();
+		flatScene.BuildAccelerationStructure();
+
+		// levels above what this CPU runs are clamped, so every level can be asked for
+		const SimdLevel detectedLevel{ DetectSimdLevel() };
+		for (SimdLevel level : { SimdLevel::SSE2, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512 })
+		{
+			EXPECT_EQ(SetSimdLevel(level), std::min(level, detectedLevel));
+			ExpectSceneMatchesBruteForce(topLevelScene);
+			ExpectSceneMatchesBruteForce(flatScene);
+		}
+		SetSimdLevel(detectedLevel);
+
+		SimdLevel parsedLevel{};
+		EXPECT_TRUE(ParseSimdLevel("sse4.1", parsedLevel));
+		EXPECT_EQ(parsedLevel, SimdLevel::SSE41);
+		EXPECT_FALSE(ParseSimdLevel("neon", parsedLevel));
+	}
+
+	TEST(PixelSamples, RunningError) {
+		PixelSamples constant{};
+		for (int idx{}; idx < 10; ++idx) constant.Add({ .5f, .5f, .5f });
+		EXPECT_FLOAT_EQ(.5f, constant.GetMean().g);
+		EXPECT_NEAR(0.f, constant.GetError(), 1e-6f);
+
+		// white and black alternating, luminance variance 1/4 * n / (n - 1)
+		PixelSamples penumbra{};
+		EXPECT_EQ(FLT_MAX, penumbra.GetError());
+		for (int idx{}; idx < 16; ++idx) penumbra.Add(idx % 2 ? colors::White : colors::Black);
+		EXPECT_FLOAT_EQ(.5f, penumbra.GetMean().r);
+		EXPECT_NEAR(std::sqrt(.25f * 16.f / 15.f / 16.f), penumbra.GetError(), 1e-5f);
+	}
+
+	TEST(PixelSamples, PenumbraDoesNotConvergeEarly) {
+		// 1 in 10 shadow rays occluded, the first 4 passes happened to see the light every time
+		PixelSamples samples{};
+		for (int idx{}; idx < 4; ++idx) samples.Add(colors::White);
+		EXPECT_NEAR(0.f, samples.GetError(), 1e-6f);
+		EXPECT_FALSE(samples.IsConverged(Renderer::DEFAULT_ADAPTIVE_THRESHOLD));
+
+		// once the occluded rays show up the error keeps it from converging
+		for (uint32_t idx{ samples.count }; idx < PixelSamples::MIN_SAMPLES; ++idx) samples.Add(idx % 4 ? colors::White : ColorRGB{ .7f, .7f, .7f });
+		EXPECT_GT(samples.GetError(), Renderer::DEFAULT_ADAPTIVE_THRESHOLD);
+		EXPECT_FALSE(samples.IsConverged(Renderer::DEFAULT_ADAPTIVE_THRESHOLD));
+
+		PixelSamples lit{};
+		for (uint32_t idx{}; idx < PixelSamples::MIN_SAMPLES; ++idx) lit.Add(colors::White);
+		EXPECT_TRUE(lit.IsConverged(Renderer::DEFAULT_ADAPTIVE_THRESHOLD));
+	}
+
+	TEST(ThreadPool, RunsEveryTaskOnce) {
+		std::vector<std::atomic<uint32_t>> runs(1000);
+		for (uint32_t threadCount : { 1u, 3u, 8u })
+		{
+			ThreadPool pool{ threadCount };
+			EXPECT_EQ(threadCount, pool.GetThreadCount());
+
+			// uneven task costs so the workers have to steal, fewer tasks than threads and no tasks at all
+			for (uint32_t taskCount : { 1000u, 5u, 0u, 1000u })
+			{
+				for (std::atomic<uint32_t>& count : runs) count = 0;
+				pool.ParallelFor(taskCount, [&](uint32_t index)
+					{
+						if (index < 50) std::this_thread::sleep_for(std::chrono::microseconds(200));
+						++runs[index];
+					});
+
+				for (uint32_t index{}; index < runs.size(); ++index)
+				{
+					ASSERT_EQ(index < taskCount ? 1u : 0u, runs[index].load());
+				}
+			}
+		}
+	}
+
+	TEST(ResolutionController, HoldsTargetFrameTime) {
+		// frames cost a fixed part plus a part that grows with the pixel count
+		const auto getFrameTime = [](float scale, float fullFrameTime) { return 2.f + fullFrameTime * scale * scale; };
+
+		ResolutionController controller{ 16.f };
+		for (int frame{}; frame < 60; ++frame) controller.Update(getFrameTime(controller.GetScale(), 60.f));
+		EXPECT_NEAR(16.f, getFrameTime(controller.GetScale(), 60.f), 16.f * .1f);
+
+		// a cheap view goes back to full size, one too heavy for the target stops at the minimum scale
+		for (int frame{}; frame < 60; ++frame) controller.Update(getFrameTime(controller.GetScale(), 8.f));
+		EXPECT_EQ(1.f, controller.GetScale());
+		for (int frame{}; frame < 60; ++frame) controller.Update(getFrameTime(controller.GetScale(), 10000.f));
+		EXPECT_EQ(ResolutionController::MIN_SCALE, controller.GetScale());
+
+		controller.SetTargetFrameTime(0.f);
+		EXPECT_EQ(1.f, controller.GetScale());
+		EXPECT_EQ(1.f, controller.Update(100.f));
+	}
+
 	int main(int argc, char** argv) {
 		::testing::InitGoogleTest(&argc, argv);
 		return RUN_ALL_TESTS();